@@ -4,6 +4,8 @@ if os.get() == "windows" then
 	platform = "win32"
 elseif os.get() == "macosx" then
 	platform = "osx"
+elseif os.get() == "linux" then
+	platform = "linux"
 else
 	error("unrecognized platform")
 end
@@ -34,24 +36,43 @@ project "TheGrid"
 		"src/" .. platform .. "/*.h"
 	}		
     includedirs {
-		"libs/SDL/include",
 		"libs/FreeImage/include",
 		"libs/enet-1.3.6/include",
 		"libs/bass/include",
 	}
-	libdirs {
-		"libs/SDL/lib",
-		"libs/FreeImage/lib",
-		"libs/enet-1.3.6",
-		"libs/bass/lib",
-	}
-    links {
-		"SDL",
-		"SDLmain",
+	links {
 		"freeimage",
 		"enet",
 		"bass",
 	}
+	if platform == "linux" then
+		-- The libraries in libs are Windows builds, so the system's SDL 1.2,
+		-- FreeImage and ENet are used, along with libbass.so from un4seen.
+		buildoptions { "`sdl-config --cflags`" }
+		linkoptions { "`sdl-config --libs`" }
+		libdirs {
+			"libs/bass/lib",
+		}
+		links {
+			"GL",
+			"GLU",
+			"pthread",
+		}
+	else
+		includedirs {
+			"libs/sdl/include",
+		}
+		libdirs {
+			"libs/sdl/lib",
+			"libs/FreeImage/lib",
+			"libs/enet-1.3.6",
+			"libs/bass/lib",
+		}
+		links {
+			"SDL",
+			"SDLmain",
+		}
+	end
 	if platform == "win32" then
 		links {
 			"opengl32",
@@ -1,10 +1,42 @@
 #include "AgentEntity.h"
+#include "Message.h"
 
 AgentEntity::AgentEntity()
 {
     m_currentStop   = -1;
     m_targetStop    = -1;
+    m_destinationStop = -1;
     m_arrivalTime   = 0;
     m_intel         = -1;
     m_state         = State_Idle;
 }
+
+void AgentEntity::Serialize(MessageWriter& writer) const
+{
+    Entity::Serialize(writer);
+    writer.WriteVarInt(m_currentStop);
+    writer.WriteVarInt(m_intel);
+    writer.WriteVarUInt(m_state);
+    writer.WriteVarInt(m_destinationStop);
+    writer.WriteVarInt(m_targetStop);
+    writer.WriteFloat(m_departureTime);
+    writer.WriteFloat(m_arrivalTime);
+}
+
+void AgentEntity::Deserialize(MessageReader& reader)
+{
+
+    Entity::Deserialize(reader);
+    reader.ReadVarInt(m_currentStop);
+    reader.ReadVarInt(m_intel);
+
+    unsigned int state = State_Idle;
+    reader.ReadVarUInt(state);
+    m_state = state <= State_Stakeout ? static_cast<State>(state) : State_Idle;
+
+    reader.ReadVarInt(m_destinationStop);
+    reader.ReadVarInt(m_targetStop);
+    reader.ReadFloat(m_departureTime);
+    reader.ReadFloat(m_arrivalTime);
+
+}
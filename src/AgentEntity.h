@@ -18,11 +18,17 @@ public:
     };
 
     AgentEntity();
+
+    void Serialize(MessageWriter& writer) const;
+    void Deserialize(MessageReader& reader);
     
     int     m_currentStop;
     int     m_intel;
     State   m_state;
     
+    // Final stop of the route the agent is following, or -1
+    int     m_destinationStop;
+
     // Movement hack
     int     m_targetStop;
     float   m_departureTime;
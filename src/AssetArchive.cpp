@@ -0,0 +1,298 @@
+#include "AssetArchive.h"
+#include "Texture.h"
+#include "Log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+const unsigned int kArchiveMagic    = 0x4B415047; // "GPAK"
+const unsigned int kArchiveVersion  = 2;
+
+// The data for each entry starts on a multiple of this, so pixel rows can be
+// copied with aligned loads.
+const size_t kDataAlignment = 16;
+
+struct ArchiveHeader
+{
+    unsigned int    magic;
+    unsigned int    version;
+    int             numEntries;
+    int             reserved;
+};
+
+static size_t GetAlignedSize(size_t size)
+{
+    return (size + kDataAlignment - 1) & ~(kDataAlignment - 1);
+}
+
+// Reads a whole file into data. Returns false if it couldn't be read.
+static bool ReadFile(const char* fileName, std::vector<unsigned char>& data)
+{
+
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data.resize(size > 0 ? size : 0);
+    bool read = size > 0 && fread(&data[0], 1, data.size(), file) == data.size();
+
+    fclose(file);
+    return read;
+
+}
+
+AssetArchive::AssetArchive()
+{
+    m_entries       = NULL;
+    m_numEntries    = 0;
+}
+
+bool AssetArchive::Open(const char* fileName)
+{
+
+    Close();
+
+    if (!m_file.Open(fileName))
+    {
+        return false;
+    }
+
+    const unsigned char* data = static_cast<const unsigned char*>(m_file.GetData());
+    size_t size = m_file.GetSize();
+
+    ArchiveHeader header;
+    if (size < sizeof(header))
+    {
+        m_file.Close();
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != kArchiveMagic || header.version != kArchiveVersion ||
+        header.numEntries < 0 ||
+        static_cast<size_t>(header.numEntries) > (size - sizeof(header)) / sizeof(Entry))
+    {
+        LogError("Ignoring invalid asset archive '%s'", fileName);
+        m_file.Close();
+        return false;
+    }
+
+    // Check everything up front so lookups don't have to.
+    const Entry* entries = reinterpret_cast<const Entry*>(data + sizeof(header));
+    for (int i = 0; i < header.numEntries; ++i)
+    {
+        const Entry& entry = entries[i];
+        bool valid = memchr(entry.fileName, 0, s_maxName) != NULL &&
+                     entry.offset <= size && entry.size <= size - entry.offset;
+        if (valid && entry.type == EntryType_Image)
+        {
+            valid = entry.xSize > 0 && entry.ySize > 0 && entry.xSize <= 0x4000 && entry.ySize <= 0x4000 &&
+                    entry.size == static_cast<unsigned int>(entry.xSize * entry.ySize * 4);
+        }
+        if (!valid)
+        {
+            LogError("Ignoring invalid asset archive '%s'", fileName);
+            m_file.Close();
+            return false;
+        }
+    }
+
+    m_entries       = entries;
+    m_numEntries    = header.numEntries;
+    return true;
+
+}
+
+void AssetArchive::Close()
+{
+    m_file.Close();
+    m_entries       = NULL;
+    m_numEntries    = 0;
+}
+
+const unsigned char* AssetArchive::FindImage(const char* fileName, int& xSize, int& ySize) const
+{
+
+    const Entry* entry = Find(fileName, EntryType_Image);
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    xSize = entry->xSize;
+    ySize = entry->ySize;
+    return static_cast<const unsigned char*>(m_file.GetData()) + entry->offset;
+
+}
+
+const void* AssetArchive::FindFile(const char* fileName, size_t& size) const
+{
+
+    const Entry* entry = Find(fileName, EntryType_File);
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    size = entry->size;
+    return static_cast<const unsigned char*>(m_file.GetData()) + entry->offset;
+
+}
+
+const AssetArchive::Entry* AssetArchive::Find(const char* fileName, EntryType type) const
+{
+
+    const Entry* entry = NULL;
+    for (int i = 0; i < m_numEntries && entry == NULL; ++i)
+    {
+        if (m_entries[i].type == type && strcmp(m_entries[i].fileName, fileName) == 0)
+        {
+            entry = &m_entries[i];
+        }
+    }
+
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    // The archive may be shipped without the files it was packed from, in
+    // which case it's used as is.
+    unsigned int size;
+    unsigned int time;
+    if (GetSourceStamp(fileName, size, time) && (size != entry->sourceSize || time != entry->sourceTime))
+    {
+        LogDebug("'%s' has changed since it was packed", fileName);
+        return NULL;
+    }
+
+    return entry;
+
+}
+
+bool AssetArchive::GetSourceStamp(const char* fileName, unsigned int& size, unsigned int& time)
+{
+
+    struct stat status;
+    if (stat(fileName, &status) != 0)
+    {
+        return false;
+    }
+
+    size = static_cast<unsigned int>(status.st_size);
+    time = static_cast<unsigned int>(status.st_mtime);
+    return true;
+
+}
+
+bool AssetArchive::Write(const char* archiveName, const std::vector<std::string>& imageFiles, const std::vector<std::string>& otherFiles)
+{
+
+    int numEntries = static_cast<int>(imageFiles.size() + otherFiles.size());
+
+    std::vector<Entry> entries(numEntries);
+    std::vector< std::vector<unsigned char> > contents(numEntries);
+
+    size_t offset = GetAlignedSize(sizeof(ArchiveHeader) + numEntries * sizeof(Entry));
+
+    for (int i = 0; i < numEntries; ++i)
+    {
+
+        bool isImage = i < static_cast<int>(imageFiles.size());
+        const std::string& fileName = isImage ? imageFiles[i] : otherFiles[i - imageFiles.size()];
+
+        if (fileName.length() >= static_cast<size_t>(s_maxName))
+        {
+            LogError("Asset file name is too long to pack: '%s'", fileName.c_str());
+            return false;
+        }
+
+        Entry& entry = entries[i];
+        memset(&entry, 0, sizeof(entry));
+        strcpy(entry.fileName, fileName.c_str());
+
+        if (!GetSourceStamp(fileName.c_str(), entry.sourceSize, entry.sourceTime))
+        {
+            LogError("Couldn't read '%s'", fileName.c_str());
+            return false;
+        }
+
+        if (isImage)
+        {
+            unsigned char* pixels = Texture_LoadPixels(fileName.c_str(), entry.xSize, entry.ySize);
+            if (pixels == NULL)
+            {
+                LogError("Couldn't load texture '%s'", fileName.c_str());
+                return false;
+            }
+            contents[i].assign(pixels, pixels + entry.xSize * entry.ySize * 4);
+            free(pixels);
+            entry.type = EntryType_Image;
+        }
+        else
+        {
+            if (!ReadFile(fileName.c_str(), contents[i]))
+            {
+                LogError("Couldn't read '%s'", fileName.c_str());
+                return false;
+            }
+            entry.type = EntryType_File;
+        }
+
+        entry.offset    = static_cast<unsigned int>(offset);
+        entry.size      = static_cast<unsigned int>(contents[i].size());
+        offset += GetAlignedSize(contents[i].size());
+
+    }
+
+    ArchiveHeader header;
+    header.magic        = kArchiveMagic;
+    header.version      = kArchiveVersion;
+    header.numEntries   = numEntries;
+    header.reserved     = 0;
+
+    FILE* file = fopen(archiveName, "wb");
+    if (file == NULL)
+    {
+        LogError("Couldn't write the asset archive '%s'", archiveName);
+        return false;
+    }
+
+    const char padding[kDataAlignment] = { 0 };
+
+    size_t indexSize = sizeof(header) + numEntries * sizeof(Entry);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (numEntries > 0)
+    {
+        written = written && fwrite(&entries[0], sizeof(Entry), numEntries, file) == static_cast<size_t>(numEntries);
+    }
+    written = written && fwrite(padding, 1, GetAlignedSize(indexSize) - indexSize, file) == GetAlignedSize(indexSize) - indexSize;
+
+    for (int i = 0; i < numEntries && written; ++i)
+    {
+        size_t size = contents[i].size();
+        written = fwrite(&contents[i][0], 1, size, file) == size &&
+                  fwrite(padding, 1, GetAlignedSize(size) - size, file) == GetAlignedSize(size) - size;
+    }
+
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        LogError("Couldn't write the asset archive '%s'", archiveName);
+        remove(archiveName);
+        return false;
+    }
+
+    LogMessage("Packed %d assets into '%s' (%d KB)", numEntries, archiveName, static_cast<int>(offset / 1024));
+    return true;
+
+}
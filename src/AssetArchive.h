@@ -0,0 +1,77 @@
+#ifndef GAME_ASSET_ARCHIVE_H
+#define GAME_ASSET_ARCHIVE_H
+
+#include "MappedFile.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * A single file holding the game's assets ready to use, written offline by
+ * Write. Images are stored already decoded as RGBA pixels in the layout
+ * Render_CreateTexture takes, and other files are stored as they are. The
+ * archive is mapped into memory so the data is used in place. The size and
+ * modification time of each source file are recorded, and an entry whose file
+ * has changed since is treated as missing so the file is loaded instead.
+ */
+class AssetArchive
+{
+
+public:
+
+    AssetArchive();
+
+    // Returns false if the file doesn't exist or isn't a valid archive.
+    bool Open(const char* fileName);
+    void Close();
+
+    bool GetIsOpen() const { return m_entries != NULL; }
+
+    // Returns the pixels of the image that was packed from fileName, or NULL
+    // if it isn't in the archive or the file has changed.
+    const unsigned char* FindImage(const char* fileName, int& xSize, int& ySize) const;
+
+    // Returns the contents of a file stored as is, or NULL if it isn't in the
+    // archive or the file has changed.
+    const void* FindFile(const char* fileName, size_t& size) const;
+
+    // Decodes the images and reads the other files and writes them all to an
+    // archive. Returns false if any of them couldn't be loaded.
+    static bool Write(const char* archiveName, const std::vector<std::string>& imageFiles, const std::vector<std::string>& otherFiles);
+
+private:
+
+    enum EntryType
+    {
+        EntryType_Image,
+        EntryType_File,
+    };
+
+    static const int s_maxName = 64;
+
+    struct Entry
+    {
+        char            fileName[s_maxName];
+        int             type;
+        int             xSize;
+        int             ySize;
+        unsigned int    offset;     // From the start of the archive
+        unsigned int    size;
+        unsigned int    sourceSize; // Of the file the entry was packed from
+        unsigned int    sourceTime; // Low bits of the file's modification time
+    };
+
+    const Entry* Find(const char* fileName, EntryType type) const;
+
+    // Returns false if the file doesn't exist.
+    static bool GetSourceStamp(const char* fileName, unsigned int& size, unsigned int& time);
+
+private:
+
+    MappedFile          m_file;
+    const Entry*        m_entries;
+    int                 m_numEntries;
+
+};
+
+#endif
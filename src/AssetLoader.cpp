@@ -0,0 +1,353 @@
+#include "AssetLoader.h"
+#include "Texture.h"
+#include "TextureAtlas.h"
+#include "Timer.h"
+#include "Log.h"
+
+#include <SDL.h>
+
+#include <stdlib.h>
+#include <algorithm>
+
+AssetLoader::AssetLoader()
+{
+    m_numDelivered  = 0;
+    m_startTime     = 0.0;
+    m_loadTime      = 0.0;
+    m_mutex         = SDL_CreateMutex();
+    m_quit          = false;
+    m_nextJob       = 0;
+}
+
+AssetLoader::~AssetLoader()
+{
+
+    SDL_mutexP(m_mutex);
+    m_quit = true;
+    SDL_mutexV(m_mutex);
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        SDL_WaitThread(m_threads[i], NULL);
+    }
+
+    // Anything decoded but never delivered is still owned by the job.
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        if (!m_jobs[i].archived)
+        {
+            free(const_cast<unsigned char*>(m_jobs[i].pixels));
+        }
+        if (m_jobs[i].loadedSample != 0)
+        {
+            BASS_SampleFree(m_jobs[i].loadedSample);
+        }
+    }
+
+    SDL_DestroyMutex(m_mutex);
+
+}
+
+bool AssetLoader::OpenArchive(const char* fileName)
+{
+    return m_archive.Open(fileName);
+}
+
+void AssetLoader::LoadTexture(Texture& texture, const char* fileName, TextureAtlas* atlas)
+{
+
+    texture.xSize   = 0;
+    texture.ySize   = 0;
+    texture.handle  = 0;
+    texture.u1      = 0.0f;
+    texture.v1      = 0.0f;
+    texture.u2      = 1.0f;
+    texture.v2      = 1.0f;
+
+    Job job;
+    job.texture         = &texture;
+    job.atlas           = atlas;
+    job.sample          = NULL;
+    job.fileName        = fileName;
+    job.pixels          = NULL;
+    job.xSize           = 0;
+    job.ySize           = 0;
+    job.loadedSample    = 0;
+    job.archived        = false;
+    job.delivered       = false;
+    m_jobs.push_back(job);
+
+}
+
+void AssetLoader::LoadSample(HSAMPLE& sample, const char* fileName)
+{
+
+    sample = 0;
+
+    Job job;
+    job.texture         = NULL;
+    job.atlas           = NULL;
+    job.sample          = &sample;
+    job.fileName        = fileName;
+    job.pixels          = NULL;
+    job.xSize           = 0;
+    job.ySize           = 0;
+    job.loadedSample    = 0;
+    job.archived        = false;
+    job.delivered       = false;
+    m_jobs.push_back(job);
+
+}
+
+const void* AssetLoader::LoadFile(const char* fileName, size_t& size)
+{
+    m_files.push_back(fileName);
+    return m_archive.FindFile(fileName, size);
+}
+
+void AssetLoader::Start(int numThreads)
+{
+
+    m_startTime = Timer_GetTime();
+
+    // Whatever is in the archive is ready to upload straight away, and the
+    // workers skip over it.
+    int numArchived = 0;
+    for (size_t i = 0; i < m_jobs.size() && m_archive.GetIsOpen(); ++i)
+    {
+        Job& job = m_jobs[i];
+        if (job.texture != NULL)
+        {
+            job.pixels = m_archive.FindImage(job.fileName.c_str(), job.xSize, job.ySize);
+            job.archived = job.pixels != NULL;
+        }
+        else
+        {
+            size_t size;
+            const void* data = m_archive.FindFile(job.fileName.c_str(), size);
+            if (data != NULL)
+            {
+                job.loadedSample = BASS_SampleLoad(true, data, 0, static_cast<DWORD>(size), 3, BASS_SAMPLE_OVER_POS);
+                job.archived = true;
+            }
+        }
+        if (job.archived)
+        {
+            m_decoded.push_back(static_cast<int>(i));
+            ++numArchived;
+        }
+    }
+
+    if (m_archive.GetIsOpen())
+    {
+        LogDebug("Found %d of %d assets in the archive", numArchived, static_cast<int>(m_jobs.size()));
+    }
+    if (numArchived == static_cast<int>(m_jobs.size()))
+    {
+        return;
+    }
+
+    // The decoder isn't safe to set up from several threads at once.
+    Texture_Initialize();
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        SDL_Thread* thread = SDL_CreateThread(ThreadMain, this);
+        if (thread == NULL)
+        {
+            LogError("Failed to create an asset loader thread: %s", SDL_GetError());
+            break;
+        }
+        m_threads.push_back(thread);
+    }
+
+    // Without any workers everything is loaded up front.
+    if (m_threads.empty())
+    {
+        Run();
+    }
+
+}
+
+bool AssetLoader::Update(int maxUploads)
+{
+
+    if (GetIsDone())
+    {
+        return true;
+    }
+
+    std::vector<int> decoded;
+
+    SDL_mutexP(m_mutex);
+    int numDecoded = static_cast<int>(m_decoded.size());
+    if (numDecoded > maxUploads)
+    {
+        numDecoded = maxUploads;
+    }
+    decoded.assign(m_decoded.begin(), m_decoded.begin() + numDecoded);
+    m_decoded.erase(m_decoded.begin(), m_decoded.begin() + numDecoded);
+    SDL_mutexV(m_mutex);
+
+    for (size_t i = 0; i < decoded.size(); ++i)
+    {
+        Deliver(m_jobs[decoded[i]]);
+        m_jobs[decoded[i]].delivered = true;
+    }
+
+    m_numDelivered += numDecoded;
+    if (!GetIsDone())
+    {
+        return false;
+    }
+
+    m_loadTime = Timer_GetTime() - m_startTime;
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        SDL_WaitThread(m_threads[i], NULL);
+    }
+    m_threads.clear();
+
+    return true;
+
+}
+
+bool AssetLoader::Pack(const char* archiveName)
+{
+
+    std::vector<std::string> imageFiles;
+    std::vector<std::string> otherFiles = m_files;
+
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        std::vector<std::string>& files = m_jobs[i].texture != NULL ? imageFiles : otherFiles;
+        if (std::find(files.begin(), files.end(), m_jobs[i].fileName) == files.end())
+        {
+            files.push_back(m_jobs[i].fileName);
+        }
+    }
+
+    return AssetArchive::Write(archiveName, imageFiles, otherFiles);
+
+}
+
+bool AssetLoader::GetIsDone() const
+{
+    return m_numDelivered == static_cast<int>(m_jobs.size());
+}
+
+int AssetLoader::GetNumQueued() const
+{
+    return static_cast<int>(m_jobs.size());
+}
+
+bool AssetLoader::GetIsDelivered(int numFiles) const
+{
+    for (int i = 0; i < numFiles; ++i)
+    {
+        if (!m_jobs[i].delivered)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+double AssetLoader::GetLoadTime() const
+{
+    return m_loadTime;
+}
+
+int AssetLoader::ThreadMain(void* data)
+{
+    static_cast<AssetLoader*>(data)->Run();
+    return 0;
+}
+
+void AssetLoader::Run()
+{
+
+    SDL_mutexP(m_mutex);
+
+    while (!m_quit)
+    {
+
+        // Jobs in the archive were finished before the workers started.
+        while (m_nextJob < static_cast<int>(m_jobs.size()) && m_jobs[m_nextJob].archived)
+        {
+            ++m_nextJob;
+        }
+        if (m_nextJob == static_cast<int>(m_jobs.size()))
+        {
+            break;
+        }
+
+        int index = m_nextJob;
+        ++m_nextJob;
+
+        // Only this thread touches the job until it's put on m_decoded.
+        SDL_mutexV(m_mutex);
+
+        Job& job = m_jobs[index];
+        if (job.texture != NULL)
+        {
+            job.pixels = Texture_LoadPixels(job.fileName.c_str(), job.xSize, job.ySize);
+        }
+        else
+        {
+            job.loadedSample = BASS_SampleLoad(false, job.fileName.c_str(), 0, 0, 3, BASS_SAMPLE_OVER_POS);
+        }
+
+        SDL_mutexP(m_mutex);
+        m_decoded.push_back(index);
+
+    }
+
+    SDL_mutexV(m_mutex);
+
+}
+
+void AssetLoader::Deliver(Job& job)
+{
+
+    if (job.sample != NULL)
+    {
+        if (job.loadedSample == 0)
+        {
+            LogError("Couldn't load sample '%s'", job.fileName.c_str());
+        }
+        *job.sample = job.loadedSample;
+        job.loadedSample = 0;
+        return;
+    }
+
+    if (job.pixels == NULL)
+    {
+        LogError("Couldn't load texture '%s'", job.fileName.c_str());
+        return;
+    }
+
+    Texture& texture = *job.texture;
+    if (job.atlas != NULL)
+    {
+        job.atlas->Insert(texture, job.pixels, job.xSize, job.ySize);
+    }
+    else
+    {
+        texture.xSize   = job.xSize;
+        texture.ySize   = job.ySize;
+        texture.handle  = Render_CreateTexture(job.xSize, job.ySize, job.pixels, 0);
+        texture.u1      = 0.0f;
+        texture.v1      = 0.0f;
+        texture.u2      = 1.0f;
+        texture.v2      = 1.0f;
+    }
+
+    if (!job.archived)
+    {
+        free(const_cast<unsigned char*>(job.pixels));
+    }
+    job.pixels = NULL;
+
+}
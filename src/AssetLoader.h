@@ -0,0 +1,109 @@
+#ifndef GAME_ASSET_LOADER_H
+#define GAME_ASSET_LOADER_H
+
+#include "AssetArchive.h"
+
+#include <bass.h>
+
+#include <string>
+#include <vector>
+
+struct Texture;
+class TextureAtlas;
+struct SDL_Thread;
+struct SDL_mutex;
+
+/**
+ * Loads textures and samples in the background so the game can show a frame
+ * before everything has been read. Files are decoded on worker threads in the
+ * order they're queued; the finished images are handed back to the main
+ * thread, which owns the GL context, and uploaded a few at a time by Update.
+ * Until then a queued Texture has a handle of 0 and a queued sample is 0.
+ * Files found in the asset archive, if one is open, skip the workers and are
+ * uploaded straight from the mapped archive.
+ */
+class AssetLoader
+{
+
+public:
+
+    AssetLoader();
+    ~AssetLoader();
+
+    // Uses the assets in the archive in place of the individual files.
+    // Returns false if it couldn't be opened.
+    bool OpenArchive(const char* fileName);
+
+    // Queues a file to be loaded. Must be called before Start. If an atlas is
+    // given the image is inserted into it rather than given its own texture.
+    void LoadTexture(Texture& texture, const char* fileName, TextureAtlas* atlas = NULL);
+    void LoadSample(HSAMPLE& sample, const char* fileName);
+
+    // Returns the contents of a file from the archive, or NULL if it isn't in
+    // the archive and must be read from disk. The file is packed by Pack.
+    const void* LoadFile(const char* fileName, size_t& size);
+
+    // Begins decoding the queued files on numThreads worker threads.
+    void Start(int numThreads);
+
+    // Uploads at most maxUploads of the files that have been decoded. Must be
+    // called from the thread that owns the GL context. Returns true once
+    // everything that was queued has been delivered.
+    bool Update(int maxUploads);
+
+    // Writes every file that has been queued to an archive instead of
+    // loading them.
+    bool Pack(const char* archiveName);
+
+    bool    GetIsDone() const;
+
+    // Number of files queued so far.
+    int     GetNumQueued() const;
+
+    // Returns true once the first numFiles files that were queued have all
+    // been delivered, whether or not they could be loaded.
+    bool    GetIsDelivered(int numFiles) const;
+
+    // Seconds from Start until the last file was delivered.
+    double  GetLoadTime() const;
+
+private:
+
+    struct Job
+    {
+        Texture*        texture;
+        TextureAtlas*   atlas;
+        HSAMPLE*        sample;
+        std::string     fileName;
+        const unsigned char* pixels;
+        int             xSize;
+        int             ySize;
+        HSAMPLE         loadedSample;
+        bool            archived;   // Pixels point into the archive rather than being decoded
+        bool            delivered;
+    };
+
+    static int ThreadMain(void* data);
+    void Run();
+
+    void Deliver(Job& job);
+
+private:
+
+    AssetArchive                m_archive;
+    std::vector<Job>            m_jobs;             // Not resized once the workers are started
+    std::vector<std::string>    m_files;            // Passed to LoadFile
+    std::vector<SDL_Thread*>    m_threads;
+    int                         m_numDelivered;
+    double                      m_startTime;
+    double                      m_loadTime;
+
+    // Shared with the worker threads and protected by m_mutex.
+    SDL_mutex*                  m_mutex;
+    bool                        m_quit;
+    int                         m_nextJob;
+    std::vector<int>            m_decoded;          // Jobs waiting for Update
+
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef GAME_ATOMIC_H
+#define GAME_ATOMIC_H
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+/**
+ * Full memory barrier; neither the compiler nor the CPU will move loads or
+ * stores across it.
+ */
+inline void Atomic_MemoryBarrier()
+{
+#ifdef WIN32
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+/**
+ * Reads a value shared with another thread. Loads that follow can't be
+ * reordered before it.
+ */
+template <class T>
+inline T Atomic_Load(const volatile T& variable)
+{
+    T value = variable;
+    Atomic_MemoryBarrier();
+    return value;
+}
+
+/**
+ * Publishes a value to another thread. Stores that precede it can't be
+ * reordered after it.
+ */
+template <class T>
+inline void Atomic_Store(volatile T& variable, T value)
+{
+    Atomic_MemoryBarrier();
+    variable = value;
+}
+
+/**
+ * Increments the value and returns the new value.
+ */
+inline int Atomic_Increment(volatile int& value)
+{
+#ifdef WIN32
+    return InterlockedIncrement(reinterpret_cast<volatile LONG*>(&value));
+#else
+    return __sync_add_and_fetch(&value, 1);
+#endif
+}
+
+#endif
@@ -0,0 +1,505 @@
+#include "Benchmark.h"
+#include "Map.h"
+#include "MapPool.h"
+#include "PathFinder.h"
+#include "PixelFormat.h"
+#include "RoutePlanner.h"
+#include "Random.h"
+#include "Thread.h"
+#include "Timer.h"
+#include "Utility.h"
+#include "Log.h"
+
+#include <SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+static void BenchmarkMapGeneration()
+{
+
+    LogMessage("Map generation:");
+
+    const int gridSpacing = 150;
+
+    // The default map is 9x6 grid cells.
+    const int scales[] = { 1, 2, 4, 8 };
+    const int numScales = sizeof(scales) / sizeof(scales[0]);
+
+    for (int i = 0; i < numScales; ++i)
+    {
+
+        int xSize = gridSpacing * 9 * scales[i];
+        int ySize = gridSpacing * 6 * scales[i];
+
+        const int numMaps = 100;
+        int numStops = 0;
+        int numRails = 0;
+
+        Map map;
+        double startTime = Timer_GetTime();
+        for (int seed = 0; seed < numMaps; ++seed)
+        {
+            map.Generate(xSize, ySize, seed);
+            numStops += map.GetNumStops();
+            numRails += map.GetNumRails();
+        }
+        double time = Timer_GetTime() - startTime;
+
+        LogMessage("  %5d x %-5d  %6d stops  %6d rails  %8.3f ms/map",
+            xSize, ySize, numStops / numMaps, numRails / numMaps, time * 1000.0 / numMaps);
+
+    }
+
+}
+
+static void BenchmarkPathFinding()
+{
+
+    LogMessage("Path finding:");
+
+    // Large cities, so the searches are timed up to about 19k stops. The
+    // table is only built up to the -pathtable limit.
+    const int gridSpacing = 150;
+    const int scales[] = { 1, 2, 4, 8 };
+    const int numScales = sizeof(scales) / sizeof(scales[0]);
+
+    for (int i = 0; i < numScales; ++i)
+    {
+
+        int xSize = gridSpacing * 9 * scales[i];
+        int ySize = gridSpacing * 6 * scales[i];
+
+        Map map;
+        map.Generate(xSize, ySize, 1, MapParams::GetLargeCity(xSize, ySize));
+        int numStops = map.GetNumStops();
+
+        PathFinder pathFinder(&map);
+
+        // A search visits most of the map, so fewer are made on big maps to
+        // keep the time spent on each size about the same.
+        int numQueries = Clamp(20000000 / numStops, 100, 100000);
+        std::vector<int> stops(numQueries * 2);
+
+        Random random;
+        random.Seed(1);
+        for (size_t j = 0; j < stops.size(); ++j)
+        {
+            stops[j] = random.Generate(0, numStops - 1);
+        }
+
+        int checksum = 0;
+
+        double startTime = Timer_GetTime();
+        for (int j = 0; j < numQueries; ++j)
+        {
+            checksum += pathFinder.GetNextStop(stops[j * 2], stops[j * 2 + 1]);
+        }
+        double hopsTime = Timer_GetTime() - startTime;
+
+        startTime = Timer_GetTime();
+        for (int j = 0; j < numQueries; ++j)
+        {
+            checksum += pathFinder.GetNextStop(stops[j * 2], stops[j * 2 + 1], PathFinder::Metric_Distance);
+        }
+        double distanceTime = Timer_GetTime() - startTime;
+
+        startTime = Timer_GetTime();
+        pathFinder.BuildTable();
+        double buildTime = Timer_GetTime() - startTime;
+
+        startTime = Timer_GetTime();
+        for (int j = 0; j < numQueries; ++j)
+        {
+            checksum += pathFinder.GetNextStop(stops[j * 2], stops[j * 2 + 1]);
+        }
+        double tableTime = Timer_GetTime() - startTime;
+
+        RoutePlanner routePlanner(&map);
+        const float railSpeed = 100.0f;
+        const float transferTime = 2.0f;
+
+        startTime = Timer_GetTime();
+        routePlanner.Build(railSpeed, transferTime);
+        double routeBuildTime = Timer_GetTime() - startTime;
+
+        startTime = Timer_GetTime();
+        for (int j = 0; j < numQueries; ++j)
+        {
+            checksum += routePlanner.GetNextStop(stops[j * 2], stops[j * 2 + 1]);
+        }
+        double routeTime = Timer_GetTime() - startTime;
+
+        LogMessage("  %6d stops  %8.3f us/query (hops)  %8.3f us/query (distance)  [%d]",
+            numStops, hopsTime * 1000000.0 / numQueries, distanceTime * 1000000.0 / numQueries, checksum);
+        if (pathFinder.GetTable().GetIsBuilt())
+        {
+            LogMessage("                %8.3f us/query (table)  %8.3f ms to build  %d KB",
+                tableTime * 1000000.0 / numQueries, buildTime * 1000.0,
+                static_cast<int>(pathFinder.GetTable().GetMemoryUsage() / 1024));
+        }
+        else
+        {
+            LogMessage("                no table for this many stops");
+        }
+        LogMessage("                %8.3f us/query (travel time)  %8.3f ms to build",
+            routeTime * 1000000.0 / numQueries, routeBuildTime * 1000.0);
+
+    }
+
+}
+
+static void BenchmarkLargeCityGeneration()
+{
+
+    LogMessage("Large city generation:");
+
+    const int gridSpacing = 150;
+
+    // The largest city has about 100k stops.
+    const int scales[] = { 1, 2, 4, 8, 12, 18 };
+    const int numScales = sizeof(scales) / sizeof(scales[0]);
+
+    for (int i = 0; i < numScales; ++i)
+    {
+
+        int xSize = gridSpacing * 9 * scales[i];
+        int ySize = gridSpacing * 6 * scales[i];
+        MapParams params = MapParams::GetLargeCity(xSize, ySize);
+
+        int numMaps = Max(2, 64 / (scales[i] * scales[i]));
+        int numStops = 0;
+        int numRails = 0;
+
+        Map map;
+        double startTime = Timer_GetTime();
+        for (int seed = 0; seed < numMaps; ++seed)
+        {
+            map.Generate(xSize, ySize, seed, params);
+            numStops += map.GetNumStops();
+            numRails += map.GetNumRails();
+        }
+        double time = Timer_GetTime() - startTime;
+
+        LogMessage("  %5d x %-5d  %6d stops  %6d rails  %8.3f ms/map  %6.3f us/stop",
+            xSize, ySize, numStops / numMaps, numRails / numMaps, time * 1000.0 / numMaps,
+            time * 1000000.0 / numStops);
+
+    }
+
+}
+
+static void BenchmarkMapPool()
+{
+
+    LogMessage("Map pool:");
+
+    // Larger maps from the default generator are rarely fully connected.
+    const int gridSpacing = 150;
+    int xSize = gridSpacing * 9;
+    int ySize = gridSpacing * 6;
+
+    const int poolSize = 64;
+    int numProcessors = Thread_GetNumProcessors();
+
+    for (int numThreads = 1; numThreads <= numProcessors; numThreads *= 2)
+    {
+
+        MapPool pool;
+
+        double startTime = Timer_GetTime();
+        pool.Start(xSize, ySize, poolSize, numThreads);
+        while (pool.GetNumReady() < poolSize)
+        {
+            SDL_Delay(1);
+        }
+        double fillTime = Timer_GetTime() - startTime;
+        pool.Stop();
+
+        Map map;
+        startTime = Timer_GetTime();
+        for (int i = 0; i < poolSize; ++i)
+        {
+            pool.Take(map, xSize, ySize);
+        }
+        double takeTime = Timer_GetTime() - startTime;
+
+        LogMessage("  %2d threads  %8.1f maps/s  %8.3f us/take  %d rejected",
+            numThreads, (poolSize + pool.GetNumRejected()) / fillTime,
+            takeTime * 1000000.0 / poolSize, pool.GetNumRejected());
+
+    }
+
+}
+
+typedef void (*ConvertFunc)(const unsigned char* src, unsigned char* dst, int numPixels);
+
+// Converts the image row by row numPasses times and returns the rate in
+// megapixels per second.
+static double TimeConversion(ConvertFunc convert, const std::vector<unsigned char>& src, int bytesPerPixel,
+    std::vector<unsigned char>& dst, int xSize, int ySize, int numPasses)
+{
+
+    double startTime = Timer_GetTime();
+    for (int pass = 0; pass < numPasses; ++pass)
+    {
+        for (int y = 0; y < ySize; ++y)
+        {
+            convert(&src[y * xSize * bytesPerPixel], &dst[y * xSize * 4], xSize);
+        }
+    }
+    double time = Timer_GetTime() - startTime;
+
+    return static_cast<double>(xSize) * ySize * numPasses / (time * 1000000.0);
+
+}
+
+// Builds the whole mip chain below the image numPasses times and returns the
+// rate in megapixels of the top level per second. The last level is left at
+// the start of dst.
+static double TimeMipGeneration(const std::vector<unsigned char>& src, std::vector<unsigned char>& dst, int xSize, int ySize, int numPasses)
+{
+
+    std::vector<unsigned char> scratch(dst.size());
+
+    double startTime = Timer_GetTime();
+    for (int pass = 0; pass < numPasses; ++pass)
+    {
+        const unsigned char* level = &src[0];
+        int xLevelSize = xSize;
+        int yLevelSize = ySize;
+        size_t offset = 0;
+        while (xLevelSize > 1 || yLevelSize > 1)
+        {
+            // Every level is kept so they can all be compared.
+            PixelFormat_BuildMip(level, xLevelSize, yLevelSize, &dst[offset]);
+            level = &dst[offset];
+            xLevelSize = Max(xLevelSize / 2, 1);
+            yLevelSize = Max(yLevelSize / 2, 1);
+            offset += xLevelSize * yLevelSize * 4;
+        }
+    }
+    double time = Timer_GetTime() - startTime;
+
+    return static_cast<double>(xSize) * ySize * numPasses / (time * 1000000.0);
+
+}
+
+// Converts a row of each width with both versions and checks the SSE2 one
+// gives the same pixels and writes nothing past the end. The odd widths
+// exercise the plain C loop that finishes each row. Returns the number of
+// widths that didn't match.
+static int CheckConversion(const char* name, ConvertFunc convert, int bytesPerPixel, Random& random)
+{
+
+    const int widths[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 1023 };
+    const int numWidths = sizeof(widths) / sizeof(widths[0]);
+
+    // Extra bytes past the end of the row that must be left alone.
+    const int guardSize = 16;
+
+    int numMismatches = 0;
+    for (int i = 0; i < numWidths; ++i)
+    {
+
+        int xSize = widths[i];
+
+        std::vector<unsigned char> src(xSize * bytesPerPixel);
+        for (size_t j = 0; j < src.size(); ++j)
+        {
+            src[j] = static_cast<unsigned char>(random.Generate(0, 255));
+        }
+
+        std::vector<unsigned char> dst[2];
+        for (int useSimd = 0; useSimd < 2; ++useSimd)
+        {
+            PixelFormat_SetUseSimd(useSimd != 0);
+            dst[useSimd].resize(xSize * 4 + guardSize, 0xCD);
+            convert(&src[0], &dst[useSimd][0], xSize);
+        }
+
+        if (dst[0] != dst[1])
+        {
+            LogError("  %s MISMATCH for a row of %d pixels", name, xSize);
+            ++numMismatches;
+        }
+
+    }
+
+    return numMismatches;
+
+}
+
+// Builds one mip level from images of the sizes that take the special cases:
+// one pixel wide or high, and odd sizes that drop a row or column. Returns
+// the number of sizes that didn't match.
+static int CheckMipGeneration(Random& random)
+{
+
+    const int sizes[][2] =
+        {
+            { 1, 1 }, { 1, 2 }, { 2, 1 }, { 1, 9 }, { 9, 1 }, { 1, 1023 }, { 1023, 1 },
+            { 3, 3 }, { 5, 2 }, { 9, 9 }, { 16, 1 }, { 1, 16 }, { 17, 5 }, { 1023, 3 },
+        };
+    const int numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    const int guardSize = 16;
+
+    int numMismatches = 0;
+    for (int i = 0; i < numSizes; ++i)
+    {
+
+        int xSize = sizes[i][0];
+        int ySize = sizes[i][1];
+        int xMipSize = Max(xSize / 2, 1);
+        int yMipSize = Max(ySize / 2, 1);
+
+        std::vector<unsigned char> src(xSize * ySize * 4);
+        for (size_t j = 0; j < src.size(); ++j)
+        {
+            src[j] = static_cast<unsigned char>(random.Generate(0, 255));
+        }
+
+        std::vector<unsigned char> dst[2];
+        for (int useSimd = 0; useSimd < 2; ++useSimd)
+        {
+            PixelFormat_SetUseSimd(useSimd != 0);
+            dst[useSimd].resize(xMipSize * yMipSize * 4 + guardSize, 0xCD);
+            PixelFormat_BuildMip(&src[0], xSize, ySize, &dst[useSimd][0]);
+        }
+
+        if (dst[0] != dst[1])
+        {
+            LogError("  Mipmaps MISMATCH for %dx%d", xSize, ySize);
+            ++numMismatches;
+        }
+
+    }
+
+    return numMismatches;
+
+}
+
+// Returns false if the SSE2 versions don't give the same pixels as the plain
+// C ones.
+static bool BenchmarkPixelFormat()
+{
+
+    LogMessage("Pixel conversion:");
+
+    const int xSize = 1024;
+    const int ySize = 1024;
+    const int numPasses = 20;
+
+    // Random values so a channel that ends up in the wrong place shows.
+    Random random;
+    random.Seed(1);
+    std::vector<unsigned char> src(xSize * ySize * 4);
+    for (size_t i = 0; i < src.size(); ++i)
+    {
+        src[i] = static_cast<unsigned char>(random.Generate(0, 255));
+    }
+
+    // Big enough for a converted image or for the mip chain below it, which
+    // takes a third of the size.
+    std::vector<unsigned char> scalar(xSize * ySize * 4);
+    std::vector<unsigned char> simd(xSize * ySize * 4);
+
+    struct Conversion
+    {
+        const char* name;
+        ConvertFunc convert;
+        int         bytesPerPixel;
+    };
+
+    const Conversion conversions[] =
+        {
+            { "BGRA to RGBA", PixelFormat_ConvertBgraToRgba, 4 },
+            { "BGR to RGBA",  PixelFormat_ConvertBgrToRgba,  3 },
+            { "Mipmaps",      NULL,                          4 },
+        };
+    const int numConversions = sizeof(conversions) / sizeof(conversions[0]);
+
+    bool hasSimd = PixelFormat_GetHasSimd();
+    bool matches = true;
+
+    if (hasSimd)
+    {
+        int numMismatches = 0;
+        numMismatches += CheckConversion("BGRA to RGBA", PixelFormat_ConvertBgraToRgba, 4, random);
+        numMismatches += CheckConversion("BGR to RGBA",  PixelFormat_ConvertBgrToRgba,  3, random);
+        numMismatches += CheckMipGeneration(random);
+        LogMessage("  Small and odd sizes %s", numMismatches == 0 ? "match" : "MISMATCH");
+        if (numMismatches > 0)
+        {
+            matches = false;
+        }
+    }
+
+    for (int i = 0; i < numConversions; ++i)
+    {
+
+        const Conversion& conversion = conversions[i];
+        double rate[2] = { 0.0, 0.0 };
+
+        std::fill(scalar.begin(), scalar.end(), 0);
+        std::fill(simd.begin(), simd.end(), 0);
+
+        // The plain C version is the reference the SSE2 version must match.
+        for (int useSimd = 0; useSimd <= (hasSimd ? 1 : 0); ++useSimd)
+        {
+            PixelFormat_SetUseSimd(useSimd != 0);
+            std::vector<unsigned char>& dst = useSimd ? simd : scalar;
+            if (conversion.convert != NULL)
+            {
+                rate[useSimd] = TimeConversion(conversion.convert, src, conversion.bytesPerPixel, dst, xSize, ySize, numPasses);
+            }
+            else
+            {
+                rate[useSimd] = TimeMipGeneration(src, dst, xSize, ySize, numPasses);
+            }
+        }
+
+        if (hasSimd)
+        {
+            bool same = memcmp(&scalar[0], &simd[0], scalar.size()) == 0;
+            LogMessage("  %-14s %8.1f MP/s  %8.1f MP/s (SSE2)  %s", conversion.name, rate[0], rate[1],
+                same ? "matches" : "MISMATCH");
+            if (!same)
+            {
+                matches = false;
+            }
+        }
+        else
+        {
+            LogMessage("  %-14s %8.1f MP/s", conversion.name, rate[0]);
+        }
+
+    }
+
+    PixelFormat_SetUseSimd(true);
+    return matches;
+
+}
+
+int Benchmark_Run()
+{
+
+    LogMessage("Running benchmarks");
+
+    BenchmarkMapGeneration();
+    BenchmarkLargeCityGeneration();
+    BenchmarkMapPool();
+    BenchmarkPathFinding();
+
+    if (!BenchmarkPixelFormat())
+    {
+        LogError("The SSE2 pixel conversion doesn't match the plain C version");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,12 @@
+#ifndef GAME_BENCHMARK_H
+#define GAME_BENCHMARK_H
+
+/**
+ * Times the expensive parts of the game (map generation and so on) at a
+ * range of sizes and logs the results. Run with "-benchmark on". Returns
+ * EXIT_FAILURE if an optimized code path gives different results from the
+ * plain version it replaces.
+ */
+int Benchmark_Run();
+
+#endif
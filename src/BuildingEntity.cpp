@@ -1,4 +1,5 @@
 #include "BuildingEntity.h"
+#include "Message.h"
 
 BuildingEntity::BuildingEntity()
 {
@@ -6,3 +7,25 @@ BuildingEntity::BuildingEntity()
     m_raided = false;
     m_numIntels = 0;
 }
+
+void BuildingEntity::Serialize(MessageWriter& writer) const
+{
+    Entity::Serialize(writer);
+    writer.WriteVarInt(m_stop);
+    writer.WriteUInt8(m_raided);
+    writer.WriteVarInt(m_numIntels);
+}
+
+void BuildingEntity::Deserialize(MessageReader& reader)
+{
+
+    Entity::Deserialize(reader);
+    reader.ReadVarInt(m_stop);
+
+    unsigned int raided = 0;
+    reader.ReadUInt8(raided);
+    m_raided = raided != 0;
+
+    reader.ReadVarInt(m_numIntels);
+
+}
@@ -14,6 +14,10 @@ public:
     
     BuildingEntity();
 
+    void Serialize(MessageWriter& writer) const;
+    void Deserialize(MessageReader& reader);
+
+
     int             m_stop;
     bool            m_raided;
     int             m_numIntels;
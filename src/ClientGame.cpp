@@ -7,13 +7,25 @@
 #include "Utility.h"
 #include "UI.h"
 #include "Server.h"
+#include "MapCache.h"
+#include "Thread.h"
 
 #include <SDL.h>
 
 #include <math.h>
 #include <assert.h>
+#include <algorithm>
 
 const int yStatusBarSize    = 140;
+
+// Images uploaded to GL per frame while assets are loading in the background.
+const int kMaxUploadsPerFrame = 4;
+
+// Written by running with -pack on; used in place of the individual files.
+const char* const kAssetArchive = "assets/assets.pak";
+
+// Times the server's map is requested before giving up on the game.
+const int kMaxMapRequests = 3;
 const float kPi = 3.14159265359f;
 
 const Protocol::Order ClientGame::kButtonToOrder[ButtonId_NumButtons] = 
@@ -61,30 +73,23 @@ static float EaseInOutQuad(float t, float b, float c, float d)
 };
 
 
-static void DrawCircle(const Vec2& point, float radius)
-{
-    const int numSides = 16;
-    glBegin(GL_TRIANGLE_FAN);
-    for (int j = 0; j < numSides; ++j)
-    {
-        float x = point.x + cosf((2.0f * j * 3.14159265f) / (numSides - 1)) * radius;
-        float y = point.y + sinf((2.0f * j * 3.14159265f) / (numSides - 1)) * radius;
-        glVertex2f(x, y);
-    }
-    glEnd();
-}
-
-ClientGame::ClientGame(int xSize, int ySize, bool playMusic) 
-    : m_host(1),
+ClientGame::ClientGame(int xSize, int ySize, bool playMusic, LanBroadcast::Mode discoveryMode, float railSpeed) 
+    : m_pathFinder(&m_map),
+      m_routePlanner(&m_map),
+      m_host(1),
       m_state(&m_typeRegistry),
       m_notificationLog(&m_map, &m_mapParticles, &m_font, xSize, ySize)
 {
 
     m_server            = NULL;
+    m_numMenuAssets     = 0;
+    m_discoveryMode     = discoveryMode;
+    m_railSpeed         = railSpeed;
     m_time              = 0;
     m_clientId          = -1;
     m_gameState         = GameState_MainMenu;
     m_mapScale          = 1;
+    m_maxMapScale       = 2;
     m_xSize             = xSize;
     m_ySize             = ySize;
     m_mapState          = State_Idle;
@@ -92,6 +97,9 @@ ClientGame::ClientGame(int xSize, int ySize, bool playMusic)
     m_blipY             = 0;
     m_serverId          = -1;
     m_hoverStop         = -1;
+    m_waitingForMap     = false;
+    m_numMapRequests    = 0;
+    m_menuMessage       = NULL;
     m_hoverButton       = ButtonId_None;
     m_xMapSize          = 0;
     m_yMapSize          = 0;
@@ -102,8 +110,11 @@ ClientGame::ClientGame(int xSize, int ySize, bool playMusic)
     m_isWinner          = false;
     m_totalNumIntels    = 0;
     m_timeAdjustment    = 0;
-    m_pathLength        = 0;
-    m_nextStop          = -1;
+    m_serverSortMode    = LanListener::SortMode_Load;
+    m_nextOrder         = 1;
+    m_predictionLatency = 0;
+    m_correctionDistance = 0;
+    m_showPredictionOverlay = false;
     
     for (int i = 0; i < ButtonId_NumButtons; ++i)
     {
@@ -120,6 +131,10 @@ ClientGame::ClientGame(int xSize, int ySize, bool playMusic)
 
     m_lanListener.Initialize(Protocol::listenPort);
 
+    // Generate a map while the player is in the menu so hosting a game
+    // doesn't have to wait for one. The worker sleeps once it's ready.
+    m_mapPool.Start(Server::s_xMapSize, Server::s_yMapSize, 1, 1);
+
     m_random.Seed(SDL_GetTicks());
 }
 
@@ -143,6 +158,27 @@ ClientGame::~ClientGame()
 }
 
 void ClientGame::LoadResources()
+{
+
+    if (!m_assetLoader.OpenArchive(kAssetArchive))
+    {
+        LogDebug("No asset archive, loading the individual files");
+    }
+
+    QueueResources();
+
+    // Leave a processor for the main thread so the menu stays responsive.
+    m_assetLoader.Start(Max(Thread_GetNumProcessors() - 1, 1));
+
+}
+
+bool ClientGame::PackResources()
+{
+    QueueResources();
+    return m_assetLoader.Pack(kAssetArchive);
+}
+
+void ClientGame::QueueResources()
 {
 
     struct TextureLoad
@@ -151,6 +187,14 @@ void ClientGame::LoadResources()
         const char* fileName;
     };
 
+    // The main menu can be shown as soon as its own images are in, so those
+    // are queued first.
+    m_assetLoader.LoadTexture(m_titleBackgroundTexture, "assets/title_background.png");
+    m_assetLoader.LoadTexture(m_uiTexture, "assets/ui.png");
+    Font_Load(m_font, "assets/font.csv", &m_assetLoader, &m_textureAtlas);
+    m_assetLoader.LoadTexture(m_titleTextTexture, "assets/title_text.png", &m_textureAtlas);
+    m_numMenuAssets = m_assetLoader.GetNumQueued();
+
     TextureLoad load[] = 
         { 
             { &m_agentTexture,                          "assets/agent.png"                          },
@@ -174,27 +218,25 @@ void ClientGame::LoadResources()
             { &m_playerBankHackedTexture,               "assets/player_bank_hacked.png"             },
             { &m_playerCellHackedTexture,               "assets/player_cell_hacked.png"             },
             { &m_playerPoliceHackedTexture,             "assets/player_police_hacked.png"           },
-            { &m_titleBackgroundTexture,                "assets/title_background.png"               },
-            { &m_titleTextTexture,                      "assets/title_text.png"                     },
-            { &m_uiTexture,                             "assets/ui.png"                             },
         };
 
+    // Sprites go into the atlas so they can be batched together. The title
+    // background is tiled and the UI skin is addressed in pixels, so those
+    // keep textures of their own (queued above).
     int numTextures = sizeof(load) / sizeof(TextureLoad);
     for (int i = 0; i < numTextures; ++i)
     {   
-        Texture_Load(*load[i].texture, load[i].fileName);
+        m_assetLoader.LoadTexture(*load[i].texture, load[i].fileName, &m_textureAtlas);
     }
 
-    Font_Load(m_font, "assets/font.csv");
+    m_assetLoader.LoadSample(m_soundAction, "assets/sound_action.wav");
+    m_assetLoader.LoadSample(m_soundDeath,  "assets/sound_death.wav");
+    m_assetLoader.LoadSample(m_soundDrop,   "assets/sound_drop.wav");
+    m_assetLoader.LoadSample(m_soundHack,   "assets/sound_hack.wav");
+    m_assetLoader.LoadSample(m_soundPickup, "assets/sound_pickup.wav");
+    m_assetLoader.LoadSample(m_soundTrain,  "assets/sound_train.wav");
 
-    m_soundAction   = BASS_SampleLoad(false, "assets/sound_action.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundDeath    = BASS_SampleLoad(false, "assets/sound_death.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundDrop     = BASS_SampleLoad(false, "assets/sound_drop.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundHack     = BASS_SampleLoad(false, "assets/sound_hack.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundPickup   = BASS_SampleLoad(false, "assets/sound_pickup.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundTrain    = BASS_SampleLoad(false, "assets/sound_train.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-
-    m_notificationLog.LoadResources();
+    m_notificationLog.LoadResources(m_assetLoader, m_textureAtlas);
 
 }
 
@@ -230,57 +272,25 @@ void ClientGame::Render()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    const int outerBorder = 35;
-
-    // Draw the background.
-    glColor(0xFFFFFFFF);
-    glBegin(GL_QUADS);
-    glVertex2i(-outerBorder, -outerBorder);
-    glVertex2i(m_xMapSize + outerBorder, -outerBorder);
-    glVertex2i(m_xMapSize + outerBorder, m_yMapSize + outerBorder);
-    glVertex2i(-outerBorder, m_yMapSize + outerBorder);
-    glEnd();
-
-    // Outer thick border of the map
-    glColor(0xFF7FD6F2);
-    glLineWidth(2);
-    glBegin(GL_LINE_LOOP);
-    glVertex2i(-outerBorder, -outerBorder);
-    glVertex2i(m_xMapSize + outerBorder, -outerBorder);
-    glVertex2i(m_xMapSize + outerBorder, m_yMapSize + outerBorder);
-    glVertex2i(-outerBorder, m_yMapSize + outerBorder);
-    glEnd();
+    m_mapLayer.SetView(
+        static_cast<float>(m_mapX),
+        static_cast<float>(m_mapY),
+        static_cast<float>(m_mapX + m_xSize * m_mapScale),
+        static_cast<float>(m_mapY + m_ySize * m_mapScale),
+        static_cast<float>(m_mapScale));
 
-    // Grid
-    glColor(0xFF7FD6F2);
-    glLineWidth(1);
-    glBegin(GL_LINES);
-    for (int x = 0; x < m_xMapSize / m_gridSpacing; ++x)
-    {
-        glVertex2i(x * m_gridSpacing, 0);
-        glVertex2i(x * m_gridSpacing, m_yMapSize);
-    }
-    glVertex2i(m_xMapSize, 0);
-    glVertex2i(m_xMapSize, m_yMapSize);
-    for (int y = 0; y < m_yMapSize / m_gridSpacing; ++y)
-    {
-        glVertex2i(0, y * m_gridSpacing);
-        glVertex2i(m_xMapSize, y * m_gridSpacing);
-    }
-    glVertex2i(0, m_yMapSize);
-    glVertex2i(m_xMapSize, m_yMapSize);
-    glEnd();
+    m_mapLayer.Draw(MapLayer::Layer_Background);
 
     // Buildings.
     glEnable(GL_TEXTURE_2D);
-    glColor(0xFFFFFFFF);
-    for (int i = 0; i < m_map.GetNumStops(); ++i)
+    m_spriteBatch.Begin();
+    const std::vector<int>& structures = m_mapLayer.GetVisibleStructures();
+    for (size_t i = 0; i < structures.size(); ++i)
     {
-        const Stop& stop = m_map.GetStop(i);
-        Vec2 position = stop.point;
+        Vec2 position = m_map.GetStopPoint(structures[i]);
                 
         const Texture* texture = NULL;
-        switch (stop.structureType)
+        switch (m_map.GetStopStructure(structures[i]))
         {
         case StructureType_Bank:
             texture = &m_buildingBankTexture;
@@ -294,7 +304,7 @@ void ClientGame::Render()
         }
         if (texture != NULL)
         {
-            Render_DrawSprite(*texture, static_cast<int>(position.x) - texture->xSize / 2, static_cast<int>(position.y) - texture->ySize / 2);
+            m_spriteBatch.Draw(*texture, static_cast<int>(position.x) - texture->xSize / 2, static_cast<int>(position.y) - texture->ySize / 2);
         }
     }
     for (int i = 0; i < m_state.GetNumEntities(); ++i)
@@ -305,85 +315,97 @@ void ClientGame::Render()
         case EntityTypeId_Building:
             {
                 const BuildingEntity* building = static_cast<const BuildingEntity*>(entity);
-                Vec2 position = m_map.GetStop(building->m_stop).point;
+                Vec2 position = m_map.GetStopPoint(building->m_stop);
+                if (!m_mapLayer.GetIsVisible(position, static_cast<float>(m_buildingHouseTexture.xSize)))
+                {
+                    break;
+                }
                 if (building->m_raided)
                 {
-                    Render_DrawSprite(m_buildingRaidedHouseTexture, static_cast<int>(position.x) - m_buildingRaidedHouseTexture.xSize / 2, static_cast<int>(position.y) - m_buildingHouseTexture.ySize / 2);
+                    m_spriteBatch.Draw(m_buildingRaidedHouseTexture, static_cast<int>(position.x) - m_buildingRaidedHouseTexture.xSize / 2, static_cast<int>(position.y) - m_buildingHouseTexture.ySize / 2);
                 }
                 else
                 {
-                    Render_DrawSprite(m_buildingHouseTexture, static_cast<int>(position.x) - m_buildingHouseTexture.xSize / 2, static_cast<int>(position.y) - m_buildingHouseTexture.ySize / 2);
+                    m_spriteBatch.Draw(m_buildingHouseTexture, static_cast<int>(position.x) - m_buildingHouseTexture.xSize / 2, static_cast<int>(position.y) - m_buildingHouseTexture.ySize / 2);
                 }
             }
             break;
         }
     }
+    m_spriteBatch.End();
     glDisable(GL_TEXTURE_2D);
 
     // Rails.
     glLineWidth(8.0f / m_mapScale);
-    glBegin(GL_LINES);
-    for (int i = 0; i < m_map.GetNumRails(); ++i)
-    {
-        const Rail& rail  = m_map.GetRail(i);
-        const Stop& stop1 = m_map.GetStop(rail.stop1);
-        const Stop& stop2 = m_map.GetStop(rail.stop2);
-        assert(rail.line >= 0);
-        unsigned long color = m_map.GetLineColor(rail.line);
-        // Draw the rails partially transparent to make the buldings more readable.
-        color = (color & 0x00FFFFFF) | 0x90000000;
-        glColor( color );
-        glVertex(stop1.point);
-        glVertex(stop2.point);
+    m_mapLayer.Draw(MapLayer::Layer_Rails);
+
+    // Highlight where the selected agent is headed.
+    int destinationStop = -1;
+    const Entity* selectedEntity = GetEntity(m_selectedAgent);
+    if (selectedEntity != NULL)
+    {
+        destinationStop = GetPredictedAgent(selectedEntity->Cast<AgentEntity>())->m_destinationStop;
     }
-    glEnd();
 
-    // Stops.
-    for (int i = 0; i < m_map.GetNumStops(); ++i)
+    // Preview the route the selected agent would take to the stop under the
+    // cursor.
+    if (selectedEntity != NULL && m_hoverStop != -1)
     {
-        const Stop& stop = m_map.GetStop(i);
+        const AgentEntity* agent = GetPredictedAgent(selectedEntity->Cast<AgentEntity>());
+        int start = agent->m_targetStop != -1 ? agent->m_targetStop : agent->m_currentStop;
+        m_previewPath.clear();
+        if (start != -1 && m_routePlanner.GetIsBuilt())
+        {
+            m_routePlanner.GetRoute(start, m_hoverStop, m_previewPath);
+        }
+        else if (start != -1)
+        {
+            m_pathFinder.GetPath(start, m_hoverStop, m_previewPath);
+        }
+        if (m_previewPath.size() > 1)
+        {
+            glLineWidth(4.0f / m_mapScale);
+            glColor( 0xC0FFFFFF );
+            glBegin(GL_LINE_STRIP);
+            for (size_t i = 0; i < m_previewPath.size(); ++i)
+            {
+                glVertex(m_map.GetStopPoint(m_previewPath[i]));
+            }
+            glEnd();
+        }
+    }
 
-        float inflate = 0.0f;
-        if (i == m_hoverStop)
+    // Stops. Only the highlighted ones change from frame to frame; they're
+    // drawn enlarged over the cached ones.
+    m_mapLayer.Draw(MapLayer::Layer_Stops);
+    const int highlightStops[] = { m_hoverStop, destinationStop };
+    for (int i = 0; i < 2; ++i)
+    {
+        int stop = highlightStops[i];
+        if (stop == -1)
         {
-            inflate = 5.0f;
+            continue;
         }
-        if (stop.line == -1)
+
+        const Vec2& point = m_map.GetStopPoint(stop);
+        int line = m_map.GetStopLine(stop);
+
+        const float inflate = 5.0f;
+        if (line == -1)
         {
             glColor( 0xFF000000 );
-            DrawCircle(stop.point, 8.0f + inflate);
+            Render_DrawCircle(point, 8.0f + inflate);
             glColor( 0xFFFFFFFF );
-            DrawCircle(stop.point, 6.0f + inflate);
+            Render_DrawCircle(point, 6.0f + inflate);
         }
         else
         {
-            glColor( m_map.GetLineColor(stop.line) );
-            DrawCircle(stop.point, 8.0f + inflate);
+            glColor( m_map.GetLineColor(line) );
+            Render_DrawCircle(point, 8.0f + inflate);
         }
     }
 
-    // Draw the legend of the grid.
-    Font_BeginDrawing(m_font);
-    glColor(0xFF7FD6F2);
     int fontHeight = Font_GetTextHeight(m_font);
-    for (int x = 0; x < m_xMapSize / m_gridSpacing; ++x)
-    {
-        char buffer[32];
-        sprintf(buffer, "%d", x);
-        int textWidth = Font_GetTextWidth(m_font, buffer);
-        Font_DrawText(buffer, x * m_gridSpacing + m_gridSpacing / 2 - textWidth / 2, -outerBorder + 5);
-        Font_DrawText(buffer, x * m_gridSpacing + m_gridSpacing / 2 - textWidth / 2, m_yMapSize + 5);
-    }
-    for (int y = 0; y < m_yMapSize / m_gridSpacing; ++y)
-    {
-        char buffer[32];
-        sprintf(buffer, "%c", 'A' + y);
-        Font_DrawText(buffer, -outerBorder + 10, y * m_gridSpacing + m_gridSpacing / 2 - fontHeight / 2);
-        Font_DrawText(buffer, m_xMapSize + 10, y * m_gridSpacing + m_gridSpacing / 2 - fontHeight / 2);
-    }
-
-    Font_EndDrawing();
-
 
     glEnable(GL_TEXTURE_2D);    
 
@@ -398,40 +420,50 @@ void ClientGame::Render()
     }
     unsigned long blinkColor = (static_cast<int>(blinkAlpha*255.0f) << 24) | 0xffffff;
     
-    // Entities
+    // The legend of the grid and the entities.
+    m_spriteBatch.Begin();
+    m_mapLayer.DrawLegend(m_spriteBatch);
     int index = 0;
     const AgentEntity* agent;
     while (m_state.GetNextEntityWithType(index, agent))
     {
-        if (m_selectedAgent == agent->GetId() && m_pathLength == 0)
+        const AgentEntity* predicted = GetPredictedAgent(agent);
+
+        Vec2 position = GetAgentDrawPosition(agent);
+        if (!m_mapLayer.GetIsVisible(position, static_cast<float>(m_agentTexture.ySize)))
         {
-            glColor(blinkColor);
+            continue;
+        }
+
+        if (GetIsSelected(agent->GetId()) && predicted->m_destinationStop == -1)
+        {
+            m_spriteBatch.SetColor(blinkColor);
         }
         else
         {
-            glColor(0xFFFFFFFF);
+            m_spriteBatch.SetColor(0xFFFFFFFF);
         }
 
-        Vec2 position = GetAgentPosition(agent);
-        if (agent->m_state == AgentEntity::State_Hacking)
+        if (predicted->m_state == AgentEntity::State_Hacking)
         {
-            Render_DrawSprite(m_agentHackingTexture, static_cast<int>(position.x) - m_agentHackingTexture.xSize / 2, static_cast<int>(position.y) - m_agentHackingTexture.ySize / 2);
+            m_spriteBatch.Draw(m_agentHackingTexture, static_cast<int>(position.x) - m_agentHackingTexture.xSize / 2, static_cast<int>(position.y) - m_agentHackingTexture.ySize / 2);
         }
-        else if (agent->m_state == AgentEntity::State_Stakeout)
+        else if (predicted->m_state == AgentEntity::State_Stakeout)
         {
-            Render_DrawSprite(m_agentStakeoutTexture, static_cast<int>(position.x) - m_agentStakeoutTexture.xSize / 2, static_cast<int>(position.y) - m_agentStakeoutTexture.ySize / 2);
+            m_spriteBatch.Draw(m_agentStakeoutTexture, static_cast<int>(position.x) - m_agentStakeoutTexture.xSize / 2, static_cast<int>(position.y) - m_agentStakeoutTexture.ySize / 2);
         }
         else if (agent->m_intel != -1)
         {
-            Render_DrawSprite(m_agentIntelTexture, static_cast<int>(position.x) - m_agentIntelTexture.xSize / 2, static_cast<int>(position.y) - m_agentIntelTexture.ySize / 2);
+            m_spriteBatch.Draw(m_agentIntelTexture, static_cast<int>(position.x) - m_agentIntelTexture.xSize / 2, static_cast<int>(position.y) - m_agentIntelTexture.ySize / 2);
         }
         else
         {
-            Render_DrawSprite(m_agentTexture, static_cast<int>(position.x) - m_agentTexture.xSize / 2, static_cast<int>(position.y) - m_agentTexture.ySize / 2);
+            m_spriteBatch.Draw(m_agentTexture, static_cast<int>(position.x) - m_agentTexture.xSize / 2, static_cast<int>(position.y) - m_agentTexture.ySize / 2);
         }
     }
 
-    m_mapParticles.Draw();
+    m_mapParticles.Draw(m_spriteBatch);
+    m_spriteBatch.End();
 
     // Draw the UI.
 
@@ -459,6 +491,7 @@ void ClientGame::Render()
 
     glEnable(GL_TEXTURE_2D);    
 
+    m_spriteBatch.Begin();
     for (int i = 0; i < ButtonId_NumButtons; ++i)
     {
         if (m_button[i].enabled)
@@ -468,24 +501,30 @@ void ClientGame::Render()
 
             if (m_button[i].toggled)
             {
-                glColor(0xFFB0E8E1);
+                m_spriteBatch.SetColor(0xFFB0E8E1);
             }
             else
             {
-                glColor(0xFFFFFFFF);
+                m_spriteBatch.SetColor(0xFFFFFFFF);
             }
             int buttonOffset = 0;
             int shadowOffset = 10;
-            Render_DrawSprite( m_buttonShadowTexture, xButton + shadowOffset, yButton + shadowOffset );
+            m_spriteBatch.Draw( m_buttonShadowTexture, xButton + shadowOffset, yButton + shadowOffset );
             if (m_activeButton == i && m_activeButtonDown)
             {
                 buttonOffset = 5;
             }
-            Render_DrawSprite( m_buttonTexture[i], xButton + buttonOffset, yButton + buttonOffset );
+            m_spriteBatch.Draw( m_buttonTexture[i], xButton + buttonOffset, yButton + buttonOffset );
         }
     }
+    m_spriteBatch.End();
+
+    m_notificationLog.Draw(m_spriteBatch);
 
-    m_notificationLog.Draw();
+    if (m_showPredictionOverlay)
+    {
+        RenderPredictionOverlay();
+    }
 
     const int maxPlayers = 32;
     const PlayerEntity* player[maxPlayers] = { NULL };
@@ -524,37 +563,38 @@ void ClientGame::Render()
     glEnd();
 
     glEnable(GL_TEXTURE_2D);
-    glColor(0xFFFFFFFF);
 
     const int scaledAgentWidth = (m_agentTexture.xSize * fontHeight) / m_agentTexture.ySize;
     const int scaledHouseWidth = (m_buildingHouseTexture.xSize * fontHeight) / m_buildingHouseTexture.ySize;
     const int scaledIntelWidth = (m_intelTexture.xSize * fontHeight) / m_intelTexture.ySize;
 
+    m_spriteBatch.Begin();
     for (int i = 0; i < numPlayers; ++i)
     {
-        Render_DrawSprite(m_playerPortraitTexture, m_xSize - 290, 20 + (playerBoxHeight + 15) * i);
+        m_spriteBatch.Draw(m_playerPortraitTexture, m_xSize - 290, 20 + (playerBoxHeight + 15) * i);
 
         int offset = 0;
         if (player[i]->m_hackingBank)
         {
-            Render_DrawSprite(m_playerBankHackedTexture, m_xSize - m_playerPortraitTexture.xSize - 60 + offset, 20 + (playerBoxHeight + 15) * i + 90 - m_playerBankHackedTexture.ySize);
+            m_spriteBatch.Draw(m_playerBankHackedTexture, m_xSize - m_playerPortraitTexture.xSize - 60 + offset, 20 + (playerBoxHeight + 15) * i + 90 - m_playerBankHackedTexture.ySize);
             offset += m_playerBankHackedTexture.xSize;
         }
         if (player[i]->m_hackingTower)
         {
-            Render_DrawSprite(m_playerCellHackedTexture, m_xSize - m_playerPortraitTexture.xSize - 60 + offset, 20 + (playerBoxHeight + 15) * i + 90 - m_playerCellHackedTexture.ySize);
+            m_spriteBatch.Draw(m_playerCellHackedTexture, m_xSize - m_playerPortraitTexture.xSize - 60 + offset, 20 + (playerBoxHeight + 15) * i + 90 - m_playerCellHackedTexture.ySize);
             offset += m_playerCellHackedTexture.xSize;
         }
         if (player[i]->m_hackingPolice)
         {
-            Render_DrawSprite(m_playerPoliceHackedTexture, m_xSize - m_playerPortraitTexture.xSize - 60 + offset, 20 + (playerBoxHeight + 15) * i + 90 - m_playerPoliceHackedTexture.ySize);
+            m_spriteBatch.Draw(m_playerPoliceHackedTexture, m_xSize - m_playerPortraitTexture.xSize - 60 + offset, 20 + (playerBoxHeight + 15) * i + 90 - m_playerPoliceHackedTexture.ySize);
             offset += m_playerPoliceHackedTexture.xSize;
         }
         
-        Render_DrawSprite(m_agentTexture, m_xSize - 280, playerBoxHeight - 25 +(playerBoxHeight + 15) * i, scaledAgentWidth, fontHeight);
-        Render_DrawSprite(m_buildingHouseTexture, m_xSize - 180, playerBoxHeight - 25 +(playerBoxHeight + 15) * i, scaledHouseWidth, fontHeight);
-        Render_DrawSprite(m_intelTexture, m_xSize - 80, playerBoxHeight - 25 +(playerBoxHeight + 15) * i, scaledIntelWidth, fontHeight);
+        m_spriteBatch.Draw(m_agentTexture, m_xSize - 280, playerBoxHeight - 25 +(playerBoxHeight + 15) * i, scaledAgentWidth, fontHeight);
+        m_spriteBatch.Draw(m_buildingHouseTexture, m_xSize - 180, playerBoxHeight - 25 +(playerBoxHeight + 15) * i, scaledHouseWidth, fontHeight);
+        m_spriteBatch.Draw(m_intelTexture, m_xSize - 80, playerBoxHeight - 25 +(playerBoxHeight + 15) * i, scaledIntelWidth, fontHeight);
     }
+    m_spriteBatch.End();
 
     Font_BeginDrawing(m_font);
     glColor(0xFF000000);
@@ -645,18 +685,19 @@ void ClientGame::Render()
 
 
     glEnable(GL_TEXTURE_2D);
-    glColor(0xFFFFFFFF);
+    m_spriteBatch.Begin();
     for (int i = 0; i < numPlayers; ++i)
     {
         if (player[i]->m_eliminated)
         {
-            Render_DrawSprite(m_playerEliminatedTexture,
+            m_spriteBatch.Draw(m_playerEliminatedTexture,
                 m_xSize - 250,
                 20 + (playerBoxHeight + 15) * i);
         }
     }
 
-    m_screenParticles.Draw();
+    m_screenParticles.Draw(m_spriteBatch);
+    m_spriteBatch.End();
 
     if (m_gameState == GameState_GameOver)
     {
@@ -740,10 +781,7 @@ void ClientGame::OnMouseDown(int x, int y, int button)
             m_activeButtonDown = true;
             m_mapState = State_Button;
 
-            Protocol::OrderPacket order;
-            order.order = kButtonToOrder[buttonId];
-            order.agentId = m_selectedAgent;
-            SendOrder(order);
+            OrderSelectedAgents(kButtonToOrder[buttonId], -1);
         }
         else if (y < m_ySize - yStatusBarSize)
         {
@@ -756,29 +794,28 @@ void ClientGame::OnMouseDown(int x, int y, int button)
 
             int stopUnderCursor = m_map.GetNearestStopForPoint( Vec2(static_cast<float>(xWorld), static_cast<float>(yWorld)) );
 
-            if (agentUnderCursor == -1 && stopUnderCursor != -1 && m_selectedAgent != -1)
+            bool addToSelection = (SDL_GetModState() & KMOD_SHIFT) != 0;
+
+            if (agentUnderCursor != -1 && addToSelection && m_selectedAgent != -1)
             {
-                const Entity* selectedEntity = GetEntity(m_selectedAgent);
-                if (selectedEntity != NULL)
+                if (static_cast<int>(m_selectedAgents.size()) < Protocol::maxGroupSize)
                 {
-                    int fromStop = selectedEntity->Cast<AgentEntity>()->m_currentStop;
-                    m_pathLength = m_map.GetPath(fromStop, stopUnderCursor, m_path);
-                    if (m_pathLength > 1)
-                    {
-                        m_nextStop = 0;
-                    }
-                    else
-                    {
-                        m_pathLength = 0;
-                        m_nextStop = -1;
-                    }
+                    m_selectedAgents.push_back(agentUnderCursor);
+                    m_selectedAgent = agentUnderCursor;
                 }
             }
+            else if (agentUnderCursor == -1 && stopUnderCursor != -1 && m_selectedAgent != -1)
+            {
+                MoveSelectedAgents(stopUnderCursor);
+            }
             else if (m_selectedAgent != agentUnderCursor)
             {
                 m_selectedAgent = agentUnderCursor;
-                m_pathLength = 0;
-                m_nextStop = -1;
+                m_selectedAgents.clear();
+                if (agentUnderCursor != -1)
+                {
+                    m_selectedAgents.push_back(agentUnderCursor);
+                }
             }
 
             UpdateActiveButtons();
@@ -789,11 +826,11 @@ void ClientGame::OnMouseDown(int x, int y, int button)
     // Zoom.
     if (button == 4)
     {
-        SetMapScale(1, x, y);
+        SetMapScale(Max(m_mapScale / 2, 1), x, y);
     }
     if (button == 5)
     {
-        SetMapScale(2, x, y);
+        SetMapScale(Min(m_mapScale * 2, m_maxMapScale), x, y);
     }
 
 
@@ -830,9 +867,9 @@ int ClientGame::GetAgentUnderCursor(int xScreen, int yScreen) const
     const AgentEntity* agent = NULL;
     while (m_state.GetNextEntityWithType(index, agent))
     {
-        Vec2 position = GetAgentPosition(agent);
+        Vec2 position = GetAgentDrawPosition(agent);
 
-        if (agent->GetId() != m_selectedAgent &&
+        if (!GetIsSelected(agent->GetId()) &&
             xWorld >= position.x - m_agentTexture.xSize / 2 &&
             yWorld >= position.y - m_agentTexture.ySize / 2 &&
             xWorld <= position.x + m_agentTexture.xSize / 2 &&
@@ -853,8 +890,8 @@ Vec2 ClientGame::GetAgentPosition(const AgentEntity* agent) const
 
     if (targetStop != -1)
     {
-        Vec2 from = m_map.GetStop(stop).point;
-        Vec2 to = m_map.GetStop(targetStop).point;
+        Vec2 from = m_map.GetStopPoint(stop);
+        Vec2 to = m_map.GetStopPoint(targetStop);
 
         float t = (m_time - agent->m_departureTime) / (agent->m_arrivalTime - agent->m_departureTime);
         t = Clamp(t, 0.0f, 1.0f);
@@ -864,7 +901,7 @@ Vec2 ClientGame::GetAgentPosition(const AgentEntity* agent) const
     }
     if (stop != -1)
     {
-        return m_map.GetStop(stop).point;
+        return m_map.GetStopPoint(stop);
     }
     return Vec2(0.0f, 0.0f);
 }
@@ -993,9 +1030,13 @@ void ClientGame::Connect(const char* hostName, int port)
 void ClientGame::HostGame()
 {
     assert(m_server == NULL);
-    m_gameState = GameState_WaitingForServer;
-    m_server = new Server();
+    m_gameState   = GameState_WaitingForServer;
+    m_menuMessage = NULL;
+    m_server = new Server(m_discoveryMode, m_railSpeed, &m_mapPool);
     Connect("127.0.0.1", 12345);
+
+    // Only one game is hosted per run, so the pool isn't needed again.
+    m_mapPool.Stop();
 }
 
 void ClientGame::Update(float deltaTime)
@@ -1006,15 +1047,32 @@ void ClientGame::Update(float deltaTime)
         m_server->Update(deltaTime);
     }
 
+    if (!m_assetLoader.GetIsDone())
+    {
+        if (m_assetLoader.Update(kMaxUploadsPerFrame))
+        {
+            LogMessage("Loaded assets in %.0f ms", m_assetLoader.GetLoadTime() * 1000.0);
+            LogMessage("Packed sprites into %d atlas pages", m_textureAtlas.GetNumPages());
+        }
+    }
+
     if (m_gameState == GameState_MainMenu)
     {
         m_lanListener.Service();
         return;
     }
 
+    // Don't join a game until there's something to draw it with.
+    if (!m_assetLoader.GetIsDone())
+    {
+        return;
+    }
+
     m_screenParticles.Update(deltaTime);
     m_mapParticles.Update(deltaTime);
 
+    UpdateCorrections(deltaTime);
+
     m_time += deltaTime;
     const float kAdjustmentStep = 0.001f;
     if (m_timeAdjustment > 0)
@@ -1029,7 +1087,24 @@ void ClientGame::Update(float deltaTime)
     }
 
     m_host.Service(this);
-    
+
+    UpdateGame();
+
+    // Everything queued this frame goes out in a single packet.
+    if (!m_outgoing.GetIsEmpty())
+    {
+        if (m_serverId != -1)
+        {
+            m_host.SendPacket(m_serverId, 0, m_outgoing.GetData(), m_outgoing.GetSize());
+        }
+        m_outgoing.Clear();
+    }
+
+}
+
+void ClientGame::UpdateGame()
+{
+
     switch (m_gameState)
     {
     case GameState_Playing:
@@ -1070,30 +1145,6 @@ void ClientGame::Update(float deltaTime)
             return;
         }
 
-        // Handle movement
-        if (m_pathLength > 0)
-        {
-            const Entity* entity = GetEntity(m_selectedAgent);
-            if (entity != NULL)
-            {
-                const AgentEntity* agent = entity->Cast<AgentEntity>();
-                if (agent->m_targetStop == -1 && agent->m_currentStop == m_path[m_nextStop])
-                {
-                    // Ready to move again!
-                    ++m_nextStop;
-                    if (m_nextStop < m_pathLength)
-                    {
-                        MoveAgent(m_selectedAgent, m_path[m_nextStop]);
-                    }
-                    else
-                    {
-                        m_pathLength = 0;
-                        m_nextStop = -1;
-                    }
-                }
-            }
-        }
-
         break;
     }
 
@@ -1130,49 +1181,86 @@ void ClientGame::OnDisconnect(int peerId)
 
 void ClientGame::OnPacket(int peerId, int channel, void* data, size_t size)
 {
-    if (peerId == m_serverId)
+
+    if (peerId != m_serverId)
     {
-        char* byteData = static_cast<char*>(data);
-        Protocol::PacketType packetType = static_cast<Protocol::PacketType>(*byteData);
-        
-        switch (packetType)
+        return;
+    }
+
+    MessageReader reader(data, size);
+    MessageReader message;
+    int messageType;
+
+    while (reader.ReadMessage(messageType, message))
+    {
+
+        bool valid = true;
+
+        switch (messageType)
         {
-        case Protocol::PacketType_InitializeGame:
+        case Protocol::MessageType_InitializeGame:
             {
-                Protocol::InitializeGamePacket* packet = static_cast<Protocol::InitializeGamePacket*>(data);
-                OnInitializeGame(*packet);
+                Protocol::InitializeGamePacket packet;
+                valid = Protocol::Read(message, packet);
+                if (valid)
+                {
+                    OnInitializeGame(packet);
+                }
+            }
+            break;
+
+        case Protocol::MessageType_MapData:
+            {
+                Protocol::MapDataPacket packet;
+                valid = Protocol::Read(message, packet);
+                if (valid)
+                {
+                    OnMapData(packet);
+                }
             }
             break;
 
-        case Protocol::PacketType_State:
+        case Protocol::MessageType_State:
             {
-                Protocol::StatePacket* packet = static_cast<Protocol::StatePacket*>(data);
-                m_state.Deserialize(packet->data, packet->header.dataSize);
-                m_timeAdjustment = m_state.GetTime() - m_time;
-                if (fabsf(m_timeAdjustment) > 0.2f)
+                Protocol::StatePacket packet;
+                valid = Protocol::Read(message, packet);
+                if (valid)
                 {
-                    // Snap time
-                    m_time = m_state.GetTime();
-                    m_timeAdjustment = 0;
-                    LogDebug("Snapping time");
+                    OnState(packet);
                 }
             }
             break;
 
-        case Protocol::PacketType_Notification:
+        case Protocol::MessageType_Notification:
             {
-                Protocol::NotificationPacket* packet = static_cast<Protocol::NotificationPacket*>(data);
-                OnNotification(*packet);
+                Protocol::NotificationPacket packet;
+                valid = Protocol::Read(message, packet);
+                if (valid)
+                {
+                    OnNotification(packet);
+                }
             }
             break;
 
         default:
-            LogDebug("Unrecognized packet: %i", packetType);
-        }        
+            LogDebug("Unrecognized message: %i", messageType);
+        }
+
+        if (!valid)
+        {
+            LogError("Malformed message: %i", messageType);
+        }
+
     }
+
+    if (!reader.GetIsValid())
+    {
+        LogError("Malformed packet from server");
+    }
+
 }
 
-void ClientGame::SendOrder(Protocol::OrderPacket& order)
+void ClientGame::SendOrder(const Protocol::OrderPacket& order)
 {
 
     if (m_serverId == -1)
@@ -1181,27 +1269,238 @@ void ClientGame::SendOrder(Protocol::OrderPacket& order)
         return;
     }
 
-    order.packetType = Protocol::PacketType_Order;
-    m_host.SendPacket(m_serverId, 0, &order, sizeof(Protocol::OrderPacket));
+    Protocol::OrderPacket packet = order;
+    packet.sequence = m_nextOrder++;
+
+    PredictOrder(packet);
+    Protocol::Write(m_outgoing, packet);
 
 }
 
-void ClientGame::OnInitializeGame(Protocol::InitializeGamePacket& packet)
+void ClientGame::SendGroupOrder(const Protocol::GroupOrderPacket& order)
 {
+
+    if (m_serverId == -1)
+    {
+        LogError("SendGroupOrder: not connected to server");
+        return;
+    }
+
+    Protocol::GroupOrderPacket packet = order;
+    packet.sequence = m_nextOrder++;
+
+    // Predict each agent separately; they're all acknowledged together.
+    Protocol::OrderPacket agentOrder;
+    agentOrder.sequence = packet.sequence;
+    agentOrder.order    = packet.order;
+    for (size_t i = 0; i < packet.agentIds.size(); ++i)
+    {
+        agentOrder.agentId      = packet.agentIds[i];
+        agentOrder.targetStop   = packet.targetStops[packet.targetStops.size() == 1 ? 0 : i];
+        PredictOrder(agentOrder);
+    }
+
+    Protocol::Write(m_outgoing, packet);
+
+}
+
+void ClientGame::OnInitializeGame(const Protocol::InitializeGamePacket& packet)
+{
+
     LogDebug("Initializing game with seed %i", packet.mapSeed);
+    MapCache_Generate(m_map, packet.xMapSize, packet.yMapSize, packet.mapSeed);
+
+    // Generation uses floating point, so a different build could produce a
+    // different map from the same seed. Use the server's copy in that case.
+    if (m_map.GetHash() != packet.mapHash)
+    {
+        LogMessage("Map doesn't match the server's, requesting it");
+        m_waitingForMap  = true;
+        m_pendingGame    = packet;
+        m_numMapRequests = 0;
+        RequestMap();
+        return;
+    }
+
+    m_waitingForMap = false;
+    StartGame(packet);
+
+}
+
+void ClientGame::OnMapData(const Protocol::MapDataPacket& packet)
+{
+
+    if (!m_waitingForMap)
+    {
+        return;
+    }
+
+    if (!m_map.Load(packet.data, packet.dataSize) ||
+        m_map.GetHash() != m_pendingGame.mapHash ||
+        m_map.GetXSize() != m_pendingGame.xMapSize ||
+        m_map.GetYSize() != m_pendingGame.yMapSize ||
+        m_map.GetSeed() != m_pendingGame.mapSeed)
+    {
+        LogError("Received an invalid map from the server");
+        if (m_numMapRequests < kMaxMapRequests)
+        {
+            RequestMap();
+        }
+        else
+        {
+            LeaveGame("The server's map couldn't be loaded");
+        }
+        return;
+    }
+
+    // Replace our own version so the next game on this map starts straight
+    // away.
+    MapCache_Store(m_map);
+
+    m_waitingForMap = false;
+    StartGame(m_pendingGame);
+
+}
+
+void ClientGame::RequestMap()
+{
+    Protocol::MapRequestPacket request;
+    request.mapHash = m_pendingGame.mapHash;
+    Protocol::Write(m_outgoing, request);
+    ++m_numMapRequests;
+}
+
+void ClientGame::LeaveGame(const char* message)
+{
+
+    LogError("Leaving the game: %s", message);
+
+    m_host.Destroy();
+    m_serverId = -1;
+    m_outgoing.Clear();
+
+    if (m_server)
+    {
+        delete m_server;
+        m_server = NULL;
+    }
+
+    m_waitingForMap = false;
+    m_gameState     = GameState_MainMenu;
+    m_menuMessage   = message;
+
+    // The list is probably out of date after the time spent joining.
+    m_lanListener.Refresh();
+
+}
+
+void ClientGame::StartGame(const Protocol::InitializeGamePacket& packet)
+{
     m_time = packet.time;
     m_clientId = packet.clientId;
     m_xMapSize = packet.xMapSize;
     m_yMapSize = packet.yMapSize;
     m_gridSpacing = packet.gridSpacing;
     m_totalNumIntels = packet.totalNumIntels;
-    m_map.Generate(m_xMapSize, m_yMapSize, packet.mapSeed);
+    m_pathFinder.BuildTable();
+    if (packet.railSpeed > 0.0f)
+    {
+        m_routePlanner.Build(packet.railSpeed, Protocol::transferTime);
+    }
+    else
+    {
+        m_routePlanner.Clear();
+    }
+
+    // Allow zooming out until the whole map fits on the screen.
+    m_maxMapScale = 2;
+    while (m_xMapSize > m_xSize * m_maxMapScale || m_yMapSize > m_ySize * m_maxMapScale)
+    {
+        m_maxMapScale *= 2;
+    }
+    m_mapScale = Min(m_mapScale, m_maxMapScale);
+
     CenterMap(m_xMapSize / 2, m_yMapSize / 2);
+    m_mapLayer.Build(m_map, m_xMapSize, m_yMapSize, m_gridSpacing, m_font);
+
+    // Order sequence numbers start over with each connection.
+    m_nextOrder = 1;
+    m_predictedOrders.clear();
+    m_predictedAgents.clear();
+    m_corrections.clear();
 
     m_gameState = GameState_Playing;
 }
 
-void ClientGame::OnNotification(Protocol::NotificationPacket& packet)
+void ClientGame::OnState(const Protocol::StatePacket& packet)
+{
+
+    // Remember where the predicted agents are drawn so that any difference
+    // from the server state can be smoothed out rather than popping. The
+    // offset here holds the drawn position.
+    CorrectionList drawn;
+    for (size_t i = 0; i < m_predictedAgents.size(); ++i)
+    {
+        Correction correction;
+        correction.agentId = m_predictedAgents[i].GetId();
+        correction.offset  = GetAgentPosition(&m_predictedAgents[i]) + GetCorrection(correction.agentId);
+        drawn.push_back(correction);
+    }
+
+    if (!m_state.Deserialize(packet.data, packet.dataSize))
+    {
+        LogError("Invalid state update");
+        return;
+    }
+
+    // Discard the orders the server has processed; they're included in the
+    // state now.
+    unsigned int ticks = SDL_GetTicks();
+    size_t numPending = 0;
+    for (size_t i = 0; i < m_predictedOrders.size(); ++i)
+    {
+        const PredictedOrder& prediction = m_predictedOrders[i];
+        if (prediction.order.sequence <= packet.lastOrder)
+        {
+            const float kLatencySmoothing = 0.2f;
+            float latency = (ticks - prediction.ticks) / 1000.0f;
+            m_predictionLatency += (latency - m_predictionLatency) * kLatencySmoothing;
+        }
+        else
+        {
+            m_predictedOrders[numPending++] = prediction;
+        }
+    }
+    m_predictedOrders.resize(numPending);
+
+    UpdatePredictedAgents();
+
+    for (size_t i = 0; i < drawn.size(); ++i)
+    {
+        const Entity* entity = GetEntity(drawn[i].agentId);
+        if (entity != NULL)
+        {
+            const AgentEntity* agent = GetPredictedAgent(entity->Cast<AgentEntity>());
+            Vec2 offset = drawn[i].offset - GetAgentPosition(agent);
+            SetCorrection(drawn[i].agentId, offset);
+            if (DotProduct(offset, offset) > 1.0f)
+            {
+                m_correctionDistance = sqrtf(DotProduct(offset, offset));
+            }
+        }
+    }
+
+    m_timeAdjustment = m_state.GetTime() - m_time;
+    if (fabsf(m_timeAdjustment) > 0.2f)
+    {
+        // Snap time
+        m_time = m_state.GetTime();
+        m_timeAdjustment = 0;
+        LogDebug("Snapping time");
+    }
+}
+
+void ClientGame::OnNotification(const Protocol::NotificationPacket& packet)
 {
     LogDebug("Notification: %d", packet.notification);
     m_notificationLog.AddNotification(m_time, packet);
@@ -1248,8 +1547,9 @@ void ClientGame::UpdateActiveButtons()
                 structure = GetStructureAtStop(agent->m_currentStop);
             }
 
-            m_button[ButtonId_Hack].toggled     = agent->m_state == AgentEntity::State_Hacking;
-            m_button[ButtonId_Stakeout].toggled = agent->m_state == AgentEntity::State_Stakeout;
+            const AgentEntity* predicted = GetPredictedAgent(agent);
+            m_button[ButtonId_Hack].toggled     = predicted->m_state == AgentEntity::State_Hacking;
+            m_button[ButtonId_Stakeout].toggled = predicted->m_state == AgentEntity::State_Stakeout;
 
         }
     }
@@ -1257,7 +1557,7 @@ void ClientGame::UpdateActiveButtons()
     bool buttonEnabled[ButtonId_NumButtons];
     for (int i = 0; i < ButtonId_NumButtons; ++i)
     {
-        buttonEnabled[i] = selection && m_pathLength == 0;
+        buttonEnabled[i] = selection;
     }
 
     if (structure == StructureType_House)
@@ -1328,7 +1628,7 @@ void ClientGame::PlaySample(HSAMPLE sample)
 
 StructureType ClientGame::GetStructureAtStop(int stop) const
 {
-    StructureType structureType = m_map.GetStop(stop).structureType;   
+    StructureType structureType = m_map.GetStopStructure(stop);   
 
     if (structureType != StructureType_None)
     {
@@ -1390,6 +1690,13 @@ void ClientGame::RenderMainMenu()
     glClearColor( 0.97f * 0.9f, 0.96f * 0.9f, 0.89f * 0.9f, 0.0f );
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
+    // The menu's images are the first things loaded, but may not be in yet.
+    // If one of them failed to load the menu is drawn without it.
+    if (!m_assetLoader.GetIsDelivered(m_numMenuAssets))
+    {
+        return;
+    }
+
     const int titleOffset = 50;
 
     glEnable(GL_TEXTURE_2D);
@@ -1398,20 +1705,25 @@ void ClientGame::RenderMainMenu()
     glLoadIdentity();
     gluOrtho2D(0, m_xSize, m_ySize, 0);
 
-    glColor(0x80FFFFFF);
-    glBindTexture(GL_TEXTURE_2D, m_titleBackgroundTexture.handle);
-    glBegin(GL_QUADS);
+    if (m_titleBackgroundTexture.xSize > 0)
+    {
 
-    glTexCoord2f(0, 0);
-    glVertex2i(0, titleOffset);
-    glTexCoord2i(m_xSize / m_titleBackgroundTexture.xSize, 0);
-    glVertex2i(m_xSize, titleOffset);
-    glTexCoord2i(m_xSize / m_titleBackgroundTexture.xSize, 1);
-    glVertex2i(m_xSize, titleOffset + m_titleBackgroundTexture.ySize);
-    glTexCoord2f(0, 1);
-    glVertex2i(0, titleOffset + m_titleBackgroundTexture.ySize);
+        glColor(0x80FFFFFF);
+        glBindTexture(GL_TEXTURE_2D, m_titleBackgroundTexture.handle);
+        glBegin(GL_QUADS);
 
-    glEnd();
+        glTexCoord2f(0, 0);
+        glVertex2i(0, titleOffset);
+        glTexCoord2i(m_xSize / m_titleBackgroundTexture.xSize, 0);
+        glVertex2i(m_xSize, titleOffset);
+        glTexCoord2i(m_xSize / m_titleBackgroundTexture.xSize, 1);
+        glVertex2i(m_xSize, titleOffset + m_titleBackgroundTexture.ySize);
+        glTexCoord2f(0, 1);
+        glVertex2i(0, titleOffset + m_titleBackgroundTexture.ySize);
+
+        glEnd();
+
+    }
 
     glColor(0xFFFFFFFF);
     Render_DrawSprite(m_titleTextTexture, (m_xSize - m_titleTextTexture.xSize) / 2, titleOffset + (m_titleBackgroundTexture.ySize - m_titleTextTexture.ySize) / 2);
@@ -1436,23 +1748,53 @@ void ClientGame::RenderMainMenu()
         HostGame();
     }
 
-    for (int i = 0; i < m_lanListener.GetNumServers(); ++i)
+    const char* sortLabels[LanListener::SortMode_Count] = { "Sort: none", "Sort: load", "Sort: ping" };
+    if (UI_Button(UI_ID, m_font, (m_xSize + xButtonSize) / 2 + 10, m_ySize - 300 + (yButtonSize + 10) * 0, xButtonSize / 2, yButtonSize, sortLabels[m_serverSortMode]))
+    {
+        m_serverSortMode = static_cast<LanListener::SortMode>((m_serverSortMode + 1) % LanListener::SortMode_Count);
+    }
+
+    if (UI_Button(UI_ID, m_font, (m_xSize + xButtonSize) / 2 + 10, m_ySize - 300 + (yButtonSize + 10) * 1, xButtonSize / 2, yButtonSize, "Refresh"))
+    {
+        m_lanListener.Refresh();
+    }
+
+    // Only as many servers as fit on the screen are shown, so the sort order
+    // decides which ones.
+    std::vector<const LanListener::Server*> servers;
+    m_lanListener.GetSortedServers(m_serverSortMode, servers);
+
+    int maxServers = (300 - yButtonSize) / (yButtonSize + 10);
+    for (int i = 0; i < static_cast<int>(servers.size()) && i < maxServers; ++i)
     {
-        const LanListener::Server& server = m_lanListener.GetServer(i);
+        const LanListener::Server& server = *servers[i];
         char buffer[256];
-        sprintf(buffer, "Join '%s'", server.name);
-        if (UI_Button(UI_ID, m_font, (m_xSize - xButtonSize) / 2, m_ySize - 300 + (yButtonSize + 10) * (1 + i), xButtonSize, yButtonSize, buffer))
+        sprintf(buffer, "Join '%s' (%d/%d, %d%% load)", server.name,
+            server.numPlayers, server.maxPlayers, static_cast<int>(server.load * 100.0f + 0.5f));
+        if (UI_Button((UI_ID << 16) + i, m_font, (m_xSize - xButtonSize) / 2, m_ySize - 300 + (yButtonSize + 10) * (1 + i), xButtonSize, yButtonSize, buffer))
         {
             char addres[256];
             sprintf(addres, "%d.%d.%d.%d",
                 (server.ip >> 24) & 0xFF, (server.ip >> 16) & 0xFF, (server.ip >> 8) & 0xFF, server.ip & 0xFF);
-            m_gameState = GameState_WaitingForServer;
+            m_gameState   = GameState_WaitingForServer;
+            m_menuMessage = NULL;
             Connect(addres, server.port);
         }
     }
 
     UI_End();
 
+    // Explains why the last game was left, if it didn't end normally.
+    if (m_menuMessage != NULL)
+    {
+        int textWidth  = Font_GetTextWidth(m_font, m_menuMessage);
+        int textHeight = Font_GetTextHeight(m_font);
+        glColor(0xFF800000);
+        Font_BeginDrawing(m_font);
+        Font_DrawText(m_menuMessage, (m_xSize - textWidth) / 2, m_ySize - 300 - textHeight - 20);
+        Font_EndDrawing();
+    }
+
 }
 
 bool ClientGame::DoButton(const char* text, int x, int y, int xSize, int ySize) const
@@ -1477,30 +1819,364 @@ bool ClientGame::DoButton(const char* text, int x, int y, int xSize, int ySize)
     return true;
 }
 
-void ClientGame::MoveAgent(int agentId, int stop)
+void ClientGame::MoveSelectedAgents(int stop)
 {
 
-    if (agentId == -1 || stop == -1)
+    if (stop == -1)
     {
         return;
     }
 
-    const Entity* entity = GetEntity(agentId);
-    if (entity == NULL)
+    // Clicking the stop the agents are at (or headed to) stops them following
+    // their routes.
+    bool cancel = true;
+    bool routing = false;
+
+    for (size_t i = 0; i < m_selectedAgents.size(); ++i)
     {
-        return;
+        const Entity* entity = GetEntity(m_selectedAgents[i]);
+        if (entity != NULL)
+        {
+            const AgentEntity* agent = GetPredictedAgent(entity->Cast<AgentEntity>());
+            int nextStop = agent->m_targetStop != -1 ? agent->m_targetStop : agent->m_currentStop;
+            if (nextStop != stop)
+            {
+                cancel = false;
+            }
+            if (agent->m_destinationStop != -1)
+            {
+                routing = true;
+            }
+        }
     }
 
-    const AgentEntity* agent = entity->Cast<AgentEntity>();
-    if (agent->m_targetStop == -1)
+    if (!cancel)
     {
-        Protocol::OrderPacket order;
-        order.order = Protocol::Order_MoveTo;
-        order.agentId = agentId;
-        order.targetStop = stop;
-        SendOrder(order);
+        OrderSelectedAgents(Protocol::Order_Route, stop);
         // TODO: play in response from the server?
         PlaySample(m_soundTrain);
     }
+    else if (routing)
+    {
+        OrderSelectedAgents(Protocol::Order_Cancel, -1);
+    }
+
+}
+
+void ClientGame::OrderSelectedAgents(Protocol::Order order, int targetStop)
+{
+
+    if (m_selectedAgents.empty())
+    {
+        return;
+    }
+
+    if (m_selectedAgents.size() == 1)
+    {
+        Protocol::OrderPacket packet;
+        packet.order        = order;
+        packet.agentId      = m_selectedAgents[0];
+        packet.targetStop   = targetStop;
+        SendOrder(packet);
+    }
+    else
+    {
+        Protocol::GroupOrderPacket packet;
+        packet.order        = order;
+        packet.agentIds     = m_selectedAgents;
+        packet.targetStops.push_back(targetStop);
+        SendGroupOrder(packet);
+    }
+
+}
+
+bool ClientGame::GetIsSelected(int agentId) const
+{
+    return std::find(m_selectedAgents.begin(), m_selectedAgents.end(), agentId) != m_selectedAgents.end();
+}
+
+Vec2 ClientGame::GetAgentDrawPosition(const AgentEntity* agent) const
+{
+    return GetAgentPosition(GetPredictedAgent(agent)) + GetCorrection(agent->GetId());
+}
+
+void ClientGame::PredictOrder(const Protocol::OrderPacket& order)
+{
+
+    const Entity* entity = GetEntity(order.agentId);
+    if (entity == NULL || entity->GetOwnerId() != m_clientId)
+    {
+        return;
+    }
+
+    // Check the order against the current prediction so that we don't keep
+    // orders which won't have any effect.
+    AgentEntity agent = *GetPredictedAgent(entity->Cast<AgentEntity>());
+    if (!ApplyOrder(agent, order, m_time))
+    {
+        return;
+    }
+
+    PredictedOrder prediction;
+    prediction.order = order;
+    prediction.time  = m_time;
+    prediction.ticks = SDL_GetTicks();
+    m_predictedOrders.push_back(prediction);
+
+    UpdatePredictedAgents();
+
+}
+
+bool ClientGame::ApplyOrder(AgentEntity& agent, const Protocol::OrderPacket& order, float time) const
+{
+
+    // This mirrors the checks in Server::Client::OnOrder.
+    switch (order.order)
+    {
+    case Protocol::Order_MoveTo:
+        agent.m_destinationStop = -1;
+        return ApplyMove(agent, order.targetStop, time);
+
+    case Protocol::Order_Route:
+        {
+            if (order.targetStop < 0 || order.targetStop >= m_map.GetNumStops() || agent.m_currentStop == -1)
+            {
+                return false;
+            }
+
+            // Only the first hop is predicted; the server advances the rest.
+            int start = agent.m_targetStop != -1 ? agent.m_targetStop : agent.m_currentStop;
+            int nextStop;
+            if (m_routePlanner.GetIsBuilt())
+            {
+                nextStop = m_routePlanner.GetNextStop(start, order.targetStop);
+            }
+            else
+            {
+                nextStop = m_pathFinder.GetNextStop(start, order.targetStop);
+            }
+            if (nextStop == -1)
+            {
+                return false;
+            }
+            if (nextStop == start)
+            {
+                agent.m_destinationStop = -1;
+                return true;
+            }
+            agent.m_destinationStop = order.targetStop;
+            if (agent.m_targetStop == -1)
+            {
+                ApplyMove(agent, nextStop, time);
+            }
+        }
+        return true;
+
+    case Protocol::Order_Cancel:
+        agent.m_destinationStop = -1;
+        return true;
+
+    case Protocol::Order_Hack:
+        if (agent.m_currentStop == -1 || m_map.GetStopStructure(agent.m_currentStop) == StructureType_None)
+        {
+            return false;
+        }
+        if (agent.m_state == AgentEntity::State_Hacking)
+        {
+            agent.m_state = AgentEntity::State_Idle;
+        }
+        else
+        {
+            agent.m_state = AgentEntity::State_Hacking;
+            agent.m_destinationStop = -1;
+        }
+        return true;
+
+    case Protocol::Order_Stakeout:
+        if (agent.m_state == AgentEntity::State_Stakeout)
+        {
+            agent.m_state = AgentEntity::State_Idle;
+        }
+        else
+        {
+            agent.m_state = AgentEntity::State_Stakeout;
+            agent.m_destinationStop = -1;
+        }
+        return true;
+
+    default:
+        // The outcome of the other orders depends on things the client
+        // can't see, so wait for the server.
+        return false;
+    }
+
+}
+
+bool ClientGame::ApplyMove(AgentEntity& agent, int stop, float time) const
+{
+
+    if (agent.m_targetStop != -1 || agent.m_currentStop == -1)
+    {
+        return false;
+    }
+
+    if (!m_map.GetIsConnected(agent.m_currentStop, stop))
+    {
+        return false;
+    }
+
+    agent.m_targetStop      = stop;
+    agent.m_departureTime   = time;
+    agent.m_arrivalTime     = time + GetHopTime(agent.m_currentStop, stop);
+    agent.m_state           = AgentEntity::State_Idle;
+    return true;
+
+}
+
+float ClientGame::GetHopTime(int stopA, int stopB) const
+{
+    if (m_routePlanner.GetIsBuilt())
+    {
+        return m_routePlanner.GetHopTime(stopA, stopB);
+    }
+    return Protocol::travelTime;
+}
+
+void ClientGame::UpdatePredictedAgents()
+{
+
+    m_predictedAgents.clear();
+
+    for (size_t i = 0; i < m_predictedOrders.size(); ++i)
+    {
+
+        const PredictedOrder& prediction = m_predictedOrders[i];
+
+        AgentEntity* agent = NULL;
+        for (size_t j = 0; j < m_predictedAgents.size(); ++j)
+        {
+            if (m_predictedAgents[j].GetId() == prediction.order.agentId)
+            {
+                agent = &m_predictedAgents[j];
+                break;
+            }
+        }
+
+        if (agent == NULL)
+        {
+            const Entity* entity = GetEntity(prediction.order.agentId);
+            if (entity == NULL || entity->GetOwnerId() != m_clientId)
+            {
+                // We lost the agent; the prediction no longer matters.
+                continue;
+            }
+            m_predictedAgents.push_back(*entity->Cast<AgentEntity>());
+            agent = &m_predictedAgents.back();
+        }
+
+        ApplyOrder(*agent, prediction.order, prediction.time);
+
+    }
+
+}
+
+const AgentEntity* ClientGame::GetPredictedAgent(const AgentEntity* agent) const
+{
+    for (size_t i = 0; i < m_predictedAgents.size(); ++i)
+    {
+        if (m_predictedAgents[i].GetId() == agent->GetId())
+        {
+            return &m_predictedAgents[i];
+        }
+    }
+    return agent;
+}
+
+Vec2 ClientGame::GetCorrection(int agentId) const
+{
+    for (size_t i = 0; i < m_corrections.size(); ++i)
+    {
+        if (m_corrections[i].agentId == agentId)
+        {
+            return m_corrections[i].offset;
+        }
+    }
+    return Vec2(0.0f, 0.0f);
+}
+
+void ClientGame::SetCorrection(int agentId, const Vec2& offset)
+{
+
+    // Large differences are things like the agent being captured, which look
+    // better as a jump than sliding across the map.
+    const float kMaxCorrection = 200.0f;
+    bool snap = DotProduct(offset, offset) > kMaxCorrection * kMaxCorrection;
+
+    for (size_t i = 0; i < m_corrections.size(); ++i)
+    {
+        if (m_corrections[i].agentId == agentId)
+        {
+            if (snap)
+            {
+                m_corrections.erase(m_corrections.begin() + i);
+            }
+            else
+            {
+                m_corrections[i].offset = offset;
+            }
+            return;
+        }
+    }
+
+    if (!snap)
+    {
+        Correction correction;
+        correction.agentId = agentId;
+        correction.offset  = offset;
+        m_corrections.push_back(correction);
+    }
+
+}
+
+void ClientGame::UpdateCorrections(float deltaTime)
+{
+
+    // Exponentially decay the offsets so the agents ease into the position
+    // given by the server.
+    const float kCorrectionRate = 8.0f;
+    float scale = expf(-kCorrectionRate * deltaTime);
+
+    size_t numCorrections = 0;
+    for (size_t i = 0; i < m_corrections.size(); ++i)
+    {
+        Correction correction = m_corrections[i];
+        correction.offset = scale * correction.offset;
+        if (DotProduct(correction.offset, correction.offset) > 0.01f)
+        {
+            m_corrections[numCorrections++] = correction;
+        }
+    }
+    m_corrections.resize(numCorrections);
+
+}
+
+void ClientGame::SetShowPredictionOverlay(bool showPredictionOverlay)
+{
+    m_showPredictionOverlay = showPredictionOverlay;
+}
+
+void ClientGame::RenderPredictionOverlay()
+{
+
+    char buffer[128];
+    sprintf(buffer, "Prediction: %d ms hidden, %d pending, last correction %.1f",
+        static_cast<int>(m_predictionLatency * 1000.0f),
+        static_cast<int>(m_predictedOrders.size()),
+        m_correctionDistance);
+
+    Font_BeginDrawing(m_font);
+    glColor(0xFF000000);
+    Font_DrawText(buffer, 10, 10);
+    Font_EndDrawing();
 
 }
@@ -2,22 +2,33 @@
 #define GAME_CLIENT_GAME_H
 
 #include "Texture.h"
+#include "TextureAtlas.h"
+#include "AssetLoader.h"
+#include "SpriteBatch.h"
 #include "Font.h"
 #include "Map.h"
+#include "MapLayer.h"
+#include "MapPool.h"
+#include "PathFinder.h"
+#include "RoutePlanner.h"
 
-#include "Host.h"
+#include "NetworkThread.h"
 #include "Protocol.h"
+#include "Message.h"
 #include "EntityState.h"
 #include "EntityType.h"
 #include "EntityTypeRegistry.h"
 #include "LanListener.h"
+#include "LanBroadcast.h"
 #include "Particles.h"
 #include "NotificationLog.h"
 #include "Random.h"
+#include "AgentEntity.h"
 
 #include <bass.h>
 
-class AgentEntity;
+#include <vector>
+
 class PlayerEntity;
 class Server;
 
@@ -26,12 +37,20 @@ class ClientGame : Host::Handler
 
 public:
 
-    ClientGame(int xSize, int ySize, bool playMusic);
+    ClientGame(int xSize, int ySize, bool playMusic, LanBroadcast::Mode discoveryMode, float railSpeed);
     ~ClientGame();
 
     void LoadResources();
+
+    // Writes the assets LoadResources uses to the asset archive.
+    bool PackResources();
+
     void Render();
 
+    // Shows the prediction statistics in the corner of the screen. Off by
+    // default.
+    void SetShowPredictionOverlay(bool showPredictionOverlay);
+
     void OnMouseDown(int x, int y, int button);
     void OnMouseUp(int x, int y, int button);
     void OnMouseMove(int x, int y);
@@ -79,6 +98,27 @@ private:
         bool    toggled;
     };
 
+    // An order which has been applied locally but not yet acknowledged by the
+    // server.
+    struct PredictedOrder
+    {
+        Protocol::OrderPacket   order;
+        float                   time;           // Game time the order was issued
+        unsigned int            ticks;          // Wall clock time the order was issued
+    };
+
+    // Offset added to the drawn position of an agent to smooth over a
+    // prediction that didn't match the server.
+    struct Correction
+    {
+        int     agentId;
+        Vec2    offset;
+    };
+
+    typedef std::vector<PredictedOrder> PredictedOrderList;
+    typedef std::vector<AgentEntity>    AgentList;
+    typedef std::vector<Correction>     CorrectionList;
+
     void ScreenToWorld(int xScreen, int yScreen, int& xWorld, int& yWorld) const;
 
     // Sets the zoom for the map and adjusts the panning so the specified point
@@ -89,11 +129,22 @@ private:
     // screen.
     void CenterMap(int xWorld, int yWorld);
 
-    void SendOrder(Protocol::OrderPacket& order);
+    void SendOrder(const Protocol::OrderPacket& order);
+    void SendGroupOrder(const Protocol::GroupOrderPacket& order);
+
+    void OnInitializeGame(const Protocol::InitializeGamePacket& packet);
+    void OnMapData(const Protocol::MapDataPacket& packet);
+    void StartGame(const Protocol::InitializeGamePacket& packet);
 
-    void OnInitializeGame(Protocol::InitializeGamePacket& packet);
+    // Asks the server for its copy of the map in m_pendingGame.
+    void RequestMap();
 
-    void OnNotification(Protocol::NotificationPacket& packet);
+    // Disconnects and goes back to the main menu, showing message there.
+    void LeaveGame(const char* message);
+
+    void OnState(const Protocol::StatePacket& packet);
+
+    void OnNotification(const Protocol::NotificationPacket& packet);
 
     void GetButtonRect(ButtonId buttonId, int& x, int& y, int& xSize, int& ySize) const;
 
@@ -111,6 +162,34 @@ private:
 
     Vec2 GetAgentPosition(const AgentEntity* agent) const;
 
+    // Returns the position the agent is drawn at, including predicted orders
+    // and any correction that is still being smoothed out.
+    Vec2 GetAgentDrawPosition(const AgentEntity* agent) const;
+
+    // Applies the order to a local copy of the agent until the server
+    // acknowledges it. Only orders whose outcome the client can determine
+    // on its own are predicted.
+    void PredictOrder(const Protocol::OrderPacket& order);
+
+    // Returns true if the order changed the agent.
+    bool ApplyOrder(AgentEntity& agent, const Protocol::OrderPacket& order, float time) const;
+    bool ApplyMove(AgentEntity& agent, int stop, float time) const;
+    float GetHopTime(int stopA, int stopB) const;
+
+    // Rebuilds the predicted agents from the server state and the orders
+    // that haven't been acknowledged yet.
+    void UpdatePredictedAgents();
+
+    // Returns the predicted copy of the agent, or the agent itself if it
+    // has no outstanding orders.
+    const AgentEntity* GetPredictedAgent(const AgentEntity* agent) const;
+
+    Vec2 GetCorrection(int agentId) const;
+    void SetCorrection(int agentId, const Vec2& offset);
+    void UpdateCorrections(float deltaTime);
+
+    void RenderPredictionOverlay();
+
     StructureType GetStructureAtStop(int stop) const;
 
     const Entity* GetEntity(int id) const;
@@ -120,9 +199,22 @@ private:
 
     void RenderMainMenu();
 
+    // Queues every texture and sound on m_assetLoader.
+    void QueueResources();
+
     bool DoButton(const char* text, int x, int y, int xSize, int ySize) const;
 
-    void MoveAgent(int agentId, int stop);
+    // Sends the selected agents to the stop; the server moves them along the
+    // route. If the stop is where the agents are (or are headed) their routes
+    // are cancelled.
+    void MoveSelectedAgents(int stop);
+
+    // Sends one order for all of the selected agents.
+    void OrderSelectedAgents(Protocol::Order order, int targetStop);
+
+    bool GetIsSelected(int agentId) const;
+
+    void UpdateGame();
 
 private:
 
@@ -130,7 +222,11 @@ private:
 
 
     Server*             m_server;
+    LanBroadcast::Mode  m_discoveryMode;     // Used by servers hosted from the menu
+    float               m_railSpeed;         // Used by servers hosted from the menu
+    MapPool             m_mapPool;           // A map ready for the server hosted from the menu
     LanListener         m_lanListener;
+    LanListener::SortMode m_serverSortMode;
     Random              m_random;
 
     float               m_time;
@@ -139,6 +235,7 @@ private:
     int                 m_ySize;
 
     int                 m_mapScale;
+    int                 m_maxMapScale;
     int                 m_mapX;
     int                 m_mapY;
 
@@ -176,6 +273,10 @@ private:
     Texture             m_titleTextTexture;
     Texture             m_titleBackgroundTexture;
     Texture             m_uiTexture;
+    TextureAtlas        m_textureAtlas;
+    AssetLoader         m_assetLoader;
+    int                 m_numMenuAssets;    // Files queued before the rest, needed by the main menu
+    SpriteBatch         m_spriteBatch;
 
     Button              m_button[ButtonId_NumButtons];
 
@@ -186,12 +287,17 @@ private:
 
     GameState           m_gameState;
     Map                 m_map;
+    MapLayer            m_mapLayer;
+    mutable PathFinder  m_pathFinder;       // Only holds scratch space between queries
+    mutable RoutePlanner m_routePlanner;    // Only built if the server times travel by rail length
+    std::vector<int>    m_previewPath;
     int                 m_xMapSize;
     int                 m_yMapSize;
     int                 m_gridSpacing;
 
-    Host                m_host;
+    NetworkThread       m_host;
     int                 m_serverId;
+    MessageWriter       m_outgoing;
 
     EntityTypeRegistry  m_typeRegistry;
     EntityState         m_state;
@@ -199,6 +305,7 @@ private:
     int                 m_hoverStop;
     ButtonId            m_hoverButton;
     int                 m_selectedAgent;
+    std::vector<int>    m_selectedAgents;       // Includes m_selectedAgent; shift-click adds more
 
     int                 m_maxPlayersInGame;
     float               m_gameOverTime;
@@ -209,12 +316,23 @@ private:
     NotificationLog     m_notificationLog;
 
     int                 m_totalNumIntels;
+
+    // Set while the server sends its map because ours didn't match.
+    bool                m_waitingForMap;
+    Protocol::InitializeGamePacket m_pendingGame;
+    int                 m_numMapRequests;
+
+    const char*         m_menuMessage;          // Shown on the main menu, or NULL
     
     float               m_timeAdjustment;
-    
-    int                 m_path[Map::s_maxStops];
-    int                 m_pathLength;
-    int                 m_nextStop;
+
+    unsigned int        m_nextOrder;
+    PredictedOrderList  m_predictedOrders;
+    AgentList           m_predictedAgents;
+    CorrectionList      m_corrections;
+    float               m_predictionLatency;    // Smoothed time between issuing and acknowledging an order
+    float               m_correctionDistance;   // Size of the last correction
+    bool                m_showPredictionOverlay;
 };
 
 #endif
@@ -1,4 +1,5 @@
 #include "Entity.h"
+#include "Message.h"
 
 Entity::Entity()
 {
@@ -26,3 +27,15 @@ int Entity::GetOwnerId() const
 {
     return m_ownerId;
 }
+
+void Entity::Serialize(MessageWriter& writer) const
+{
+    writer.WriteVarInt(m_id);
+    writer.WriteVarInt(m_ownerId);
+}
+
+void Entity::Deserialize(MessageReader& reader)
+{
+    reader.ReadVarInt(m_id);
+    reader.ReadVarInt(m_ownerId);
+}
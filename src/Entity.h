@@ -1,9 +1,13 @@
 #ifndef GAME_ENTITY_H
 #define GAME_ENTITY_H
 
-#include "EntityType.h"
 #include "EntityTypeRegistry.h"
 
+#include <stddef.h>
+
+class MessageWriter;
+class MessageReader;
+
 class Entity
 {
 
@@ -18,6 +22,11 @@ public:
     void SetOwnerId(int clientId);
     int GetOwnerId() const;
 
+    // Writes the fields common to all entities. Each entity type hides these
+    // with versions that write its own fields after them.
+    void Serialize(MessageWriter& writer) const;
+    void Deserialize(MessageReader& reader);
+
     template<class T>
     T* Cast();
 
@@ -1,16 +1,10 @@
 #include "EntityState.h"
 
 #include "Entity.h"
+#include "Message.h"
 
 #include <assert.h>
 
-struct SerializeHeader
-{
-    size_t  numEntities;
-    float   time;
-};
-
-
 EntityState::EntityState(EntityTypeRegistry* typeRegistry)
 {
     m_nextEntityId = 1;  
@@ -42,72 +36,88 @@ const Entity* EntityState::GetEntity(int entityIndex) const
     return m_entities[entityIndex];
 }
 
-size_t EntityState::GetSerializedSize(int clientId) const
+void EntityState::Serialize(int clientId, MessageWriter& writer) const
 {
-    size_t size = sizeof(SerializeHeader);
 
+    unsigned int numEntities = 0;
     for (size_t i = 0; i < m_entities.size(); ++i)
     {
-        Entity* entity = m_entities[i];
-        if (entity->GetOwnerId() == clientId || entity->GetOwnerId() == -1)
+        if (GetIsVisible(m_entities[i], clientId))
         {
-            EntityType* entityType = m_typeRegistry->GetType(entity->GetTypeId());
-            size += entityType->GetSerializedSize(entity) + sizeof(EntityTypeId);
+            ++numEntities;
         }
     }
 
-    return size;
-}
+    writer.WriteVarUInt(numEntities);
+    writer.WriteFloat(m_time);
 
-void EntityState::Serialize(int clientId, void* buffer, size_t size) const
-{
-
-    SerializeHeader* header = static_cast<SerializeHeader*>(buffer);
-    header->time = m_time;
-
-    char* entityBuffer = reinterpret_cast<char*>(header + 1);
-    size_t numEntities = 0;
     for (size_t i = 0; i < m_entities.size(); ++i)
     {
-        Entity* entity = m_entities[i];
-
-        if (entity->GetOwnerId() == clientId || entity->GetOwnerId() == -1)
+        const Entity* entity = m_entities[i];
+        if (GetIsVisible(entity, clientId))
         {
             EntityTypeId typeId = entity->GetTypeId();
+            writer.WriteVarUInt(typeId);
+            m_typeRegistry->GetType(typeId)->Serialize(entity, writer);
+        }
+    }
 
-            *reinterpret_cast<EntityTypeId*>(entityBuffer) = typeId;
-            entityBuffer += sizeof(EntityTypeId);
+}
 
-            EntityType* entityType = m_typeRegistry->GetType(typeId);
-            entityBuffer += entityType->Serialize(m_entities[i], entityBuffer);
+bool EntityState::Deserialize(const void* buffer, size_t size)
+{
 
-            ++numEntities;
+    MessageReader reader(buffer, size);
+
+    unsigned int numEntities = 0;
+    float time = 0.0f;
+    reader.ReadVarUInt(numEntities);
+    reader.ReadFloat(time);
+
+    // Validate the whole buffer before touching the current state by reading
+    // each entity into a scratch one of the same type.
+    Entity* scratch[EntityTypeId_Count] = { NULL };
+    MessageReader validateReader = reader;
+    bool valid = validateReader.GetIsValid();
+    for (unsigned int i = 0; i < numEntities && valid; ++i)
+    {
+        EntityType* entityType = ReadType(validateReader);
+        if (entityType == NULL)
+        {
+            valid = false;
+            break;
         }
-    }
 
-    header->numEntities = numEntities;
-    assert(entityBuffer == static_cast<char*>(buffer) + size);
+        Entity*& entity = scratch[entityType->GetTypeId()];
+        if (entity == NULL)
+        {
+            entity = entityType->Create(-1);
+        }
+        entityType->Deserialize(entity, validateReader);
+        valid = validateReader.GetIsValid();
+    }
 
-}
+    for (int i = 0; i < EntityTypeId_Count; ++i)
+    {
+        delete scratch[i];
+    }
 
-void EntityState::Deserialize(const void* buffer, size_t size)
-{
+    if (!valid || !validateReader.GetIsAtEnd())
+    {
+        return false;
+    }
 
-    const SerializeHeader* header = static_cast<const SerializeHeader*>(buffer);
-    m_time = header->time;
+    m_time = time;
 
-    if (m_entities.size() < header->numEntities)
+    if (m_entities.size() < numEntities)
     {
-        m_entities.resize(header->numEntities, NULL);
+        m_entities.resize(numEntities, NULL);
     }    
 
-    const char* entityBuffer = reinterpret_cast<const char*>(header + 1);
-    for (size_t i = 0; i < header->numEntities; ++i)
+    for (size_t i = 0; i < numEntities; ++i)
     {
-        EntityTypeId typeId = *reinterpret_cast<const EntityTypeId*>(entityBuffer);
-        entityBuffer += sizeof(EntityTypeId);
-
-        EntityType* entityType = m_typeRegistry->GetType(typeId);
+        EntityType* entityType = ReadType(reader);
+        EntityTypeId typeId = entityType->GetTypeId();
 
         if (m_entities[i] == NULL)
         {
@@ -119,20 +129,39 @@ void EntityState::Deserialize(const void* buffer, size_t size)
             m_entities[i] = entityType->Create(-1);
         }
 
-        entityBuffer += entityType->Deserialize(m_entities[i], entityBuffer);
+        entityType->Deserialize(m_entities[i], reader);
     }
 
-    if (m_entities.size() > header->numEntities)
+    if (m_entities.size() > numEntities)
     {
-        for (size_t i = header->numEntities; i < m_entities.size(); ++i)
+        for (size_t i = numEntities; i < m_entities.size(); ++i)
         {
             delete m_entities[i];
         }
 
-        m_entities.resize(header->numEntities);
+        m_entities.resize(numEntities);
+    }
+
+    assert(reader.GetIsValid() && reader.GetIsAtEnd());
+    return true;
+
+}
+
+bool EntityState::GetIsVisible(const Entity* entity, int clientId)
+{
+    return entity->GetOwnerId() == clientId || entity->GetOwnerId() == -1;
+}
+
+EntityType* EntityState::ReadType(MessageReader& reader) const
+{
+
+    unsigned int typeId = 0;
+    if (!reader.ReadVarUInt(typeId) || typeId >= EntityTypeId_Count)
+    {
+        return NULL;
     }
 
-    assert(entityBuffer == static_cast<const char*>(buffer) + size);
+    return m_typeRegistry->GetType(static_cast<EntityTypeId>(typeId));
 
 }
 
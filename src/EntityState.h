@@ -7,6 +7,8 @@
 
 class Entity;
 class EntityTypeRegistry;
+class MessageWriter;
+class MessageReader;
 
 class EntityState
 {
@@ -22,9 +24,10 @@ public:
     Entity* GetEntity(int entityIndex);    
     const Entity* GetEntity(int entityIndex) const;
     
-    size_t GetSerializedSize(int clientId) const;
-    void Serialize(int clientId, void* buffer, size_t size) const;
-    void Deserialize(const void* buffer, size_t size);
+    // Writes the entities visible to the client.
+    void Serialize(int clientId, MessageWriter& writer) const;
+    // Returns false (leaving the state untouched) if the buffer is malformed.
+    bool Deserialize(const void* buffer, size_t size);
 
     Entity* CreateEntity(EntityTypeId typeId, int ownerId=-1);
 
@@ -43,6 +46,13 @@ public:
     template<class T>
     bool GetNextEntityWithType(int& index, T*& entity) const;
 
+private:
+
+    static bool GetIsVisible(const Entity* entity, int clientId);
+
+    // Returns NULL if the type id is out of range or unregistered.
+    EntityType* ReadType(MessageReader& reader) const;
+
 private:
 
     typedef std::vector<Entity*> EntityList;
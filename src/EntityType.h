@@ -1,12 +1,14 @@
 #ifndef GAME_ENTITY_TYPE_H
 #define GAME_ENTITY_TYPE_H
 
+#include "Entity.h"
+#include "EntityTypeRegistry.h"
+
 #include <assert.h>
 #include <vector>
 
-
-enum EntityTypeId;
-class Entity;
+class MessageWriter;
+class MessageReader;
 
 class EntityType
 {
@@ -16,9 +18,10 @@ public:
     EntityTypeId GetTypeId();
 
     virtual Entity* Create(int entityId)=0;
-    virtual size_t GetSerializedSize(Entity* entity) const=0;
-    virtual size_t Serialize(const Entity* entity, void *buffer) const=0;
-    virtual size_t Deserialize(Entity* entity, const void* buffer)=0;
+    virtual void Serialize(const Entity* entity, MessageWriter& writer) const=0;
+    // A failed read leaves the reader invalid; the entity may be partly
+    // overwritten.
+    virtual void Deserialize(Entity* entity, MessageReader& reader) const=0;
 
 protected:
 
@@ -35,9 +38,8 @@ public:
     StructEntityType();
 
     virtual Entity* Create(int entityId);
-    virtual size_t GetSerializedSize(Entity* entity) const;
-    virtual size_t Serialize(const Entity* entity, void *buffer) const;
-    virtual size_t Deserialize(Entity* entity, const void* buffer);
+    virtual void Serialize(const Entity* entity, MessageWriter& writer) const;
+    virtual void Deserialize(Entity* entity, MessageReader& reader) const;
 
 
 };
@@ -56,24 +58,15 @@ Entity* StructEntityType<T>::Create(int entityId)
 }
 
 template<class T>
-size_t StructEntityType<T>::GetSerializedSize(Entity* entity) const
+void StructEntityType<T>::Serialize(const Entity* entity, MessageWriter& writer) const
 {
-    return sizeof(T);
+    static_cast<const T*>(entity)->Serialize(writer);
 }
 
 template<class T>
-size_t StructEntityType<T>::Serialize(const Entity* entity, void *buffer) const
+void StructEntityType<T>::Deserialize(Entity* entity, MessageReader& reader) const
 {
-    memcpy(buffer, entity, sizeof(T));
-    return sizeof(T);
-}
-
-template<class T>
-size_t StructEntityType<T>::Deserialize(Entity* entity, const void* buffer)
-{
-    memcpy(entity, buffer, sizeof(T));
-    return sizeof(T);
+    static_cast<T*>(entity)->Deserialize(reader);
 }
 
 #endif
-
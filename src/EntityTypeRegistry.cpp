@@ -1,4 +1,5 @@
 #include "EntityTypeRegistry.h"
+#include "EntityType.h"
 
 #include "AgentEntity.h"
 #include "BuildingEntity.h"
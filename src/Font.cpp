@@ -1,97 +1,145 @@
 #include "Font.h"
 #include "Texture.h"
+#include "TextureAtlas.h"
+#include "AssetLoader.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 /* The font we're currently drawing with */
 static const Font* g_font = NULL;
 
-int Font_Load(Font& font, const char* fileName)
+static void Font_ParseLine(Font& font, char* buffer, AssetLoader* loader, TextureAtlas* atlas)
 {
 
-    /* Font CSV files can be exporter with Codeheads Bitmap Font Generator */
+    char*   value;
+    int     charIndex;
+    int     matchLength;
+    size_t  lineLength;
 
-    FILE* file = fopen(fileName, "rt");
+    value = strchr(buffer, ',');
 
-    if (file == NULL)
+    lineLength = strlen(buffer);
+    while (lineLength > 0 && (buffer[lineLength - 1] == '\n' || buffer[lineLength - 1] == '\r'))
     {
-        return 0;
+        buffer[--lineLength] = 0;
     }
 
-    while (!feof(file))
+    if (value != NULL)
     {
+        
+        value[0] = 0;
+        ++value;
 
-        char    buffer[256];
-        char*   value;
-        int     charIndex;
-        int     matchLength;
-        size_t  lineLength;
-
-        fgets(buffer, sizeof(buffer), file);
-        value = strchr(buffer, ',');
-
-        lineLength = strlen(buffer);
-        if (lineLength > 0 && buffer[lineLength - 1] == '\n')
+        if (sscanf(buffer, "Char %d %n", &charIndex, &matchLength) == 1)
         {
-            buffer[lineLength - 1] = 0;
-        }
-
-        if (value != NULL)
-        {
-            
-            value[0] = 0;
-            ++value;
-
-            if (sscanf(buffer, "Char %d %n", &charIndex, &matchLength) == 1)
+            if (charIndex < 256)
             {
-                if (charIndex < 256)
+                if (strcmp(buffer + matchLength, "Base Width") == 0)
                 {
-                    if (strcmp(buffer + matchLength, "Base Width") == 0)
-                    {
-                        font.charWidth[charIndex] = atoi(value);
-                    }
+                    font.charWidth[charIndex] = atoi(value);
                 }
             }
-            if (strcmp(buffer, "Texture File") == 0)
-            {
-                Texture_Load(font.texture, value);
-            }
-            else if (strcmp(buffer, "Cell Width") == 0)
-            {
-                font.cellWidth = atoi(value);
-            }
-            else if (strcmp(buffer, "Cell Height") == 0)
-            {
-                font.cellHeight = atoi(value);
-            }
-            else if (strcmp(buffer, "Image Width") == 0)
-            {
-                font.imageWidth = atoi(value);
-            }
-            else if (strcmp(buffer, "Image Height") == 0)
+        }
+        if (strcmp(buffer, "Texture File") == 0)
+        {
+            if (loader != NULL)
             {
-                font.imageHeight = atoi(value);
+                loader->LoadTexture(font.texture, value, atlas);
             }
-            else if (strcmp(buffer, "Start Char") == 0)
+            else if (atlas != NULL)
             {
-                font.startChar = atoi(value);
+                atlas->Add(font.texture, value);
             }
-            else if (strcmp(buffer, "Font Height") == 0)
+            else
             {
-                font.fontHeight = atoi(value);
+                Texture_Load(font.texture, value);
             }
+        }
+        else if (strcmp(buffer, "Cell Width") == 0)
+        {
+            font.cellWidth = atoi(value);
+        }
+        else if (strcmp(buffer, "Cell Height") == 0)
+        {
+            font.cellHeight = atoi(value);
+        }
+        else if (strcmp(buffer, "Image Width") == 0)
+        {
+            font.imageWidth = atoi(value);
+        }
+        else if (strcmp(buffer, "Image Height") == 0)
+        {
+            font.imageHeight = atoi(value);
+        }
+        else if (strcmp(buffer, "Start Char") == 0)
+        {
+            font.startChar = atoi(value);
+        }
+        else if (strcmp(buffer, "Font Height") == 0)
+        {
+            font.fontHeight = atoi(value);
+        }
+
+    }
+
+}
+
+int Font_Load(Font& font, const char* fileName, AssetLoader* loader, TextureAtlas* atlas)
+{
+
+    /* Font CSV files can be exporter with Codeheads Bitmap Font Generator */
+
+    char        buffer[256];
+    const char* data = NULL;
+    size_t      dataSize = 0;
+
+    if (loader != NULL)
+    {
+        data = static_cast<const char*>(loader->LoadFile(fileName, dataSize));
+    }
+
+    if (data != NULL)
+    {
+
+        /* The file was packed into the asset archive */
+        const char* end = data + dataSize;
+        while (data < end)
+        {
+            const char* lineEnd = static_cast<const char*>(memchr(data, '\n', end - data));
+            size_t lineLength = (lineEnd != NULL ? lineEnd + 1 : end) - data;
+            size_t copyLength = lineLength < sizeof(buffer) - 1 ? lineLength : sizeof(buffer) - 1;
+            memcpy(buffer, data, copyLength);
+            buffer[copyLength] = 0;
+            data += lineLength;
+            Font_ParseLine(font, buffer, loader, atlas);
+        }
+
+    }
+    else
+    {
+
+        FILE* file = fopen(fileName, "rt");
 
+        if (file == NULL)
+        {
+            return 0;
         }
 
+        while (fgets(buffer, sizeof(buffer), file) != NULL)
+        {
+            Font_ParseLine(font, buffer, loader, atlas);
+        }
+
+        fclose(file);
+        file = NULL;
+
     }
 
     font.numRows = font.imageWidth  / font.cellWidth;
     font.numCols = font.imageHeight / font.cellHeight;
 
-    fclose(file);
-    file = NULL;
-
     return 1;
 
 }
@@ -136,28 +184,18 @@ int Font_DrawText(const char* text, int x, int y)
         }
     
         int     charIndex;
-        int     row, col;
         int     x1, y1, x2, y2;
         float   u1, v1, u2, v2;
         int     width;
 
         charIndex = (unsigned char)text[0];
-
-        row = (charIndex - g_font->startChar) / g_font->numCols;
-        col = (charIndex - g_font->startChar) % g_font->numCols;
-
-        width = g_font->charWidth[charIndex];
+        width = Font_GetGlyph(*g_font, charIndex, u1, v1, u2, v2);
 
         x1 = x;
         y1 = y;
         x2 = x + width;
         y2 = y + g_font->cellHeight;
 
-        u1 = (float)(col) / g_font->numCols;
-        v1 = (float)(row) / g_font->numRows;
-        u2 = u1 + (float)(width) / g_font->imageWidth;
-        v2 = v1 + 1.0f / g_font->numRows;
-
         glTexCoord2f(u1, v1);
         glVertex2i(x1, y1);
 
@@ -181,6 +219,30 @@ int Font_DrawText(const char* text, int x, int y)
 
 }
 
+int Font_GetGlyph(const Font& font, int charIndex, float& u1, float& v1, float& u2, float& v2)
+{
+
+    int row = (charIndex - font.startChar) / font.numCols;
+    int col = (charIndex - font.startChar) % font.numCols;
+    int width = font.charWidth[charIndex];
+
+    // Position in the font image, which may only be part of the texture if
+    // it was packed into an atlas.
+    float x1 = (float)(col) / font.numCols;
+    float y1 = (float)(row) / font.numRows;
+    float x2 = x1 + (float)(width) / font.imageWidth;
+    float y2 = y1 + 1.0f / font.numRows;
+
+    const Texture& texture = font.texture;
+    u1 = texture.u1 + x1 * (texture.u2 - texture.u1);
+    v1 = texture.v1 + y1 * (texture.v2 - texture.v1);
+    u2 = texture.u1 + x2 * (texture.u2 - texture.u1);
+    v2 = texture.v1 + y2 * (texture.v2 - texture.v1);
+
+    return width;
+
+}
+
 int Font_GetTextWidth(const Font& font, const char* text)
 {
 
@@ -3,6 +3,9 @@
 
 #include "Texture.h"
 
+class AssetLoader;
+class TextureAtlas;
+
 struct Font
 {
     Texture texture;
@@ -18,9 +21,12 @@ struct Font
 };
 
 /**
- * Loads a font file.
+ * Loads a font file. If a loader is given the font's image is queued on it
+ * and the font can't be drawn until the texture handle is set, and the file
+ * itself is read from the loader's archive if it's there. If an atlas is
+ * given the image is added to it.
  */
-int Font_Load(Font& font, const char* fileName);
+int Font_Load(Font& font, const char* fileName, AssetLoader* loader = NULL, TextureAtlas* atlas = NULL);
 
 /**
  * Begins drawing with the specified font.
@@ -37,6 +43,12 @@ void Font_EndDrawing();
  */
 int Font_DrawText(const char* text, int x, int y);
 
+/**
+ * Returns the width (in pixels) of a character, and stores the part of the
+ * font's texture holding it in u1, v1, u2, v2.
+ */
+int Font_GetGlyph(const Font& font, int charIndex, float& u1, float& v1, float& u2, float& v2);
+
 /**
  * Returns the width (in pixels) of the text when rendered.
  */
@@ -9,8 +9,6 @@
 #include <assert.h>
 #include <stdio.h>
 
-static const int kMaxClients = 32;
-
 struct Host::PrivateData
 {
 
@@ -46,15 +44,17 @@ Host::~Host()
     delete m_data;
 }
 
-void Host::Service(Handler* handler)
+void Host::Service(Handler* handler, int timeout)
 {
     
     if (m_data->m_host != NULL)
     {
 
         ENetEvent event;
-        while (enet_host_service(m_data->m_host, &event, 0) > 0)
+        while (enet_host_service(m_data->m_host, &event, timeout) > 0)
         {
+
+            timeout = 0;
     
             switch (event.type)
             {
@@ -107,7 +107,7 @@ void Host::Service(Handler* handler)
 
 }
 
-bool Host::SendPacket(int peerId, int channel, void* data, size_t size)
+bool Host::SendPacket(int peerId, int channel, const void* data, size_t size)
 {
 
     bool result = false;
@@ -132,7 +132,7 @@ bool Host::Listen(int port)
     address.host = ENET_HOST_ANY;
     address.port = port;
 
-    m_data->m_host = enet_host_create(&address, kMaxClients, m_numChannels, 0, 0);
+    m_data->m_host = enet_host_create(&address, s_maxPeers, m_numChannels, 0, 0);
 
     if (m_data->m_host == NULL)
     {
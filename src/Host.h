@@ -1,11 +1,16 @@
 #ifndef GAME_HOST_H
 #define GAME_HOST_H
 
+#include <stddef.h>
+
 class Host
 {
 
 public:
     
+    // Maximum number of peers that can be connected when listening.
+    static const int s_maxPeers = 32;
+
     class Handler
     {
     public:
@@ -17,8 +22,10 @@ public:
     Host(int numChannels);
     ~Host();
 
-    void Service(Handler* handler);
-    bool SendPacket(int peerId, int channel, void* data, size_t size);
+    // Dispatches pending events. Waits up to timeout milliseconds for the
+    // first event to arrive.
+    void Service(Handler* handler, int timeout=0);
+    bool SendPacket(int peerId, int channel, const void* data, size_t size);
 
     bool Listen(int port);
     bool Connect(const char* hostName, int port);
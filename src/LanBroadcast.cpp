@@ -1,12 +1,33 @@
 #include "LanBroadcast.h"
+#include "Message.h"
+#include "Socket.h"
+#include "Log.h"
 
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include <SDL.h>
+
+#include <string.h>
+
+// Time between beacons in each mode (in milliseconds).
+static const unsigned int kBroadcastInterval    = 1000;
+static const unsigned int kFallbackInterval     = 10000;
+
+// Responses are delayed by a random amount up to this so that every server
+// on the LAN doesn't answer a query at the same instant.
+static const int kMaxResponseJitter             = 100;
+
+// Limits how many responses are sent, however many queries arrive.
+static const float kResponsesPerSecond          = 20.0f;
+static const float kMaxResponseBurst            = 20.0f;
 
 LanBroadcast::LanBroadcast()
 {
     m_socket = INVALID_SOCKET;
+    m_querySocket = INVALID_SOCKET;
     m_serverName[0] = 0;
+    m_beaconInterval = kBroadcastInterval;
+    m_nextBeaconTime = 0;
+    m_responseTokens = kMaxResponseBurst;
+    m_lastTokenTime = 0;
 }
 
 LanBroadcast::~LanBroadcast()
@@ -14,29 +35,62 @@ LanBroadcast::~LanBroadcast()
     Shutdown();
 }
 
-bool LanBroadcast::Initialize(int port, int gamePort)
+bool LanBroadcast::Initialize(int port, int gamePort, Mode mode)
 {
 
     m_port = port;
     m_gamePort = gamePort;
+    m_beaconInterval = (mode == Mode_Query) ? kFallbackInterval : kBroadcastInterval;
+    m_nextBeaconTime = SDL_GetTicks();
+    m_lastTokenTime = SDL_GetTicks();
+    m_random.Seed(SDL_GetTicks() + gamePort);
 
     m_socket = (int)socket(AF_INET,SOCK_DGRAM, 0);
-    if (m_socket == -1)
+    if (m_socket == INVALID_SOCKET)
     {
         return false;
     }
 
     static int so_broadcast = 1;
-    if (setsockopt(m_socket, SOL_SOCKET, SO_BROADCAST, (const char*)&so_broadcast, sizeof(so_broadcast)) == -1)
+    if (setsockopt(m_socket, SOL_SOCKET, SO_BROADCAST, (const char*)&so_broadcast, sizeof(so_broadcast)) == SOCKET_ERROR)
     {
         return false;
     }
 
-#ifdef WIN32
-    DWORD length = sizeof(m_serverName) - 1;
-    m_serverName[0] = 0;
-    GetComputerNameA(m_serverName, &length);
-#endif
+    Socket_GetComputerName(m_serverName, sizeof(m_serverName));
+
+    // Several servers can run on one machine, so they all share the query
+    // port.
+    m_querySocket = (int)socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_querySocket == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    int so_reuseaddr = 1;
+    setsockopt(m_querySocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&so_reuseaddr, sizeof(so_reuseaddr));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_port            = htons(Protocol::queryPort);
+    address.sin_family          = AF_INET;
+    address.sin_addr.s_addr     = htonl(INADDR_ANY);
+
+    if (bind(m_querySocket, (const sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+    {
+        LogError("Couldn't bind the discovery query port");
+        Socket_Close(m_querySocket);
+        m_querySocket = INVALID_SOCKET;
+        return true;
+    }
+
+    ip_mreq membership;
+    membership.imr_multiaddr.s_addr = inet_addr(Protocol::queryGroup);
+    membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(m_querySocket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) == SOCKET_ERROR)
+    {
+        LogError("Couldn't join the discovery multicast group");
+    }
 
     return true;
 }
@@ -45,25 +99,150 @@ void LanBroadcast::Shutdown()
 {
     if (m_socket != INVALID_SOCKET)
     {
-        shutdown(m_socket, SD_SEND);
-        closesocket(m_socket);
+        Socket_Close(m_socket);
         m_socket = INVALID_SOCKET;
     }
+    if (m_querySocket != INVALID_SOCKET)
+    {
+        Socket_Close(m_querySocket);
+        m_querySocket = INVALID_SOCKET;
+    }
+    m_pendingResponses.clear();
+}
+
+void LanBroadcast::Update(const Protocol::ServerInfoPacket& info)
+{
+
+    if (m_socket == INVALID_SOCKET)
+    {
+        return;
+    }
+
+    unsigned int time = SDL_GetTicks();
+
+    ReceiveQueries(time);
+
+    // Send the responses that are due.
+    size_t numPending = 0;
+    for (size_t i = 0; i < m_pendingResponses.size(); ++i)
+    {
+        const PendingResponse& response = m_pendingResponses[i];
+        if (static_cast<int>(time - response.sendTime) >= 0)
+        {
+            Protocol::ServerInfoPacket packet = info;
+            packet.queryTime = response.queryTime;
+            Send(packet, Protocol::DiscoveryType_Response, response.ip, response.port);
+        }
+        else
+        {
+            m_pendingResponses[numPending++] = response;
+        }
+    }
+    m_pendingResponses.resize(numPending);
+
+    if (static_cast<int>(time - m_nextBeaconTime) >= 0)
+    {
+        Protocol::ServerInfoPacket packet = info;
+        packet.queryTime = 0;
+        Send(packet, Protocol::DiscoveryType_Beacon, INADDR_BROADCAST, m_port);
+
+        // Vary the interval a little so servers started together don't stay
+        // in step.
+        m_nextBeaconTime = time + m_beaconInterval + m_random.Generate(0, m_beaconInterval / 10);
+    }
+
+}
+
+void LanBroadcast::ReceiveQueries(unsigned int time)
+{
+
+    if (m_querySocket == INVALID_SOCKET)
+    {
+        return;
+    }
+
+    m_responseTokens += (time - m_lastTokenTime) * kResponsesPerSecond / 1000.0f;
+    if (m_responseTokens > kMaxResponseBurst)
+    {
+        m_responseTokens = kMaxResponseBurst;
+    }
+    m_lastTokenTime = time;
+
+    while (Socket_GetIsReadable(m_querySocket))
+    {
+
+        sockaddr_in address;
+        socklen_t addressSize = sizeof(address);
+
+        char buffer[256];
+        int result = recvfrom(m_querySocket, buffer, sizeof(buffer), 0,
+            (sockaddr*)&address, &addressSize);
+
+        if (result == SOCKET_ERROR)
+        {
+            break;
+        }
+
+        MessageReader reader(buffer, result);
+        Protocol::DiscoveryType type;
+        Protocol::ServerQueryPacket query;
+        if (!Protocol::ReadDiscoveryHeader(reader, type) || type != Protocol::DiscoveryType_Query ||
+            !Protocol::Read(reader, query))
+        {
+            continue;
+        }
+
+        unsigned long ip = ntohl(address.sin_addr.s_addr);
+        int port = ntohs(address.sin_port);
+
+        // A client that asks again before we've answered gets one response.
+        bool duplicate = false;
+        for (size_t i = 0; i < m_pendingResponses.size(); ++i)
+        {
+            if (m_pendingResponses[i].ip == ip && m_pendingResponses[i].port == port)
+            {
+                m_pendingResponses[i].queryTime = query.queryTime;
+                duplicate = true;
+                break;
+            }
+        }
+
+        if (duplicate || m_responseTokens < 1.0f)
+        {
+            continue;
+        }
+        m_responseTokens -= 1.0f;
+
+        PendingResponse response;
+        response.ip         = ip;
+        response.port       = port;
+        response.queryTime  = query.queryTime;
+        response.sendTime   = time + m_random.Generate(0, kMaxResponseJitter);
+        m_pendingResponses.push_back(response);
+
+    }
+
 }
-bool LanBroadcast::BroadcastInfo()
+
+bool LanBroadcast::Send(const Protocol::ServerInfoPacket& info, Protocol::DiscoveryType type, unsigned long ip, int port)
 {
 
-    char packet[ sizeof(long) + sizeof(m_serverName) ];
+    Protocol::ServerInfoPacket packet = info;
+    memcpy(packet.name, m_serverName, sizeof(packet.name));
+    packet.gamePort = m_gamePort;
+    packet.beaconInterval = m_beaconInterval;
 
-    *((long*)packet) = m_gamePort;
-    memcpy(packet + sizeof(long), m_serverName, sizeof(m_serverName));
+    MessageWriter writer;
+    Protocol::WriteDiscoveryHeader(writer, type);
+    Protocol::Write(writer, packet);
 
     sockaddr_in address;
-    address.sin_port            = htons(m_port);
+    memset(&address, 0, sizeof(address));
+    address.sin_port            = htons(port);
     address.sin_family          = AF_INET;
-    address.sin_addr.s_addr     = INADDR_BROADCAST;
+    address.sin_addr.s_addr     = htonl(ip);
 
-    int result = sendto(m_socket, packet, sizeof(packet),
+    int result = sendto(m_socket, (const char*)writer.GetData(), (int)writer.GetSize(),
         0, (const sockaddr*)&address, sizeof(address));
     return result != SOCKET_ERROR;
 
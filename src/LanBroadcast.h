@@ -1,26 +1,61 @@
 #ifndef GAME_LAN_BROADCAST_H
 #define GAME_LAN_BROADCAST_H
 
+#include "Protocol.h"
+#include "Random.h"
+
+#include <vector>
+
 class LanBroadcast
 {
 
 public:
 
+    enum Mode
+    {
+        Mode_Broadcast,     // Beacon every second
+        Mode_Query,         // Answer queries, with an infrequent beacon as a fallback
+    };
+
     LanBroadcast();
     ~LanBroadcast();
 
-    bool Initialize(int port, int gamePort);
+    bool Initialize(int port, int gamePort, Mode mode);
     void Shutdown();
 
-    bool BroadcastInfo();
+    // Answers discovery queries and sends the beacon when it's due. The name,
+    // game port and timing fields of the info are filled in here.
+    void Update(const Protocol::ServerInfoPacket& info);
 
 private:
 
-    int             m_socket;
-    char            m_serverName[64];
-    int             m_port;
-    int             m_gamePort;
+    struct PendingResponse
+    {
+        unsigned long   ip;
+        int             port;
+        unsigned int    queryTime;
+        unsigned int    sendTime;
+    };
+
+    typedef std::vector<PendingResponse> PendingResponseList;
+
+    void ReceiveQueries(unsigned int time);
+    bool Send(const Protocol::ServerInfoPacket& info, Protocol::DiscoveryType type, unsigned long ip, int port);
+
+    int                 m_socket;
+    int                 m_querySocket;
+    char                m_serverName[Protocol::maxServerName];
+    int                 m_port;
+    int                 m_gamePort;
+
+    Random              m_random;
+    unsigned int        m_beaconInterval;
+    unsigned int        m_nextBeaconTime;
+
+    PendingResponseList m_pendingResponses;
+    float               m_responseTokens;
+    unsigned int        m_lastTokenTime;
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,13 +1,62 @@
 #include "LanListener.h"
+#include "Message.h"
+#include "Socket.h"
 
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include <SDL.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+static void SetServerInfo(LanListener::Server& server, const Protocol::ServerInfoPacket& info)
+{
+    memcpy(server.name, info.name, sizeof(server.name));
+    server.port             = info.gamePort;
+    server.numPlayers       = info.numPlayers;
+    server.maxPlayers       = info.maxPlayers;
+    server.mapSeed          = info.mapSeed;
+    server.tickOverrunRate  = info.tickOverrunRate;
+    server.load             = info.load;
+
+    // Servers that beacon infrequently are kept around for a couple of their
+    // intervals, so a lost datagram doesn't drop them from the list.
+    server.timeout = 2 * info.beaconInterval + 1000;
+    if (server.timeout < LanListener::s_serverTimeout)
+    {
+        server.timeout = LanListener::s_serverTimeout;
+    }
+}
+
+static unsigned int HashAddress(unsigned long ip, int port)
+{
+    unsigned int hash = static_cast<unsigned int>(ip) * 0x9E3779B1u;
+    hash ^= static_cast<unsigned int>(port) * 0x85EBCA6Bu;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static bool CompareLoad(const LanListener::Server* a, const LanListener::Server* b)
+{
+    return a->load < b->load;
+}
+
+static bool ComparePing(const LanListener::Server* a, const LanListener::Server* b)
+{
+    // Unknown pings go last.
+    if (a->ping == -1 || b->ping == -1)
+    {
+        return a->ping != -1 && b->ping == -1;
+    }
+    return a->ping < b->ping;
+}
 
 LanListener::LanListener()
 {
-    m_numServers    = 0;
     m_port          = 0;
     m_socket        = INVALID_SOCKET;
+    m_nextQueryTime = 0;
+    m_numQueriesLeft = 0;
+    m_slotMask      = 0;
 }
 
 LanListener::~LanListener()
@@ -19,33 +68,46 @@ bool LanListener::Initialize(int port)
 {
     m_port  = port;
     m_socket = (int)socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket == INVALID_SOCKET)
+    {
+        return false;
+    }
+
+    // This has to be set before binding so several clients on the same
+    // machine can listen on the port.
+    int so_reuseaddr = 1;
+    if (setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&so_reuseaddr, sizeof(so_reuseaddr)) == SOCKET_ERROR)
+    {
+        Shutdown();
+        return false;
+    }
 
     sockaddr_in address;
+    memset(&address, 0, sizeof(address));
     address.sin_port                = htons(m_port);
     address.sin_family              = AF_INET;
-    address.sin_addr.s_addr         = INADDR_ANY;
+    address.sin_addr.s_addr         = htonl(INADDR_ANY);
 
-    if (bind(m_socket, (struct sockaddr*)&address, sizeof(address)) == -1)
+    if (bind(m_socket, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
     {
+        Shutdown();
         return false;
     }
 
-    int so_reuseaddr = 1;
-    if (setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&so_reuseaddr, sizeof(so_reuseaddr)) == -1)
-    {
-        return false;
-    }
+    // Query straight away so the list fills in without waiting for beacons.
+    Refresh();
 
     return true;
 }
 
 void LanListener::Shutdown()
 {
-    m_numServers = 0;
+    m_servers.clear();
+    m_slots.clear();
+    m_slotMask = 0;
     if (m_socket != INVALID_SOCKET)
     {
-        shutdown(m_socket, SD_SEND);
-        closesocket(m_socket);
+        Socket_Close(m_socket);
         m_socket = INVALID_SOCKET;
     }
 }
@@ -53,74 +115,238 @@ void LanListener::Shutdown()
 void LanListener::Service()
 {
 
-    time_t currentTime = time(NULL);
+    unsigned int currentTime = SDL_GetTicks();
 
     RemoveOldServers(currentTime);
 
-    fd_set readSet;
-    FD_ZERO(&readSet);
-    FD_SET(m_socket, &readSet);
-
-    timeval timeVal;
-    timeVal.tv_sec = 0;
-    timeVal.tv_usec = 0;
+    if (m_socket == INVALID_SOCKET)
+    {
+        return;
+    }
 
-    int result = select(0, &readSet, NULL, NULL, &timeVal);
+    if (m_numQueriesLeft > 0 && static_cast<int>(currentTime - m_nextQueryTime) >= 0)
+    {
+        SendQuery(currentTime);
+        m_nextQueryTime = currentTime + s_queryRetryInterval;
+        --m_numQueriesLeft;
+    }
 
-    if (result > 0)
+    // Read all of the beacons and responses that have arrived since the last
+    // update.
+    while (Socket_GetIsReadable(m_socket))
     {
+
         sockaddr_in address;
-        int addressSize = sizeof(address);
+        socklen_t addressSize = sizeof(address);
 
         char buffer[1024];
-        result = recvfrom(m_socket, static_cast<char*>(buffer), sizeof(buffer), 0,
+        int result = recvfrom(m_socket, buffer, sizeof(buffer), 0,
             (sockaddr*)&address, &addressSize);
 
-        unsigned long ip   = ntohl(address.sin_addr.S_un.S_addr);
-        int           port = *((long*)buffer);
+        if (result == SOCKET_ERROR)
+        {
+            break;
+        }
 
-        AddServer(buffer + sizeof(long), ip, port, currentTime);
+        MessageReader reader(buffer, result);
+        Protocol::DiscoveryType type;
+        Protocol::ServerInfoPacket info;
+        if (!Protocol::ReadDiscoveryHeader(reader, type) || !Protocol::Read(reader, info))
+        {
+            continue;
+        }
+
+        // Only responses carry our query time, so beacons leave the ping as
+        // it was.
+        int ping = -1;
+        if (type == Protocol::DiscoveryType_Response)
+        {
+            ping = static_cast<int>(currentTime - info.queryTime);
+        }
+        else if (type != Protocol::DiscoveryType_Beacon)
+        {
+            continue;
+        }
+
+        unsigned long ip = ntohl(address.sin_addr.s_addr);
+        AddServer(info, ip, currentTime, ping);
 
     }
 
 }
 
-void LanListener::AddServer(const char* name, unsigned long ip, int port, time_t time)
+void LanListener::Refresh()
 {
+    m_nextQueryTime  = SDL_GetTicks();
+    m_numQueriesLeft = s_numQueries;
+}
+
+void LanListener::GetSortedServers(SortMode sortMode, std::vector<const Server*>& servers) const
+{
+
+    servers.resize(m_servers.size());
+    for (size_t i = 0; i < m_servers.size(); ++i)
+    {
+        servers[i] = &m_servers[i];
+    }
 
-    // Check if this server is already in our list.
-    for (int i = 0; i < m_numServers; ++i)
+    switch (sortMode)
     {
-        if (m_server[i].ip == ip)
+    case SortMode_Load:
+        std::stable_sort(servers.begin(), servers.end(), CompareLoad);
+        break;
+    case SortMode_Ping:
+        std::stable_sort(servers.begin(), servers.end(), ComparePing);
+        break;
+    default:
+        // Left in the order they were found.
+        break;
+    }
+
+}
+
+void LanListener::SendQuery(unsigned int time)
+{
+
+    Protocol::ServerQueryPacket query;
+    query.queryTime = time;
+
+    MessageWriter writer;
+    Protocol::WriteDiscoveryHeader(writer, Protocol::DiscoveryType_Query);
+    Protocol::Write(writer, query);
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_port                = htons(Protocol::queryPort);
+    address.sin_family              = AF_INET;
+    address.sin_addr.s_addr         = inet_addr(Protocol::queryGroup);
+
+    // Responses come back to this socket, so they're read with the beacons.
+    sendto(m_socket, (const char*)writer.GetData(), (int)writer.GetSize(),
+        0, (const sockaddr*)&address, sizeof(address));
+
+}
+
+void LanListener::AddServer(const Protocol::ServerInfoPacket& info, unsigned long ip, unsigned int time, int ping)
+{
+
+    // Keep the table at most half full so probe sequences stay short.
+    if ((m_servers.size() + 1) * 2 > m_slots.size())
+    {
+        GrowSlots();
+    }
+
+    int slot = FindSlot(ip, info.gamePort);
+    if (m_slots[slot] == -1)
+    {
+        Server server;
+        server.ip   = ip;
+        server.ping = -1;
+        m_servers.push_back(server);
+        m_slots[slot] = static_cast<int>(m_servers.size()) - 1;
+    }
+
+    Server& server = m_servers[m_slots[slot]];
+    server.time = time;
+    if (ping >= 0)
+    {
+        server.ping = ping;
+    }
+    SetServerInfo(server, info);
+
+}
+
+void LanListener::RemoveOldServers(unsigned int time)
+{
+
+    size_t i = 0;
+    while (i < m_servers.size())
+    {
+
+        if (time - m_servers[i].time <= m_servers[i].timeout)
         {
-            m_server[i].port = port;
-            m_server[i].time = time;
-            strncpy(m_server[i].name, name, s_maxServerName);
-            return;
+            ++i;
+            continue;
         }
+
+        RemoveSlot(FindSlot(m_servers[i].ip, m_servers[i].port));
+
+        // Fill the gap with the last server so the list stays packed.
+        size_t last = m_servers.size() - 1;
+        if (i != last)
+        {
+            m_servers[i] = m_servers[last];
+            m_slots[FindSlot(m_servers[i].ip, m_servers[i].port)] = static_cast<int>(i);
+        }
+        m_servers.pop_back();
+
     }
 
-    // Add a new server.
-    if (m_numServers < s_maxServers)
+}
+
+int LanListener::FindSlot(unsigned long ip, int port) const
+{
+
+    unsigned int slot = HashAddress(ip, port) & m_slotMask;
+    while (m_slots[slot] != -1)
     {
-        m_server[m_numServers].ip   = ip;
-        m_server[m_numServers].port = port;
-        m_server[m_numServers].time = time;
-        strncpy(m_server[m_numServers].name, name, s_maxServerName);
-        ++m_numServers;
+        const Server& server = m_servers[m_slots[slot]];
+        if (server.ip == ip && server.port == port)
+        {
+            break;
+        }
+        slot = (slot + 1) & m_slotMask;
     }
 
+    return static_cast<int>(slot);
+
 }
 
-void LanListener::RemoveOldServers(time_t time)
+void LanListener::InsertSlot(int serverIndex)
 {
-    for (int i = 0; i < m_numServers; ++i)
+    const Server& server = m_servers[serverIndex];
+    m_slots[FindSlot(server.ip, server.port)] = serverIndex;
+}
+
+void LanListener::RemoveSlot(int slot)
+{
+
+    // Shift the following entries back rather than leaving a tombstone, so
+    // lookups never have to skip over removed servers.
+    unsigned int hole = static_cast<unsigned int>(slot);
+    unsigned int next = (hole + 1) & m_slotMask;
+
+    while (m_slots[next] != -1)
     {
-        if (time - m_server[i].time > s_serverTimeout)
+        const Server& server = m_servers[m_slots[next]];
+        unsigned int home = HashAddress(server.ip, server.port) & m_slotMask;
+
+        // The entry can only move back if that doesn't put it before its
+        // home slot.
+        if (((next - home) & m_slotMask) >= ((next - hole) & m_slotMask))
         {
-            --m_numServers;
-            m_server[i] = m_server[m_numServers];
-            --i;
+            m_slots[hole] = m_slots[next];
+            hole = next;
         }
+
+        next = (next + 1) & m_slotMask;
+    }
+
+    m_slots[hole] = -1;
+
+}
+
+void LanListener::GrowSlots()
+{
+
+    size_t numSlots = m_slots.empty() ? 16 : m_slots.size() * 2;
+
+    m_slots.assign(numSlots, -1);
+    m_slotMask = static_cast<unsigned int>(numSlots - 1);
+
+    for (size_t i = 0; i < m_servers.size(); ++i)
+    {
+        InsertSlot(static_cast<int>(i));
     }
-}
\ No newline at end of file
+
+}
@@ -1,23 +1,41 @@
 #ifndef GAME_LAN_LISTENER_H
 #define GAME_LAN_LISTENER_H
 
-#include <time.h>
+#include "Protocol.h"
+
+#include <vector>
 
 class LanListener
 {
 
 public:
 
-    static const int    s_maxServerName = 64;
-    static const int    s_maxServers    = 64;
-    static const time_t s_serverTimeout = 4;
+    static const int            s_maxServerName         = Protocol::maxServerName;
+    static const unsigned int   s_serverTimeout         = 4000; // milliseconds
+    static const unsigned int   s_queryRetryInterval    = 250;  // milliseconds
+    static const int            s_numQueries            = 3;    // Sent per refresh, in case some are lost
 
     struct Server
     {
         char            name[s_maxServerName];
         unsigned long   ip;
         int             port;
-        time_t          time;
+        unsigned int    time;               // SDL_GetTicks when last heard from
+        unsigned int    timeout;            // Removed if not heard from for this long
+        int             ping;               // milliseconds, or -1 if unknown
+        int             numPlayers;
+        int             maxPlayers;
+        int             mapSeed;
+        float           tickOverrunRate;
+        float           load;
+    };
+
+    enum SortMode
+    {
+        SortMode_None,
+        SortMode_Load,
+        SortMode_Ping,
+        SortMode_Count,
     };
 
     LanListener();
@@ -28,22 +46,42 @@ public:
 
     void Service();
 
-    int GetNumServers() const { return m_numServers; }
-    const Server& GetServer(int i) const { return m_server[i]; }
+    // Asks the servers on the network to respond straight away. Otherwise
+    // servers are only found from their beacons.
+    void Refresh();
+
+    int GetNumServers() const { return static_cast<int>(m_servers.size()); }
+    const Server& GetServer(int i) const { return m_servers[i]; }
+
+    // Returns the servers in the requested order. Servers with an unknown
+    // ping are placed last when sorting by ping.
+    void GetSortedServers(SortMode sortMode, std::vector<const Server*>& servers) const;
 
 private:
 
-    void AddServer(const char* name, unsigned long ip, int port, time_t time);
-    void RemoveOldServers(time_t time);
+    void SendQuery(unsigned int time);
+    void AddServer(const Protocol::ServerInfoPacket& info, unsigned long ip, unsigned int time, int ping);
+    void RemoveOldServers(unsigned int time);
+
+    // Open addressing hash table from ip:port to an index in m_servers.
+    int  FindSlot(unsigned long ip, int port) const;
+    void InsertSlot(int serverIndex);
+    void RemoveSlot(int slot);
+    void GrowSlots();
 
 private:
 
-    int             m_port;
-    int             m_socket;
+    typedef std::vector<Server> ServerList;
+
+    int                 m_port;
+    int                 m_socket;
+    unsigned int        m_nextQueryTime;
+    int                 m_numQueriesLeft;
 
-    int             m_numServers;
-    Server          m_server[s_maxServers];
+    ServerList          m_servers;
+    std::vector<int>    m_slots;            // Index into m_servers, or -1 if empty
+    unsigned int        m_slotMask;
 
 };
 
-#endif
\ No newline at end of file
+#endif
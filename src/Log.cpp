@@ -1,6 +1,8 @@
 #include "Log.h"
 
+#ifdef WIN32
 #include <Windows.h>
+#endif
 
 #include <stdio.h>
 
@@ -17,6 +19,7 @@ static void Output(Severity severity, const char* text)
     const char* kSeverityTags[] = { "[DEBUG] ", NULL, "[ERROR] " };
     const char* tag = kSeverityTags[severity];
 
+#ifdef WIN32
     if (tag != NULL)
     {
         OutputDebugStringA(tag);
@@ -24,6 +27,9 @@ static void Output(Severity severity, const char* text)
 
     OutputDebugStringA(text);
     OutputDebugStringA("\n");
+#else
+    fprintf(stderr, "%s%s\n", tag != NULL ? tag : "", text);
+#endif
     
 }
 
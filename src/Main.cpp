@@ -3,13 +3,20 @@
 #include "ClientGame.h"
 #include "Server.h"
 #include "Log.h"
+#include "Benchmark.h"
+#include "PathTable.h"
+#include "Timer.h"
 
 #include <SDL.h>
 #include <SDL_syswm.h>
 #include <bass.h>
 
+#include <signal.h>
 #include <string>
-#include <hash_map>
+#include <map>
+
+// Set by a signal to stop the dedicated server.
+static volatile sig_atomic_t g_quitServer = 0;
 
 bool ProcessEvents(ClientGame& game)
 {
@@ -63,7 +70,7 @@ bool ProcessEvents(ClientGame& game)
 
 }
 
-typedef stdext::hash_map<std::string, std::string> Arguments;
+typedef std::map<std::string, std::string> Arguments;
 
 bool ParseArguments(int argc, char* argv[], Arguments& arguments)
 {
@@ -111,15 +118,61 @@ const char* GetArgument(const Arguments& arguments, const char* key)
 
 }
 
+// Runs a server without a window, for machines that only host games.
+static void OnQuitSignal(int)
+{
+    g_quitServer = 1;
+}
+
+int RunDedicatedServer(LanBroadcast::Mode discoveryMode, float railSpeed)
+{
+
+    if (SDL_Init(SDL_INIT_TIMER) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    LogMessage("Running dedicated server");
+
+    Server* server = new Server(discoveryMode, railSpeed);
+
+    // Ctrl+C or a kill shuts the server down cleanly rather than ending the
+    // process where it stands.
+    signal(SIGINT,  OnQuitSignal);
+    signal(SIGTERM, OnQuitSignal);
+
+    Uint32 lastTime = SDL_GetTicks();
+
+    while (!g_quitServer)
+    {
+        Uint32 time = SDL_GetTicks();
+        Uint32 deltaTime = time - lastTime;
+        lastTime = time;
+
+        server->Update(static_cast<float>(deltaTime) / 1000.0f);
+        SDL_Delay(1);
+    }
+
+    LogMessage("Shutting down the server");
+
+    delete server;
+    SDL_Quit();
+
+    return EXIT_SUCCESS;
+
+}
+
 int main(int argc, char* argv[])
 {
 
-    _putenv("SDL_VIDEO_WINDOW_POS");
-    _putenv("SDL_VIDEO_CENTERED=1");
+    SDL_putenv(const_cast<char*>("SDL_VIDEO_WINDOW_POS"));
+    SDL_putenv(const_cast<char*>("SDL_VIDEO_CENTERED=1"));
 
     const int xSize = 1280;
     const int ySize = 800;
 
+    double startTime = Timer_GetTime();
+
     Log::Initialize(Log::Severity_Debug);
     LogMessage("Initializing the grid...");
 
@@ -129,8 +182,52 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
+    // Maps with more stops than this route with searches instead of a
+    // precomputed table.
+    const char* pathTable = GetArgument(arguments, "pathtable");
+    if (pathTable != NULL)
+    {
+        PathTable::SetMaxStops(atoi(pathTable));
+    }
+
+    const char* benchmark = GetArgument(arguments, "benchmark");
+    if (benchmark != NULL && strcmp(benchmark, "on") == 0)
+    {
+        return Benchmark_Run();
+    }
+
     Host::Initialize();
 
+    // Servers on a busy LAN can answer queries instead of broadcasting every
+    // second.
+    LanBroadcast::Mode discoveryMode = LanBroadcast::Mode_Broadcast;
+    const char* discovery = GetArgument(arguments, "discovery");
+    if (discovery != NULL && strcmp(discovery, "query") == 0)
+    {
+        discoveryMode = LanBroadcast::Mode_Query;
+    }
+
+    // Time travel by rail length (in world units per second) instead of
+    // taking the same time for every hop.
+    float railSpeed = 0.0f;
+    const char* railSpeedArgument = GetArgument(arguments, "railspeed");
+    if (railSpeedArgument != NULL)
+    {
+        railSpeed = static_cast<float>(atof(railSpeedArgument));
+        if (railSpeed < 0.0f)
+        {
+            railSpeed = 0.0f;
+        }
+    }
+
+    const char* dedicated = GetArgument(arguments, "dedicated");
+    if (dedicated != NULL && strcmp(dedicated, "on") == 0)
+    {
+        int result = RunDedicatedServer(discoveryMode, railSpeed);
+        Host::Shutdown();
+        return result;
+    }
+
     if ( SDL_Init(SDL_INIT_AUDIO|SDL_INIT_VIDEO) < 0 )
     {
         exit(EXIT_FAILURE);
@@ -172,7 +269,11 @@ int main(int argc, char* argv[])
         exit(EXIT_FAILURE);
     }
 
+#ifdef WIN32
     BASS_Init(-1, 44100, 0, sysInfo.window, NULL);
+#else
+    BASS_Init(-1, 44100, 0, 0, NULL);
+#endif
 
     const char* hostName = "127.0.0.1";
 
@@ -188,12 +289,31 @@ int main(int argc, char* argv[])
     }
 
 
-    ClientGame* game = new ClientGame(xSize, ySize, strcmp(music, "on") == 0);
+    ClientGame* game = new ClientGame(xSize, ySize, strcmp(music, "on") == 0, discoveryMode, railSpeed);
+
+    // Bakes the assets into a single archive for faster start up.
+    const char* pack = GetArgument(arguments, "pack");
+    if (pack != NULL && strcmp(pack, "on") == 0)
+    {
+        bool packed = game->PackResources();
+        delete game;
+        Host::Shutdown();
+        Log::Shutdown();
+        BASS_Free();
+        return packed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const char* prediction = GetArgument(arguments, "prediction");
+    if (prediction != NULL && strcmp(prediction, "on") == 0)
+    {
+        game->SetShowPredictionOverlay(true);
+    }
 
     game->LoadResources();
     game->Connect(hostName, 12345);
 
     Uint32 lastTime = SDL_GetTicks();
+    bool firstFrame = true;
 
     while (ProcessEvents(*game))
     {
@@ -207,6 +327,12 @@ int main(int argc, char* argv[])
         game->Render();
         SDL_GL_SwapBuffers();
 
+        if (firstFrame)
+        {
+            LogMessage("First frame after %.0f ms", (Timer_GetTime() - startTime) * 1000.0);
+            firstFrame = false;
+        }
+
     }
 
     delete game;
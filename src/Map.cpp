@@ -14,6 +14,13 @@ const float pi = 3.1415926535f;
 const int   _minTerminalDist = 20;
 const float _stopMergeDistance = 25.0f;
 
+// Terminals are placed one per tile of this size.
+const int   _terminalSpacing = 150;
+
+// Size of the cells in the stop grid. Merging is the most common query, so
+// this keeps it to a few cells.
+const float _gridCellSize = 50.0f;
+
 const unsigned long kLineColor[] = 
 {
     //0xFF231F20,
@@ -29,6 +36,65 @@ const unsigned long kLineColor[] =
 
 const int kNumLines = sizeof(kLineColor) / sizeof(unsigned long);
 
+// Identifies saved maps. The version must be increased whenever the layout
+// or the generator changes so that stale cached maps are thrown away.
+const unsigned int kMapFileMagic    = 0x50414D47; // "GMAP"
+const unsigned int kMapFileVersion  = 2;
+
+// Saved maps are written in the native byte order and every array starts on
+// a four byte boundary so it can be used in place. The hash covers
+// everything after the header.
+struct MapFileHeader
+{
+    unsigned int    magic;
+    unsigned int    version;
+    unsigned int    hash;
+    int             xSize;
+    int             ySize;
+    int             seed;
+    int             numStops;
+    int             numRails;
+    int             numRiverVertices;
+    int             xNumCells;
+    int             yNumCells;
+};
+
+const unsigned int kHashBasis = 2166136261u;
+
+// FNV-1a over 32-bit words rather than bytes, since large maps hash tens of
+// megabytes. A partial last word is padded with zeros, which matches the
+// padding in saved maps.
+static unsigned int HashWords(unsigned int hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    size_t numWords = size / 4;
+    for (size_t i = 0; i < numWords; ++i)
+    {
+        unsigned int word;
+        memcpy(&word, bytes + i * 4, 4);
+        hash = (hash ^ word) * 16777619u;
+    }
+    if (size % 4 != 0)
+    {
+        unsigned int word = 0;
+        memcpy(&word, bytes + numWords * 4, size % 4);
+        hash = (hash ^ word) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t GetPaddedSize(size_t size)
+{
+    return (size + 3) & ~static_cast<size_t>(3);
+}
+
+template <class T>
+static void GetArraySection(std::vector<T>& array, void*& data, size_t& size)
+{
+    data = array.empty() ? NULL : &array[0];
+    size = array.size() * sizeof(T);
+}
+
 
 bool GetLineLineIntersection(const Vec2& p1, const Vec2& p2, const Vec2& p3, const Vec2& p4, float& ua, float& ub, Vec2& result)
 {
@@ -67,54 +133,122 @@ bool GetLineSegmentLineSegmentIntersection(const Vec2& p1, const Vec2& p2, const
 }
 
 
+MapParams::MapParams()
+{
+    numLines        = 7;
+    lineLength      = 20;
+    edgeTerminals   = true;
+    numRings        = 1;
+    ringSpacing     = 1.0f;
+    joinComponents  = false;
+    numBanks        = 2;
+    numPolice       = 3;
+    numTowers       = 4;
+}
+
+MapParams MapParams::GetLargeCity(int xSize, int ySize)
+{
+
+    int xNumTiles = Max(1, xSize / _terminalSpacing);
+    int yNumTiles = Max(1, ySize / _terminalSpacing);
+    int numTiles  = xNumTiles * yNumTiles;
+
+    // The default map is 9x6 tiles. Lines start anywhere in the city, and
+    // there are enough of them that they cross each other often.
+    const int defaultNumTiles = 54;
+
+    MapParams params;
+    params.numLines         = Max(params.numLines, numTiles / 4);
+    params.lineLength       = 30;
+    params.edgeTerminals    = false;
+    params.joinComponents   = true;
+
+    // Rings are spaced out so they don't merge together, and have to fit
+    // inside the map. The first ring is 2 x 1.5 tiles.
+    params.ringSpacing      = 3.0f;
+    float maxRadius         = Min(xNumTiles / 4.0f, yNumTiles / 3.0f);
+    params.numRings         = Max(1, static_cast<int>((maxRadius - 1.0f) / params.ringSpacing) + 1);
+
+    params.numBanks         = Max(params.numBanks,  params.numBanks  * numTiles / defaultNumTiles);
+    params.numPolice        = Max(params.numPolice, params.numPolice * numTiles / defaultNumTiles);
+    params.numTowers        = Max(params.numTowers, params.numTowers * numTiles / defaultNumTiles);
+
+    return params;
+
+}
+
 Map::Map()
 {
-    m_numStops = 0;
-    m_numRails = 0;
-    m_numRiverVertices = 0;
+    m_xSize     = 0;
+    m_ySize     = 0;
+    m_seed      = 0;
+    m_hash      = 0;
+    m_xNumCells = 0;
+    m_yNumCells = 0;
+    m_railQuery = 0;
 }
 
-void Map::Generate(int xSize, int ySize, int seed)
+void Map::Generate(int xSize, int ySize, int seed, const MapParams& params)
 {
 
     Random random;
     random.Seed(seed);
 
-    const int terminalSpacing = 150;
+    m_xSize = xSize;
+    m_ySize = ySize;
+    m_seed  = seed;
 
-    int xNumTiles = xSize / terminalSpacing;
-    int yNumTiles = ySize / terminalSpacing;
+    m_stopPoint.clear();
+    m_stopLine.clear();
+    m_stopTerminal.clear();
+    m_stopStructure.clear();
+    m_railStop1.clear();
+    m_railStop2.clear();
+    m_railLine.clear();
+    InitializeGrid(xSize, ySize);
+
+    int xNumTiles = xSize / _terminalSpacing;
+    int yNumTiles = ySize / _terminalSpacing;
 
-    const int maxLines = 8;
     int line = 0;
 
-    for (int i = 0; i < maxLines - 1; ++i)
+    for (int i = 0; i < params.numLines; ++i)
     {
 
-        int r = random.Generate(0, xNumTiles * 2 + yNumTiles * 2);
-
         int x = 0;
         int y = 0;
 
-        if (r < xNumTiles)
+        if (params.edgeTerminals)
         {
-            x = r;
-            y = 0;
-        }
-        else if (r < xNumTiles * 2)
-        {
-            x = r - xNumTiles;
-            y = yNumTiles - 1;
-        }
-        else if (r < xNumTiles * 2 + yNumTiles)
-        {
-            x = 0;
-            y = r - xNumTiles * 2;
+
+            int r = random.Generate(0, xNumTiles * 2 + yNumTiles * 2);
+
+            if (r < xNumTiles)
+            {
+                x = r;
+                y = 0;
+            }
+            else if (r < xNumTiles * 2)
+            {
+                x = r - xNumTiles;
+                y = yNumTiles - 1;
+            }
+            else if (r < xNumTiles * 2 + yNumTiles)
+            {
+                x = 0;
+                y = r - xNumTiles * 2;
+            }
+            else
+            {
+                x = xNumTiles - 1;
+                y = r - (xNumTiles * 2 + yNumTiles);
+            }
+
         }
         else
         {
-            x = xNumTiles - 1;
-            y = r - (xNumTiles * 2 + yNumTiles);
+            x = random.Generate(0, xNumTiles - 1);
+            y = random.Generate(0, yNumTiles - 1);
         }
 
         if (x >= xNumTiles) x = xNumTiles - 1;
@@ -124,125 +258,381 @@ void Map::Generate(int xSize, int ySize, int seed)
         assert(y >= 0);
 
         Vec2 point;
-        point.x = (float)(x * terminalSpacing + random.Generate(_minTerminalDist, terminalSpacing - _minTerminalDist));
-        point.y = (float)(y * terminalSpacing + random.Generate(_minTerminalDist, terminalSpacing - _minTerminalDist));
+        point.x = (float)(x * _terminalSpacing + random.Generate(_minTerminalDist, _terminalSpacing - _minTerminalDist));
+        point.y = (float)(y * _terminalSpacing + random.Generate(_minTerminalDist, _terminalSpacing - _minTerminalDist));
         AddStop(point, line, true);
         ++line;
 
     }
 
  
-    int numTerminals = m_numStops;
+    int numTerminals = GetNumStops();
 
     for (int i = 0; i < numTerminals; ++i)
     {
-        GenerateLine(xSize, ySize, i, random);
+        GenerateLine(xSize, ySize, i, params, random);
+    }
+
+    // Create additional lines that circle the center of the city. Outer
+    // rings have more stops so the stops stay about as far apart.
+    for (int i = 0; i < params.numRings; ++i)
+    {
+        float radius = 1.0f + i * params.ringSpacing;
+        GenerateRing(xNumTiles, yNumTiles, radius, 16 * (i + 1), line);
+        ++line;
+    }
+
+    if (params.joinComponents)
+    {
+        JoinComponents();
     }
 
-   // Create an additional line that circles the center of the city.
 
-    int xNumSteps = 2;
-    int yNumSteps = 2;
-    int lastStop = -1;
-    int firstStop = -1;
+    BuildEdges();
 
-    for (int i = 0; i < 16; ++i)
+    /*
+    // Interative straighen out the lines.
+
+    const int numPasses = 100;
+    for (int pass = 0; pass < numPasses; ++pass)
     {
+        for (int i = 0; i < GetNumStops(); ++i)
+        {
+           StraightenStop(i);
+        }
+    }
+    */
 
-        float x = cosf((i * 2 * 3.14159265f) / 15) * 2.0f;
-        float y = sinf((i * 2 * 3.14159265f) / 15) * 1.5f;
+    // Place the structures.
 
-        x += xNumTiles / 2;
-        y += yNumTiles / 2;
+    PlaceStructures(StructureType_Bank,   params.numBanks, random);
+    PlaceStructures(StructureType_Police, params.numPolice, random);
+    PlaceStructures(StructureType_Tower,  params.numTowers, random);
 
-        Vec2 point((x + 0.5f) * terminalSpacing, (y + 0.5f) * terminalSpacing);
+    ReleaseRailGrid();
 
-        point.x = floorf(point.x / 50.0f) * 50.0f;
-        point.y = floorf(point.y / 50.0f) * 50.0f;
+    m_hash = ComputeHash();
 
-        int stop = MergeStop(point, line, 50.0f);
+}
 
-        if (lastStop != -1)
+void Map::Swap(Map& map)
+{
+    ::Swap(m_xSize, map.m_xSize);
+    ::Swap(m_ySize, map.m_ySize);
+    ::Swap(m_seed, map.m_seed);
+    ::Swap(m_hash, map.m_hash);
+    m_stopPoint.swap(map.m_stopPoint);
+    m_stopLine.swap(map.m_stopLine);
+    m_stopTerminal.swap(map.m_stopTerminal);
+    m_stopStructure.swap(map.m_stopStructure);
+    m_railStop1.swap(map.m_railStop1);
+    m_railStop2.swap(map.m_railStop2);
+    m_railLine.swap(map.m_railLine);
+    m_edgeStart.swap(map.m_edgeStart);
+    m_edgeStop.swap(map.m_edgeStop);
+    m_edgeLine.swap(map.m_edgeLine);
+    m_edgeLength.swap(map.m_edgeLength);
+    m_riverVertex.swap(map.m_riverVertex);
+    ::Swap(m_xNumCells, map.m_xNumCells);
+    ::Swap(m_yNumCells, map.m_yNumCells);
+    m_cellFirstStop.swap(map.m_cellFirstStop);
+    m_nextStopInCell.swap(map.m_nextStopInCell);
+    m_cellFirstRail.swap(map.m_cellFirstRail);
+    m_railNodeRail.swap(map.m_railNodeRail);
+    m_railNodeNext.swap(map.m_railNodeNext);
+    m_railStamp.swap(map.m_railStamp);
+    ::Swap(m_railQuery, map.m_railQuery);
+}
+
+void Map::Save(std::vector<unsigned char>& data) const
+{
+
+    Section sections[kNumSections];
+    const_cast<Map*>(this)->GetSections(sections);
+
+    size_t size = sizeof(MapFileHeader);
+    for (int i = 0; i < kNumSections; ++i)
+    {
+        size += GetPaddedSize(sections[i].size);
+    }
+
+    MapFileHeader header;
+    header.magic            = kMapFileMagic;
+    header.version          = kMapFileVersion;
+    header.hash             = m_hash;
+    header.xSize            = m_xSize;
+    header.ySize            = m_ySize;
+    header.seed             = m_seed;
+    header.numStops         = GetNumStops();
+    header.numRails         = GetNumRails();
+    header.numRiverVertices = static_cast<int>(m_riverVertex.size());
+    header.xNumCells        = m_xNumCells;
+    header.yNumCells        = m_yNumCells;
+
+    // Resizing zeroes the padding.
+    data.clear();
+    data.resize(size, 0);
+    memcpy(&data[0], &header, sizeof(header));
+
+    size_t offset = sizeof(MapFileHeader);
+    for (int i = 0; i < kNumSections; ++i)
+    {
+        if (sections[i].size > 0)
         {
-            Connect(lastStop, stop, line);
+            memcpy(&data[offset], sections[i].data, sections[i].size);
         }
-        else
+        offset += GetPaddedSize(sections[i].size);
+    }
+
+}
+
+bool Map::Load(const void* data, size_t size)
+{
+
+    Clear();
+
+    MapFileHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != kMapFileMagic || header.version != kMapFileVersion)
+    {
+        return false;
+    }
+
+    // Every element takes at least a byte, so this keeps the counts from
+    // overflowing before the size is checked.
+    const int maxCount = static_cast<int>(Min(size, static_cast<size_t>(0x7FFFFFF)));
+    if (header.numStops < 0 || header.numStops > maxCount ||
+        header.numRails < 0 || header.numRails > maxCount ||
+        header.numRiverVertices < 0 || header.numRiverVertices > maxCount ||
+        header.xNumCells <= 0 || header.xNumCells > maxCount ||
+        header.yNumCells <= 0 || header.yNumCells > maxCount / header.xNumCells)
+    {
+        return false;
+    }
+
+    m_stopPoint.resize(header.numStops);
+    m_stopLine.resize(header.numStops);
+    m_stopTerminal.resize(header.numStops);
+    m_stopStructure.resize(header.numStops);
+    m_railStop1.resize(header.numRails);
+    m_railStop2.resize(header.numRails);
+    m_railLine.resize(header.numRails);
+    m_edgeStart.resize(header.numStops + 1);
+    m_edgeStop.resize(header.numRails * 2);
+    m_edgeLine.resize(header.numRails * 2);
+    m_edgeLength.resize(header.numRails * 2);
+    m_riverVertex.resize(header.numRiverVertices);
+    m_cellFirstStop.resize(header.xNumCells * header.yNumCells);
+    m_nextStopInCell.resize(header.numStops);
+
+    Section sections[kNumSections];
+    GetSections(sections);
+
+    size_t expectedSize = sizeof(MapFileHeader);
+    for (int i = 0; i < kNumSections; ++i)
+    {
+        expectedSize += GetPaddedSize(sections[i].size);
+    }
+
+    const unsigned char* body = static_cast<const unsigned char*>(data) + sizeof(MapFileHeader);
+    size_t bodySize = size - sizeof(MapFileHeader);
+    if (expectedSize != size || HashWords(kHashBasis, body, bodySize) != header.hash)
+    {
+        Clear();
+        return false;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < kNumSections; ++i)
+    {
+        if (sections[i].size > 0)
         {
-            firstStop = stop;
+            memcpy(sections[i].data, body + offset, sections[i].size);
         }
-        lastStop = stop;
-        
+        offset += GetPaddedSize(sections[i].size);
     }
-    Connect(lastStop, firstStop, line);
 
+    m_xSize     = header.xSize;
+    m_ySize     = header.ySize;
+    m_seed      = header.seed;
+    m_hash      = header.hash;
+    m_xNumCells = header.xNumCells;
+    m_yNumCells = header.yNumCells;
 
-    // Initialize the stop children.
-    for (int i = 0; i < m_numRails; ++i)
+    // Maps can come from the network, so make sure nothing will index off
+    // the end of an array or loop forever.
+    if (!GetIsValid())
     {
-        const Rail& rail = m_rail[i];
-        Stop& stop1 = m_stop[rail.stop1];
-        Stop& stop2 = m_stop[rail.stop2];
-        stop1.children.push_back(rail.stop2);
-        stop2.children.push_back(rail.stop1);
+        Clear();
+        return false;
     }
 
-    /*
-    // Interative straighen out the lines.
+    return true;
 
-    const int numPasses = 100;
-    for (int pass = 0; pass < numPasses; ++pass)
+}
+
+void Map::GetSections(Section sections[kNumSections])
+{
+    GetArraySection(m_stopPoint,      sections[0].data,  sections[0].size);
+    GetArraySection(m_stopLine,       sections[1].data,  sections[1].size);
+    GetArraySection(m_stopTerminal,   sections[2].data,  sections[2].size);
+    GetArraySection(m_stopStructure,  sections[3].data,  sections[3].size);
+    GetArraySection(m_railStop1,      sections[4].data,  sections[4].size);
+    GetArraySection(m_railStop2,      sections[5].data,  sections[5].size);
+    GetArraySection(m_railLine,       sections[6].data,  sections[6].size);
+    GetArraySection(m_edgeStart,      sections[7].data,  sections[7].size);
+    GetArraySection(m_edgeStop,       sections[8].data,  sections[8].size);
+    GetArraySection(m_edgeLine,       sections[9].data,  sections[9].size);
+    GetArraySection(m_edgeLength,     sections[10].data, sections[10].size);
+    GetArraySection(m_riverVertex,    sections[11].data, sections[11].size);
+    GetArraySection(m_cellFirstStop,  sections[12].data, sections[12].size);
+    GetArraySection(m_nextStopInCell, sections[13].data, sections[13].size);
+}
+
+unsigned int Map::ComputeHash() const
+{
+
+    // Hashes the same words Save writes after the header.
+    Section sections[kNumSections];
+    const_cast<Map*>(this)->GetSections(sections);
+
+    unsigned int hash = kHashBasis;
+    for (int i = 0; i < kNumSections; ++i)
+    {
+        hash = HashWords(hash, sections[i].data, sections[i].size);
+    }
+    return hash;
+
+}
+
+bool Map::GetIsValid() const
+{
+
+    int numStops = GetNumStops();
+    int numRails = GetNumRails();
+
+    if (m_xSize <= 0 || m_ySize <= 0)
     {
-        for (int i = 0; i < m_numStops; ++i)
+        return false;
+    }
+
+    for (int i = 0; i < numStops; ++i)
+    {
+        if (m_stopLine[i] < -1 || m_stopStructure[i] < StructureType_None || m_stopStructure[i] > StructureType_House)
         {
-           Stop& stop = m_stop[i];
-           StraightenStop(stop);
+            return false;
         }
     }
-    */
 
-    // Place the structures.
+    for (int i = 0; i < numRails; ++i)
+    {
+        if (m_railStop1[i] < 0 || m_railStop1[i] > m_railStop2[i] || m_railStop2[i] >= numStops)
+        {
+            return false;
+        }
+    }
+
+    if (m_edgeStart[0] != 0 || m_edgeStart[numStops] != numRails * 2)
+    {
+        return false;
+    }
+    for (int i = 0; i < numStops; ++i)
+    {
+        if (m_edgeStart[i + 1] < m_edgeStart[i])
+        {
+            return false;
+        }
+    }
+    for (int i = 0; i < numRails * 2; ++i)
+    {
+        if (m_edgeStop[i] < 0 || m_edgeStop[i] >= numStops)
+        {
+            return false;
+        }
+    }
+
+    // Each stop must be in exactly one cell's list. Counting the steps stops
+    // a cycle from looping forever.
+    int numListed = 0;
+    for (size_t i = 0; i < m_cellFirstStop.size(); ++i)
+    {
+        int stop = m_cellFirstStop[i];
+        while (stop != -1)
+        {
+            if (stop < 0 || stop >= numStops || ++numListed > numStops)
+            {
+                return false;
+            }
+            stop = m_nextStopInCell[stop];
+        }
+    }
 
-    const int numBanks  = 2;
-    const int numPolice = 3;
-    const int numTowers = 4;
+    return numListed == numStops;
 
-    PlaceStructures(StructureType_Bank,   numBanks, random);
-    PlaceStructures(StructureType_Police, numPolice, random);
-    PlaceStructures(StructureType_Tower,  numTowers, random);
+}
 
+void Map::Clear()
+{
+    m_xSize     = 0;
+    m_ySize     = 0;
+    m_seed      = 0;
+    m_hash      = 0;
+    m_stopPoint.clear();
+    m_stopLine.clear();
+    m_stopTerminal.clear();
+    m_stopStructure.clear();
+    m_railStop1.clear();
+    m_railStop2.clear();
+    m_railLine.clear();
+    m_edgeStart.assign(1, 0);
+    m_edgeStop.clear();
+    m_edgeLine.clear();
+    m_edgeLength.clear();
+    m_riverVertex.clear();
+    m_xNumCells = 1;
+    m_yNumCells = 1;
+    m_cellFirstStop.assign(1, -1);
+    m_nextStopInCell.clear();
+    ReleaseRailGrid();
 }
 
 void Map::PlaceStructures(StructureType structureType, int number, Random& random)
 {
     for (int i = 0; i < number; ++i)
     {
-        int offset = random.Generate(0, m_numStops);
-        for (int j = 0; j < m_numStops; ++j)
+        int numStops = GetNumStops();
+        int offset = random.Generate(0, numStops);
+        for (int j = 0; j < numStops; ++j)
         {
-            int stopIndex = (j + offset) % m_numStops;
-            Stop& stop = m_stop[stopIndex];
-            if (stop.structureType == StructureType_None)
+            int stopIndex = (j + offset) % numStops;
+            if (m_stopStructure[stopIndex] == StructureType_None)
             {
-                stop.structureType = structureType;
+                m_stopStructure[stopIndex] = structureType;
                 break;
             }
         }
     }
 }
 
-void Map::StraightenStop(Stop& stop)
+void Map::StraightenStop(int stop)
 {
-    if (stop.children.size() == 2)
+    if (GetNumNeighbors(stop) == 2)
     {
 
-        int child1 = stop.children[0];
-        int child2 = stop.children[1];
+        int child1 = GetNeighbor(stop, 0);
+        int child2 = GetNeighbor(stop, 1);
 
-        const Stop& stop1 = m_stop[child1];
-        const Stop& stop2 = m_stop[child2];
+        const Vec2& point1 = m_stopPoint[child1];
+        const Vec2& point2 = m_stopPoint[child2];
+        Vec2& point = m_stopPoint[stop];
 
-        Vec2 e1 = stop1.point - stop.point;
-        Vec2 e2 = stop2.point - stop.point;
+        Vec2 e1 = point1 - point;
+        Vec2 e2 = point2 - point;
 
         e1.Normalize();
         e2.Normalize();
@@ -252,10 +642,10 @@ void Map::StraightenStop(Stop& stop)
         if (angle < 0.01f)
         {
             // Make it into a straight line.
-            Vec2 d = stop2.point - stop1.point;
+            Vec2 d = point2 - point1;
             d.Normalize();
-            Vec2 p = stop1.point + DotProduct(d, stop.point - stop1.point) * d;
-            stop.point = p;
+            Vec2 p = point1 + DotProduct(d, point - point1) * d;
+            point = p;
         }
 
     }
@@ -264,85 +654,353 @@ void Map::StraightenStop(Stop& stop)
 void Map::Connect(int stop1, int stop2, int line)
 {
     assert(line >= 0);
-    
-    const Stop& s1 = m_stop[stop1];
-    const Stop& s2 = m_stop[stop2];
 
     // Check if we are crossing an existing rail.
 
-    for (int i = 0; i < m_numRails; ++i)
+    Vec2 mid;
+    int i = FindCrossingRail(stop1, stop2, mid);
+    if (i != -1)
+    {
+        int railStop2 = m_railStop2[i];
+        int midStop = MergeStop(mid, -1, _stopMergeDistance);
+
+        AddRail(midStop, railStop2, m_railLine[i]);
+
+        // The crossing may have merged with a stop off the old rail, so add
+        // the rail to the cells it now covers. It's left in its old cells too,
+        // which only costs an extra check.
+        m_railStop2[i] = midStop;
+        EnforceRailConstraint(i);
+        AddRailToGrid(i);
+
+        Connect(stop1, midStop, line);
+        Connect(midStop, stop2, line);
+        return;
+    }
+
+    AddRail(stop1, stop2, line);
+}
+
+void Map::AddRail(int stop1, int stop2, int line)
+{
+    m_railStop1.push_back(stop1);
+    m_railStop2.push_back(stop2);
+    m_railLine.push_back(line);
+    EnforceRailConstraint(GetNumRails() - 1);
+    m_railStamp.push_back(0);
+    AddRailToGrid(GetNumRails() - 1);
+}
+
+int Map::FindCrossingRail(int stop1, int stop2, Vec2& crossing)
+{
+
+    const Vec2& p1 = m_stopPoint[stop1];
+    const Vec2& p2 = m_stopPoint[stop2];
+
+    // Rails can only cross the segment if their bounding boxes overlap, and
+    // then they share at least one cell.
+    int xMin = GetCellX(Min(p1.x, p2.x));
+    int xMax = GetCellX(Max(p1.x, p2.x));
+    int yMin = GetCellY(Min(p1.y, p2.y));
+    int yMax = GetCellY(Max(p1.y, p2.y));
+
+    // A rail can be listed in several of the cells, so stamp each one as it's
+    // checked.
+    ++m_railQuery;
+    int result = -1;
+
+    for (int y = yMin; y <= yMax; ++y)
+    {
+        for (int x = xMin; x <= xMax; ++x)
+        {
+            int node = m_cellFirstRail[x + y * m_xNumCells];
+            while (node != -1)
+            {
+                int i = m_railNodeRail[node];
+                node = m_railNodeNext[node];
+
+                if (m_railStamp[i] == m_railQuery || (result != -1 && i > result))
+                {
+                    continue;
+                }
+                m_railStamp[i] = m_railQuery;
+
+                // Rails are checked in cell order, so keep the lowest index to
+                // match checking them in order.
+                int railStop1 = m_railStop1[i];
+                int railStop2 = m_railStop2[i];
+                Vec2 mid;
+                if (railStop1 != stop1 && railStop2 != stop1 &&
+                    railStop1 != stop2 && railStop2 != stop2 &&
+                    GetLineSegmentLineSegmentIntersection(p1, p2, m_stopPoint[railStop1], m_stopPoint[railStop2], mid))
+                {
+                    result = i;
+                    crossing = mid;
+                }
+            }
+        }
+    }
+
+    return result;
+
+}
+
+void Map::AddRailToGrid(int rail)
+{
+
+    const Vec2& p1 = m_stopPoint[m_railStop1[rail]];
+    const Vec2& p2 = m_stopPoint[m_railStop2[rail]];
+
+    int xMin = GetCellX(Min(p1.x, p2.x));
+    int xMax = GetCellX(Max(p1.x, p2.x));
+    int yMin = GetCellY(Min(p1.y, p2.y));
+    int yMax = GetCellY(Max(p1.y, p2.y));
+
+    for (int y = yMin; y <= yMax; ++y)
     {
-        Rail& rail = m_rail[i];
-        const Stop& s3 = m_stop[ rail.stop1 ];
-        const Stop& s4 = m_stop[ rail.stop2 ];
-        Vec2 mid;
-        if (rail.stop1 != stop1 && rail.stop2 != stop1 &&
-            rail.stop1 != stop2 && rail.stop2 != stop2 &&
-            GetLineSegmentLineSegmentIntersection(s1.point, s2.point, s3.point, s4.point, mid))
+        for (int x = xMin; x <= xMax; ++x)
         {
-            int midStop = MergeStop(mid, -1, _stopMergeDistance);
-
-            assert(m_numRails < s_maxRails);
-            m_rail[m_numRails].stop1 = midStop;
-            m_rail[m_numRails].stop2 = rail.stop2;
-            m_rail[m_numRails].line  = rail.line;
-            EnforceRailConstraint(m_rail[m_numRails]);
-            ++m_numRails;
-            
-            rail.stop2 = midStop;
-            EnforceRailConstraint(rail);
-
-            Connect(stop1, midStop, line);
-            Connect(midStop, stop2, line);
-            return;
+            int cell = x + y * m_xNumCells;
+            m_railNodeRail.push_back(rail);
+            m_railNodeNext.push_back(m_cellFirstRail[cell]);
+            m_cellFirstRail[cell] = static_cast<int>(m_railNodeRail.size()) - 1;
         }
     }
 
-    assert(m_numRails < s_maxRails);
-    m_rail[m_numRails].stop1 = stop1;
-    m_rail[m_numRails].stop2 = stop2;
-    EnforceRailConstraint(m_rail[m_numRails]);
-    m_rail[m_numRails].line  = line;
-    ++m_numRails;
+}
+
+void Map::ReleaseRailGrid()
+{
+    // Only needed while rails are being added.
+    std::vector<int>().swap(m_cellFirstRail);
+    std::vector<int>().swap(m_railNodeRail);
+    std::vector<int>().swap(m_railNodeNext);
+    std::vector<unsigned int>().swap(m_railStamp);
 }
 
 int Map::AddStop(const Vec2& point, int line, bool terminal)
 {
-    assert(m_numStops < s_maxStops);
-    m_stop[m_numStops].point            = point;
-    m_stop[m_numStops].line             = line;
-    m_stop[m_numStops].terminal         = terminal;
-    m_stop[m_numStops].structureType    = StructureType_None;
-    ++m_numStops;
-    return m_numStops - 1;
+    m_stopPoint.push_back(point);
+    m_stopLine.push_back(line);
+    m_stopTerminal.push_back(terminal);
+    m_stopStructure.push_back(StructureType_None);
+    int stop = GetNumStops() - 1;
+    AddStopToGrid(stop);
+    return stop;
 }
 
 int Map::MergeStop(const Vec2& point, int line, float distance)
 {
+    int stop = FindStop(point, distance, false);
+    if (stop != -1)
+    {
+        m_stopLine[stop] = -1;
+        return stop;
+    }
+    return AddStop(point, line);
+}
+
+int Map::FindStop(const Vec2& point, float distance, bool includeTerminals) const
+{
+
+    if (m_xNumCells == 0)
+    {
+        return -1;
+    }
+
+    int xMin = GetCellX(point.x - distance);
+    int xMax = GetCellX(point.x + distance);
+    int yMin = GetCellY(point.y - distance);
+    int yMax = GetCellY(point.y + distance);
+
+    // The stops are checked in cell order rather than index order, so keep
+    // the lowest index to give the same answer as checking them in order.
     float distance2 = distance * distance;
-    for (int i = 0; i < m_numStops; ++i)
+    int result = -1;
+
+    for (int y = yMin; y <= yMax; ++y)
     {
-        Vec2 d = m_stop[i].point - point;
-        if (d.x * d.x + d.y * d.y < distance2 && !m_stop[i].terminal)
+        for (int x = xMin; x <= xMax; ++x)
         {
-            m_stop[i].line = -1;
-            return i;
+            int i = m_cellFirstStop[x + y * m_xNumCells];
+            while (i != -1)
+            {
+                Vec2 d = m_stopPoint[i] - point;
+                if ((result == -1 || i < result) && d.x * d.x + d.y * d.y < distance2 &&
+                    (includeTerminals || !m_stopTerminal[i]))
+                {
+                    result = i;
+                }
+                i = m_nextStopInCell[i];
+            }
         }
     }
-    return AddStop(point, line);
+
+    return result;
+
+}
+
+void Map::InitializeGrid(int xSize, int ySize)
+{
+    m_xNumCells = Max(1, static_cast<int>(ceilf(xSize / _gridCellSize)));
+    m_yNumCells = Max(1, static_cast<int>(ceilf(ySize / _gridCellSize)));
+    m_cellFirstStop.assign(m_xNumCells * m_yNumCells, -1);
+    m_nextStopInCell.clear();
+    m_cellFirstRail.assign(m_xNumCells * m_yNumCells, -1);
+    m_railNodeRail.clear();
+    m_railNodeNext.clear();
+    m_railStamp.clear();
+}
+
+void Map::AddStopToGrid(int stop)
+{
+    // Stops are only ever added in order and don't move once they're placed.
+    assert(stop == static_cast<int>(m_nextStopInCell.size()));
+    int cell = GetCellX(m_stopPoint[stop].x) + GetCellY(m_stopPoint[stop].y) * m_xNumCells;
+    m_nextStopInCell.push_back(m_cellFirstStop[cell]);
+    m_cellFirstStop[cell] = stop;
+}
+
+int Map::GetCellX(float x) const
+{
+    // Points off the edge of the map go in the edge cells.
+    return Clamp(static_cast<int>(floorf(x / _gridCellSize)), 0, m_xNumCells - 1);
+}
+
+int Map::GetCellY(float y) const
+{
+    return Clamp(static_cast<int>(floorf(y / _gridCellSize)), 0, m_yNumCells - 1);
 }
 
 
-void Map::GenerateLine(int xSize, int ySize, int stopIndex, Random& random)
+void Map::GenerateRing(int xNumTiles, int yNumTiles, float radius, int numStops, int line)
+{
+
+    int lastStop = -1;
+    int firstStop = -1;
+
+    // The last point is on top of the first one, so they get merged.
+    for (int i = 0; i < numStops; ++i)
+    {
+
+        float x = cosf((i * 2 * 3.14159265f) / (numStops - 1)) * 2.0f * radius;
+        float y = sinf((i * 2 * 3.14159265f) / (numStops - 1)) * 1.5f * radius;
+
+        x += xNumTiles / 2;
+        y += yNumTiles / 2;
+
+        Vec2 point((x + 0.5f) * _terminalSpacing, (y + 0.5f) * _terminalSpacing);
+
+        point.x = floorf(point.x / 50.0f) * 50.0f;
+        point.y = floorf(point.y / 50.0f) * 50.0f;
+
+        int stop = MergeStop(point, line, 50.0f);
+
+        if (lastStop != -1)
+        {
+            Connect(lastStop, stop, line);
+        }
+        else
+        {
+            firstStop = stop;
+        }
+        lastStop = stop;
+        
+    }
+    Connect(lastStop, firstStop, line);
+
+}
+
+static int FindRoot(std::vector<int>& parent, int stop)
+{
+    while (parent[stop] != stop)
+    {
+        parent[stop] = parent[parent[stop]];
+        stop = parent[stop];
+    }
+    return stop;
+}
+
+void Map::JoinComponents()
+{
+
+    int numStops = GetNumStops();
+
+    // Find the pieces of the network with a union-find over the rails.
+    std::vector<int> root(numStops);
+    std::vector<int> size(numStops, 1);
+    for (int i = 0; i < numStops; ++i)
+    {
+        root[i] = i;
+    }
+    for (int i = 0; i < GetNumRails(); ++i)
+    {
+        int root1 = FindRoot(root, m_railStop1[i]);
+        int root2 = FindRoot(root, m_railStop2[i]);
+        if (root1 != root2)
+        {
+            if (size[root1] < size[root2])
+            {
+                ::Swap(root1, root2);
+            }
+            root[root2] = root1;
+            size[root1] += size[root2];
+        }
+    }
+
+    int mainRoot = 0;
+    for (int i = 0; i < numStops; ++i)
+    {
+        root[i] = FindRoot(root, i);
+        if (size[root[i]] > size[mainRoot])
+        {
+            mainRoot = root[i];
+        }
+    }
+
+    // Stops added while joining aren't in root, so they're never picked
+    // as the stop to join to.
+    std::vector<char> joined(numStops, 0);
+    for (int i = 0; i < numStops; ++i)
+    {
+        int component = root[i];
+        if (component == mainRoot || joined[component])
+        {
+            continue;
+        }
+        joined[component] = 1;
+
+        int stop = FindNearestStop(m_stopPoint[i], &root[0], numStops, mainRoot);
+        int line = m_stopLine[i] >= 0 ? m_stopLine[i] : Max(m_stopLine[stop], 0);
+        Connect(i, stop, line);
+    }
+
+}
+
+void Map::GenerateLine(int xSize, int ySize, int stopIndex, const MapParams& params, Random& random)
 {
 
     // Lines go along horizontal, vertical and 45 degree angles.
     const int numDirs = 8;
     
-    const Stop& stop = m_stop[stopIndex];
-
-    bool xPos = stop.point.x < xSize / 2;
-    bool yPos = stop.point.y < ySize / 2;
+    // Copied since adding stops can reallocate the arrays.
+    Vec2 point = m_stopPoint[stopIndex];
+    int  line  = m_stopLine[stopIndex];
+
+    // Lines from the edge head towards the center; in a large city they can
+    // head off in any direction.
+    bool xPos;
+    bool yPos;
+    if (params.edgeTerminals)
+    {
+        xPos = point.x < xSize / 2;
+        yPos = point.y < ySize / 2;
+    }
+    else
+    {
+        xPos = random.Generate(0, 1) == 0;
+        yPos = random.Generate(0, 1) == 0;
+    }
 
     int minDir, maxDir;
 
@@ -363,13 +1021,11 @@ void Map::GenerateLine(int xSize, int ySize, int stopIndex, Random& random)
         minDir = (numDirs * 3) / 4; maxDir = numDirs - 1;
     }
 
-    Vec2 point = stop.point;
     int dir  = random.Generate(minDir, maxDir);
-    int line = stop.line;
     
     int stepSize = random.Generate(50, 100);
 
-    for (int i = 0; i < 20; ++i)
+    for (int i = 0; i < params.lineLength; ++i)
     {
 
         if (random.Generate(0, 100) > 25)
@@ -389,182 +1045,220 @@ void Map::GenerateLine(int xSize, int ySize, int stopIndex, Random& random)
             break;
         }
 
-        int newStopIndex = MergeStop(point, stop.line, _stopMergeDistance);
-        point = m_stop[newStopIndex].point;
+        int newStopIndex = MergeStop(point, line, _stopMergeDistance);
+        point = m_stopPoint[newStopIndex];
 
         Connect(stopIndex, newStopIndex, line);
         stopIndex = newStopIndex;
 
     }
 
-    m_stop[stopIndex].terminal = true;
+    m_stopTerminal[stopIndex] = true;
 
 }
 
-void Map::EnforceRailConstraint(Rail& rail) const
+void Map::EnforceRailConstraint(int rail)
 {
-    if (rail.stop1 > rail.stop2)
+    if (m_railStop1[rail] > m_railStop2[rail])
     {
-        Swap(rail.stop1, rail.stop2);
+        ::Swap(m_railStop1[rail], m_railStop2[rail]);
     }
 }
 
-int Map::GetStopForPoint(const Vec2& point)
+Rail Map::GetRail(int rail) const
 {
-    float distance = 10.0f;
-    float d2 = distance * distance;
-    for (int i = 0; i < m_numStops; ++i)
-    {
-        Vec2 offset = m_stop[i].point - point;
-        if (DotProduct(offset, offset) < d2)
-        {
-            return i;
-        }
-    }
-    return -1;
+    Rail result;
+    result.stop1 = m_railStop1[rail];
+    result.stop2 = m_railStop2[rail];
+    result.line  = m_railLine[rail];
+    return result;
 }
 
-int Map::GetNearestStopForPoint(const Vec2& point)
+void Map::BuildEdges()
 {
-    int closestStop = -1;
-    float minDistanceSquared;
 
-    for (int i = 0; i < m_numStops; ++i)
+    int numStops = GetNumStops();
+    int numRails = GetNumRails();
+
+    // Count the edges leaving each stop, then place them with a counting sort
+    // so each stop's edges stay in rail order.
+    m_edgeStart.assign(numStops + 1, 0);
+    for (int i = 0; i < numRails; ++i)
     {
-        Vec2 offset = m_stop[i].point - point;
-        float distanceSquared = DotProduct(offset, offset);
-        
-        if (closestStop == -1 || distanceSquared < minDistanceSquared)
-        {
-            closestStop = i;
-            minDistanceSquared = distanceSquared;
-        }
+        ++m_edgeStart[m_railStop1[i] + 1];
+        ++m_edgeStart[m_railStop2[i] + 1];
+    }
+    for (int i = 0; i < numStops; ++i)
+    {
+        m_edgeStart[i + 1] += m_edgeStart[i];
     }
 
-    return closestStop;
-}
+    m_edgeStop.resize(numRails * 2);
+    m_edgeLine.resize(numRails * 2);
+    m_edgeLength.resize(numRails * 2);
 
-int Map::GetLineBetween(int stopA, int stopB)
-{
-    for (int i = 0 ; i < m_numRails; ++i)
+    std::vector<int> next(m_edgeStart.begin(), m_edgeStart.end() - 1);
+    for (int i = 0; i < numRails; ++i)
     {
-        if ((m_rail[i].stop1 == stopA && m_rail[i].stop2 == stopB) ||
-            (m_rail[i].stop1 == stopB && m_rail[i].stop2 == stopA))
-        {
-            return m_rail[i].line;
-        }
+        int stop1 = m_railStop1[i];
+        int stop2 = m_railStop2[i];
+        float length = Length(m_stopPoint[stop2] - m_stopPoint[stop1]);
+
+        int edge1 = next[stop1]++;
+        m_edgeStop[edge1]   = stop2;
+        m_edgeLine[edge1]   = m_railLine[i];
+        m_edgeLength[edge1] = length;
+
+        int edge2 = next[stop2]++;
+        m_edgeStop[edge2]   = stop1;
+        m_edgeLine[edge2]   = m_railLine[i];
+        m_edgeLength[edge2] = length;
     }
 
-    return -1;
 }
 
-unsigned long Map::GetLineColor(int line)
+int Map::GetStopForPoint(const Vec2& point) const
 {
+    return FindStop(point, 10.0f, true);
+}
 
-    if (line < 0)
-    {
-        return 0xff7f7f7f;
-    }
-
-    return kLineColor[line % kNumLines];
-
+int Map::GetNearestStopForPoint(const Vec2& point) const
+{
+    return FindNearestStop(point, NULL, 0, 0);
 }
 
-int Map::GetPath(int stopA, int stopB, int path[])
+int Map::FindNearestStop(const Vec2& point, const int* stopGroup, int numGroupStops, int group) const
 {
-    struct Node
-    {
-        int distance;
-        bool visited;
-        int next;
-    };
 
-    if (stopA == stopB)
+    if (m_stopPoint.empty())
     {
-        path[0] = stopA;
-        return 1;
+        return -1;
     }
 
-    Node nodes[s_maxStops];
+    int closestStop = -1;
+    float minDistanceSquared;
 
-    int unvisited[s_maxStops];
-    int numUnvisited = 0;
+    int xCell = GetCellX(point.x);
+    int yCell = GetCellY(point.y);
+    int maxRing = Max(Max(xCell, m_xNumCells - 1 - xCell), Max(yCell, m_yNumCells - 1 - yCell));
 
-    // Setup
-    for (int i = 0; i < m_numStops; ++i)
+    // Search rings of cells outwards from the point. A stop in ring r+1 is
+    // more than r cells away, so once the closest stop is within that we're
+    // done.
+    for (int ring = 0; ring <= maxRing; ++ring)
     {
-        if (i == stopB)
-        {
-            nodes[i].distance = 0;
-        }
-        else
-        {
-            nodes[i].distance = -1;
-            unvisited[numUnvisited] = i;
-            ++numUnvisited;
-        }
-        nodes[i].visited = false;
-        nodes[i].next = -1;        
-    }
-
-    int current = stopB;
 
-    // Dijkstra's algorithm
-    while(true)
-    {
-        int distance = nodes[current].distance + 1;
-        for (size_t i = 0; i < m_stop[current].children.size(); ++i)
+        for (int y = yCell - ring; y <= yCell + ring; ++y)
         {
-            int neighbor = m_stop[current].children[i];
-            if (!nodes[neighbor].visited && (nodes[neighbor].distance == -1 || distance < nodes[neighbor].distance))
+            if (y < 0 || y >= m_yNumCells)
             {
-                nodes[neighbor].distance = distance;
-                nodes[neighbor].next = current;
+                continue;
             }
-        }
-        nodes[current].visited = true;
 
-        // Find nearest unvisited
-        int nearestIndex = -1;
-        int nearestDistance;
-        for (int i = 1; i < numUnvisited; ++i)
-        {
-            distance = nodes[unvisited[i]].distance;
-            if (distance != -1 && (nearestIndex == -1 || distance < nearestDistance))
+            // Only the edges of the ring are new cells.
+            int xStep = (y == yCell - ring || y == yCell + ring) ? 1 : Max(1, ring * 2);
+            for (int x = xCell - ring; x <= xCell + ring; x += xStep)
             {
-                nearestIndex = i;
-                nearestDistance = distance;
+                if (x < 0 || x >= m_xNumCells)
+                {
+                    continue;
+                }
+
+                int i = m_cellFirstStop[x + y * m_xNumCells];
+                while (i != -1)
+                {
+                    if (stopGroup != NULL && (i >= numGroupStops || stopGroup[i] != group))
+                    {
+                        i = m_nextStopInCell[i];
+                        continue;
+                    }
+                    Vec2 offset = m_stopPoint[i] - point;
+                    float distanceSquared = DotProduct(offset, offset);
+                    if (closestStop == -1 || distanceSquared < minDistanceSquared ||
+                        (distanceSquared == minDistanceSquared && i < closestStop))
+                    {
+                        closestStop = i;
+                        minDistanceSquared = distanceSquared;
+                    }
+                    i = m_nextStopInCell[i];
+                }
             }
         }
-        
-        if (nearestIndex == -1)
+
+        float ringDistance = ring * _gridCellSize;
+        if (closestStop != -1 && minDistanceSquared <= ringDistance * ringDistance)
         {
-            // No path!
-            return 0;
+            break;
         }
 
-        current = unvisited[nearestIndex];
-        if (current == stopA)
+    }
+
+    return closestStop;
+
+}
+
+int Map::GetLineBetween(int stopA, int stopB) const
+{
+    for (int i = m_edgeStart[stopA]; i < m_edgeStart[stopA + 1]; ++i)
+    {
+        if (m_edgeStop[i] == stopB)
         {
-            break;
+            return m_edgeLine[i];
         }
+    }
+
+    return -1;
+}
+
+// Converts a hue, saturation and value, all from 0 to 1, to an opaque color.
+static unsigned long GetHsvColor(float h, float s, float v)
+{
 
-        unvisited[nearestIndex] = unvisited[numUnvisited-1];
-        --numUnvisited;
+    float sector = h * 6.0f;
+    int i = static_cast<int>(sector) % 6;
+    float f = sector - floorf(sector);
+
+    float p = v * (1.0f - s);
+    float q = v * (1.0f - s * f);
+    float t = v * (1.0f - s * (1.0f - f));
+
+    float r, g, b;
+    switch (i)
+    {
+    case 0:  r = v; g = t; b = p; break;
+    case 1:  r = q; g = v; b = p; break;
+    case 2:  r = p; g = v; b = t; break;
+    case 3:  r = p; g = q; b = v; break;
+    case 4:  r = t; g = p; b = v; break;
+    default: r = v; g = p; b = q; break;
     }
 
-    // Build path
-    int pathLength = 0;
-    while (current != stopB)
+    unsigned long red   = static_cast<unsigned long>(r * 255.0f + 0.5f);
+    unsigned long green = static_cast<unsigned long>(g * 255.0f + 0.5f);
+    unsigned long blue  = static_cast<unsigned long>(b * 255.0f + 0.5f);
+    return 0xFF000000 | (red << 16) | (green << 8) | blue;
+
+}
+
+unsigned long Map::GetLineColor(int line) const
+{
+
+    if (line < 0)
     {
-        path[pathLength] = current;
-        ++pathLength;
-        current = nodes[current].next;
-        assert(current != -1);
+        return 0xff7f7f7f;
     }
-    path[pathLength] = stopB;
-    ++pathLength;
 
-    return pathLength;
+    if (line < kNumLines)
+    {
+        return kLineColor[line];
+    }
 
-}
\ No newline at end of file
+    // Large cities have more lines than the palette. Stepping the hue by the
+    // golden ratio keeps each new color far from the ones before it, and
+    // the brightness alternates so neighbouring hues still differ.
+    int index = line - kNumLines;
+    float hue = fmodf(0.1f + index * 0.618034f, 1.0f);
+    float value = (index / 3) % 2 == 0 ? 0.85f : 0.6f;
+    return GetHsvColor(hue, 0.75f, value);
+
+}
@@ -2,6 +2,7 @@
 #define GAME_MAP_H
 
 #include "Vec2.h"
+#include <stddef.h>
 #include <vector>
 
 class Random;
@@ -15,15 +16,6 @@ enum StructureType
     StructureType_House, // never placed on the map.
 };
 
-struct Stop
-{
-    Vec2                point;
-    int                 line;       // -1 means a hub
-    bool                terminal;   // End of the line buddy
-    std::vector<int>    children;
-    StructureType       structureType;
-};
-
 struct Rail
 {
     int stop1;
@@ -31,57 +23,172 @@ struct Rail
     int line;
 };
 
+// Controls the shape of a generated map. The defaults give the small map the
+// game was designed around, so existing seeds keep giving the same maps.
+struct MapParams
+{
+
+    MapParams();
+
+    // Returns parameters for a large city, with the number of lines, ring
+    // lines and structures scaled with the area of the map.
+    static MapParams GetLargeCity(int xSize, int ySize);
+
+    int     numLines;           // Lines starting from a terminal
+    int     lineLength;         // Maximum number of steps along each line
+    bool    edgeTerminals;      // Start the lines at the edge of the map heading inwards
+    int     numRings;           // Lines circling the center of the map
+    float   ringSpacing;        // Distance between rings, relative to the first one's radius
+    bool    joinComponents;     // Connect pieces of the network no other line reaches
+    int     numBanks;
+    int     numPolice;
+    int     numTowers;
+
+};
+
 class Map
 {
 
 public:
 
-    static const int s_maxStops = 500;
-    static const int s_maxRails = 1500;
-    static const int s_maxRiverVertices = 100;
-
     Map();
 
-    void Generate(int xSize, int ySize, int seed);
+    void Generate(int xSize, int ySize, int seed, const MapParams& params = MapParams());
+
+    // Exchanges the contents of two maps without copying them.
+    void Swap(Map& map);
 
-    int         GetNumStops() const { return m_numStops; }
-    const Stop& GetStop(int i) const { return m_stop[i]; }
+    // Maps can be saved in a versioned binary format whose arrays are copied
+    // straight into the map when it's loaded. Load returns false if the data
+    // is from a different version, is corrupt or describes an invalid map,
+    // in which case the map is left empty.
+    void Save(std::vector<unsigned char>& data) const;
+    bool Load(const void* data, size_t size);
 
-    int         GetNumRails() const { return m_numRails; }
-    const Rail& GetRail(int i) const { return m_rail[i]; }
+    int             GetXSize() const { return m_xSize; }
+    int             GetYSize() const { return m_ySize; }
+    int             GetSeed() const { return m_seed; }
 
-    int GetStopForPoint(const Vec2& point);
-    int GetNearestStopForPoint(const Vec2& point);
+    // Hash of the map's contents, so maps generated by different builds can
+    // be checked against each other.
+    unsigned int    GetHash() const { return m_hash; }
 
-    int GetLineBetween(int stopA, int stopB);
-    unsigned long GetLineColor(int line);
+    // Stops and rails are stored as parallel arrays indexed by the stop or
+    // rail number, so the size of the map is only limited by memory.
+    int             GetNumStops() const { return static_cast<int>(m_stopPoint.size()); }
+    const Vec2&     GetStopPoint(int stop) const { return m_stopPoint[stop]; }
+    int             GetStopLine(int stop) const { return m_stopLine[stop]; }        // -1 means a hub
+    bool            GetStopIsTerminal(int stop) const { return m_stopTerminal[stop] != 0; }
+    StructureType   GetStopStructure(int stop) const { return m_stopStructure[stop]; }
 
-    int GetPath(int stopA, int stopB, int path[]);
+    // The rails leaving a stop, in the order the rails were created.
+    int             GetNumNeighbors(int stop) const { return m_edgeStart[stop + 1] - m_edgeStart[stop]; }
+    int             GetNeighbor(int stop, int i) const { return m_edgeStop[m_edgeStart[stop] + i]; }
+    int             GetNeighborLine(int stop, int i) const { return m_edgeLine[m_edgeStart[stop] + i]; }
+    float           GetNeighborDistance(int stop, int i) const { return m_edgeLength[m_edgeStart[stop] + i]; }
+    bool            GetIsConnected(int stopA, int stopB) const { return GetLineBetween(stopA, stopB) != -1; }
+
+    int             GetNumRails() const { return static_cast<int>(m_railStop1.size()); }
+    Rail            GetRail(int rail) const;
+
+    int GetStopForPoint(const Vec2& point) const;
+    int GetNearestStopForPoint(const Vec2& point) const;
+
+    // Returns -1 if the stops aren't adjacent.
+    int GetLineBetween(int stopA, int stopB) const;
+    unsigned long GetLineColor(int line) const;
 
 private:
 
+    struct Section
+    {
+        void*   data;
+        size_t  size;
+    };
+
+    enum { kNumSections = 14 };
+
+    // Fills in the arrays that are saved, in the order they're saved.
+    void GetSections(Section sections[kNumSections]);
+    unsigned int ComputeHash() const;
+    bool GetIsValid() const;
+    void Clear();
+
     int  AddStop(const Vec2& point, int line, bool terminal = false);
     int  MergeStop(const Vec2& point, int line, float distance);
 
+    // Returns the lowest numbered stop closer than distance to the point, or
+    // -1 if there isn't one.
+    int  FindStop(const Vec2& point, float distance, bool includeTerminals) const;
+
+    // Returns the closest stop to the point. If stopGroup isn't NULL only
+    // stops below numGroupStops whose entry is group are considered.
+    int  FindNearestStop(const Vec2& point, const int* stopGroup, int numGroupStops, int group) const;
+
+    void InitializeGrid(int xSize, int ySize);
+    void AddStopToGrid(int stop);
+    int  GetCellX(float x) const;
+    int  GetCellY(float y) const;
+
     void Connect(int stop1, int stop2, int line);
+    void AddRail(int stop1, int stop2, int line);
 
-    void GenerateLine(int xSize, int ySize, int stopIndex, Random& random);
+    // Returns the lowest numbered rail that the segment between two stops
+    // crosses, or -1 if there isn't one.
+    int  FindCrossingRail(int stop1, int stop2, Vec2& crossing);
+    void AddRailToGrid(int rail);
+    void ReleaseRailGrid();
 
-    void EnforceRailConstraint(Rail& rail) const;
-    void StraightenStop(Stop& stop);
+    void GenerateLine(int xSize, int ySize, int stopIndex, const MapParams& params, Random& random);
+    void GenerateRing(int xNumTiles, int yNumTiles, float radius, int numStops, int line);
+    void JoinComponents();
+
+    void EnforceRailConstraint(int rail);
+    void BuildEdges();
+    void StraightenStop(int stop);
 
     void PlaceStructures(StructureType structureType, int number, Random& random);
 
 private:
 
-    int     m_numStops;
-    Stop    m_stop[s_maxStops];
-
-    int     m_numRails;
-    Rail    m_rail[s_maxRails];
-
-    int     m_numRiverVertices;
-    Vec2    m_riverVertex[s_maxRiverVertices];
+    int                             m_xSize;
+    int                             m_ySize;
+    int                             m_seed;
+    unsigned int                    m_hash;
+
+    std::vector<Vec2>               m_stopPoint;
+    std::vector<int>                m_stopLine;
+    std::vector<char>               m_stopTerminal;     // End of the line buddy
+    std::vector<StructureType>      m_stopStructure;
+
+    std::vector<int>                m_railStop1;        // Always less than m_railStop2
+    std::vector<int>                m_railStop2;
+    std::vector<int>                m_railLine;
+
+    // The rail graph in compressed sparse row form, built once the map has
+    // been generated. The edges leaving stop i are m_edgeStart[i] up to
+    // m_edgeStart[i + 1]; each rail gives an edge in both directions.
+    std::vector<int>                m_edgeStart;
+    std::vector<int>                m_edgeStop;
+    std::vector<int>                m_edgeLine;
+    std::vector<float>              m_edgeLength;
+
+    std::vector<Vec2>               m_riverVertex;
+
+    // Uniform grid over the stops so point queries only look at nearby
+    // stops. Each cell holds a linked list of the stops inside it.
+    int                             m_xNumCells;
+    int                             m_yNumCells;
+    std::vector<int>                m_cellFirstStop;    // -1 if the cell is empty
+    std::vector<int>                m_nextStopInCell;   // -1 at the end of the list
+
+    // The same grid for the rails while the map is generated. A rail is
+    // listed in every cell its bounding box overlaps.
+    std::vector<int>                m_cellFirstRail;    // -1 if the cell is empty
+    std::vector<int>                m_railNodeRail;
+    std::vector<int>                m_railNodeNext;     // -1 at the end of the list
+    std::vector<unsigned int>       m_railStamp;        // Last query that checked the rail
+    unsigned int                    m_railQuery;
 
 };
 
@@ -0,0 +1,251 @@
+#include "MapCache.h"
+#include "MappedFile.h"
+#include "Map.h"
+#include "Log.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#ifdef WIN32
+#include <windows.h>
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <utime.h>
+#endif
+
+static const char* const kCacheDirectory = "cache";
+
+// The buffer must hold at least kMaxFileName characters.
+static const int kMaxFileName = 64;
+
+// Only this many maps are kept; the ones used least recently are deleted.
+static const int kMaxCachedMaps = 16;
+
+struct CachedFile
+{
+    std::string name;
+    time_t      time;
+};
+
+static bool CompareCachedFiles(const CachedFile& a, const CachedFile& b)
+{
+    return a.time > b.time;
+}
+
+// Hashes each field separately so padding in the struct doesn't matter.
+static unsigned int GetParamsHash(const MapParams& params)
+{
+
+    int values[] =
+        {
+            params.numLines,
+            params.lineLength,
+            params.edgeTerminals,
+            params.numRings,
+            static_cast<int>(params.ringSpacing * 1000.0f),
+            params.joinComponents,
+            params.numBanks,
+            params.numPolice,
+            params.numTowers,
+        };
+
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        hash = (hash ^ static_cast<unsigned int>(values[i])) * 16777619u;
+    }
+    return hash;
+
+}
+
+static void GetFileName(char* fileName, int xSize, int ySize, int seed, const MapParams& params)
+{
+    sprintf(fileName, "%s/map_%dx%d_%d_%08x.bin", kCacheDirectory, xSize, ySize, seed, GetParamsHash(params));
+}
+
+// Lists the maps in the cache with the time each was last used.
+static void GetCachedFiles(std::vector<CachedFile>& files)
+{
+
+    files.clear();
+
+#ifdef WIN32
+
+    char pattern[kMaxFileName];
+    sprintf(pattern, "%s/map_*.bin", kCacheDirectory);
+
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        ULARGE_INTEGER time;
+        time.LowPart  = data.ftLastWriteTime.dwLowDateTime;
+        time.HighPart = data.ftLastWriteTime.dwHighDateTime;
+
+        CachedFile file;
+        file.name = std::string(kCacheDirectory) + "/" + data.cFileName;
+        file.time = static_cast<time_t>(time.QuadPart / 10000000);
+        files.push_back(file);
+    }
+    while (FindNextFileA(find, &data));
+
+    FindClose(find);
+
+#else
+
+    DIR* directory = opendir(kCacheDirectory);
+    if (directory == NULL)
+    {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "map_", 4) != 0 || strcmp(entry->d_name + length - 4, ".bin") != 0)
+        {
+            continue;
+        }
+
+        CachedFile file;
+        file.name = std::string(kCacheDirectory) + "/" + entry->d_name;
+
+        struct stat status;
+        if (stat(file.name.c_str(), &status) != 0)
+        {
+            continue;
+        }
+        file.time = status.st_mtime;
+        files.push_back(file);
+    }
+
+    closedir(directory);
+
+#endif
+
+}
+
+// Deletes the least recently used maps until there are at most
+// kMaxCachedMaps left.
+static void TrimCache()
+{
+
+    std::vector<CachedFile> files;
+    GetCachedFiles(files);
+
+    if (static_cast<int>(files.size()) <= kMaxCachedMaps)
+    {
+        return;
+    }
+
+    std::sort(files.begin(), files.end(), CompareCachedFiles);
+    for (size_t i = kMaxCachedMaps; i < files.size(); ++i)
+    {
+        LogDebug("Removing cached map '%s'", files[i].name.c_str());
+        remove(files[i].name.c_str());
+    }
+
+}
+
+static bool LoadMap(Map& map, int xSize, int ySize, int seed, const MapParams& params)
+{
+
+    char fileName[kMaxFileName];
+    GetFileName(fileName, xSize, ySize, seed, params);
+
+    MappedFile file;
+    if (!file.Open(fileName))
+    {
+        return false;
+    }
+
+    if (!map.Load(file.GetData(), file.GetSize()) ||
+        map.GetXSize() != xSize || map.GetYSize() != ySize || map.GetSeed() != seed)
+    {
+        LogDebug("Ignoring stale cached map '%s'", fileName);
+        return false;
+    }
+
+    file.Close();
+
+    // The modification time marks when the map was last used, so it isn't
+    // the first to go when the cache is trimmed.
+    utime(fileName, NULL);
+
+    return true;
+
+}
+
+bool MapCache_Generate(Map& map, int xSize, int ySize, int seed, const MapParams& params)
+{
+
+    if (LoadMap(map, xSize, ySize, seed, params))
+    {
+        return true;
+    }
+
+    map.Generate(xSize, ySize, seed, params);
+    MapCache_Store(map, params);
+    return false;
+
+}
+
+void MapCache_Store(const Map& map, const MapParams& params)
+{
+
+#ifdef WIN32
+    _mkdir(kCacheDirectory);
+#else
+    mkdir(kCacheDirectory, 0755);
+#endif
+
+    char fileName[kMaxFileName];
+    GetFileName(fileName, map.GetXSize(), map.GetYSize(), map.GetSeed(), params);
+
+    // Write to a temporary file first so a reader never maps a partly
+    // written map.
+    char tempFileName[kMaxFileName + 4];
+    sprintf(tempFileName, "%s.tmp", fileName);
+
+    std::vector<unsigned char> data;
+    map.Save(data);
+
+    FILE* file = fopen(tempFileName, "wb");
+    if (file == NULL)
+    {
+        LogError("Couldn't write the map cache file '%s'", tempFileName);
+        return;
+    }
+
+    bool written = fwrite(&data[0], 1, data.size(), file) == data.size();
+    written = fclose(file) == 0 && written;
+
+#ifdef WIN32
+    // rename doesn't replace existing files on Windows.
+    remove(fileName);
+#endif
+
+    if (!written || rename(tempFileName, fileName) != 0)
+    {
+        LogError("Couldn't write the map cache file '%s'", fileName);
+        remove(tempFileName);
+        return;
+    }
+
+    TrimCache();
+
+}
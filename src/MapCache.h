@@ -0,0 +1,19 @@
+#ifndef GAME_MAP_CACHE_H
+#define GAME_MAP_CACHE_H
+
+#include "Map.h"
+
+/**
+ * Loads a map from the cache on disk if it was saved before, otherwise
+ * generates it and saves it for next time. Returns true if the map came from
+ * the cache. Maps are cached by size, seed and generation parameters.
+ */
+bool MapCache_Generate(Map& map, int xSize, int ySize, int seed, const MapParams& params = MapParams());
+
+/**
+ * Saves the map to the cache, replacing any map with the same key. The cache
+ * only keeps the most recently used maps; older ones are deleted.
+ */
+void MapCache_Store(const Map& map, const MapParams& params = MapParams());
+
+#endif
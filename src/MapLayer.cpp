@@ -0,0 +1,628 @@
+#include "MapLayer.h"
+#include "Map.h"
+#include "Font.h"
+#include "Render.h"
+#include "SpriteBatch.h"
+#include "Utility.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <assert.h>
+
+// Size of the square chunks the map is split into (in world units).
+static const int kChunkSize = 600;
+
+// Smallest number of world units per pixel each level of detail is used at.
+// Rails are simplified to within a pixel at that scale.
+static const float kLodScale[] = { 0.0f, 4.0f, 8.0f };
+
+// Largest radius of anything drawn at a stop or width of a rail (in world
+// units), used to pad the bounds of the chunks.
+static const float kStopRadius = 8.0f;
+
+// Closest the grid labels are allowed to get on screen (in pixels); further
+// out only every second, fourth, ... row and column is labeled.
+static const int kMinLabelSpacing = 40;
+
+MapLayer::MapLayer()
+{
+    m_lists         = 0;
+    m_xMapSize      = 0;
+    m_yMapSize      = 0;
+    m_gridSpacing   = 1;
+    m_xChunks       = 0;
+    m_yChunks       = 0;
+    m_overhang      = 0.0f;
+    m_xViewMin      = 0.0f;
+    m_yViewMin      = 0.0f;
+    m_xViewMax      = 0.0f;
+    m_yViewMax      = 0.0f;
+    m_scale         = 1.0f;
+    m_lod           = 0;
+}
+
+MapLayer::~MapLayer()
+{
+    Destroy();
+}
+
+void MapLayer::Build(const Map& map, int xMapSize, int yMapSize, int gridSpacing, const Font& font)
+{
+
+    Destroy();
+
+    m_xMapSize      = xMapSize;
+    m_yMapSize      = yMapSize;
+    m_gridSpacing   = gridSpacing;
+
+    m_xChunks = xMapSize / kChunkSize + 1;
+    m_yChunks = yMapSize / kChunkSize + 1;
+    m_chunks.resize(m_xChunks * m_yChunks);
+    for (size_t i = 0; i < m_chunks.size(); ++i)
+    {
+        Chunk& chunk = m_chunks[i];
+        chunk.xMin = FLT_MAX;
+        chunk.yMin = FLT_MAX;
+        chunk.xMax = -FLT_MAX;
+        chunk.yMax = -FLT_MAX;
+    }
+
+    m_lists = glGenLists(1 + static_cast<GLsizei>(m_chunks.size()) * List_Count);
+
+    glNewList(m_lists, GL_COMPILE);
+    BuildBackground();
+    glEndList();
+
+    BuildChunks(map);
+    BuildLegend(font);
+
+    m_overhang = 0.0f;
+    for (int y = 0; y < m_yChunks; ++y)
+    {
+        for (int x = 0; x < m_xChunks; ++x)
+        {
+            const Chunk& chunk = m_chunks[x + y * m_xChunks];
+            if (chunk.xMin <= chunk.xMax)
+            {
+                m_overhang = Max(m_overhang, static_cast<float>(x * kChunkSize) - chunk.xMin);
+                m_overhang = Max(m_overhang, static_cast<float>(y * kChunkSize) - chunk.yMin);
+                m_overhang = Max(m_overhang, chunk.xMax - static_cast<float>((x + 1) * kChunkSize));
+                m_overhang = Max(m_overhang, chunk.yMax - static_cast<float>((y + 1) * kChunkSize));
+            }
+        }
+    }
+
+}
+
+void MapLayer::Destroy()
+{
+    if (m_lists != 0)
+    {
+        glDeleteLists(m_lists, 1 + static_cast<GLsizei>(m_chunks.size()) * List_Count);
+        m_lists = 0;
+    }
+    m_chunks.clear();
+    m_visibleChunks.clear();
+    m_visibleStructures.clear();
+    m_columnLabels.clear();
+    m_rowLabels.clear();
+}
+
+void MapLayer::SetView(float xMin, float yMin, float xMax, float yMax, float scale)
+{
+
+    m_xViewMin  = xMin;
+    m_yViewMin  = yMin;
+    m_xViewMax  = xMax;
+    m_yViewMax  = yMax;
+    m_scale     = scale;
+
+    m_lod = 0;
+    while (m_lod + 1 < kNumLods && scale >= kLodScale[m_lod + 1])
+    {
+        ++m_lod;
+    }
+
+    m_visibleChunks.clear();
+    m_visibleStructures.clear();
+
+    if (m_chunks.empty())
+    {
+        return;
+    }
+
+    // Only the squares near the view can have bounds overlapping it.
+    int xFirst = Max(static_cast<int>(floorf((xMin - m_overhang) / kChunkSize)), 0);
+    int yFirst = Max(static_cast<int>(floorf((yMin - m_overhang) / kChunkSize)), 0);
+    int xLast  = Min(static_cast<int>(floorf((xMax + m_overhang) / kChunkSize)), m_xChunks - 1);
+    int yLast  = Min(static_cast<int>(floorf((yMax + m_overhang) / kChunkSize)), m_yChunks - 1);
+
+    for (int y = yFirst; y <= yLast; ++y)
+    {
+        for (int x = xFirst; x <= xLast; ++x)
+        {
+            int index = x + y * m_xChunks;
+            const Chunk& chunk = m_chunks[index];
+            if (chunk.xMax >= xMin && chunk.xMin <= xMax &&
+                chunk.yMax >= yMin && chunk.yMin <= yMax)
+            {
+                m_visibleChunks.push_back(index);
+                m_visibleStructures.insert(m_visibleStructures.end(), chunk.structures.begin(), chunk.structures.end());
+            }
+        }
+    }
+
+}
+
+bool MapLayer::GetIsVisible(const Vec2& point, float radius) const
+{
+    return point.x + radius >= m_xViewMin && point.x - radius <= m_xViewMax &&
+           point.y + radius >= m_yViewMin && point.y - radius <= m_yViewMax;
+}
+
+const std::vector<int>& MapLayer::GetVisibleStructures() const
+{
+    return m_visibleStructures;
+}
+
+void MapLayer::Draw(Layer layer) const
+{
+
+    if (m_lists == 0)
+    {
+        return;
+    }
+
+    switch (layer)
+    {
+    case Layer_Background:
+        glCallList(m_lists);
+        break;
+    case Layer_Rails:
+        for (size_t i = 0; i < m_visibleChunks.size(); ++i)
+        {
+            glCallList(GetList(m_visibleChunks[i], List_Rails + m_lod));
+        }
+        break;
+    case Layer_Stops:
+        for (size_t i = 0; i < m_visibleChunks.size(); ++i)
+        {
+            glCallList(GetList(m_visibleChunks[i], List_Stops + m_lod));
+        }
+        break;
+    default:
+        assert(0);
+        break;
+    }
+
+}
+
+void MapLayer::BuildBackground()
+{
+
+    const int outerBorder = s_outerBorder;
+
+    // Draw the background.
+    glColor(0xFFFFFFFF);
+    glBegin(GL_QUADS);
+    glVertex2i(-outerBorder, -outerBorder);
+    glVertex2i(m_xMapSize + outerBorder, -outerBorder);
+    glVertex2i(m_xMapSize + outerBorder, m_yMapSize + outerBorder);
+    glVertex2i(-outerBorder, m_yMapSize + outerBorder);
+    glEnd();
+
+    // Outer thick border of the map
+    glColor(0xFF7FD6F2);
+    glLineWidth(2);
+    glBegin(GL_LINE_LOOP);
+    glVertex2i(-outerBorder, -outerBorder);
+    glVertex2i(m_xMapSize + outerBorder, -outerBorder);
+    glVertex2i(m_xMapSize + outerBorder, m_yMapSize + outerBorder);
+    glVertex2i(-outerBorder, m_yMapSize + outerBorder);
+    glEnd();
+
+    // Grid
+    glColor(0xFF7FD6F2);
+    glLineWidth(1);
+    glBegin(GL_LINES);
+    for (int x = 0; x < m_xMapSize / m_gridSpacing; ++x)
+    {
+        glVertex2i(x * m_gridSpacing, 0);
+        glVertex2i(x * m_gridSpacing, m_yMapSize);
+    }
+    glVertex2i(m_xMapSize, 0);
+    glVertex2i(m_xMapSize, m_yMapSize);
+    for (int y = 0; y < m_yMapSize / m_gridSpacing; ++y)
+    {
+        glVertex2i(0, y * m_gridSpacing);
+        glVertex2i(m_xMapSize, y * m_gridSpacing);
+    }
+    glVertex2i(0, m_yMapSize);
+    glVertex2i(m_xMapSize, m_yMapSize);
+    glEnd();
+
+}
+
+void MapLayer::BuildChunks(const Map& map)
+{
+
+    // Sort the geometry into the chunks first, since the lists have to be
+    // compiled one at a time.
+    std::vector<SegmentList> segments[kNumLods];
+    for (int lod = 0; lod < kNumLods; ++lod)
+    {
+        segments[lod].resize(m_chunks.size());
+    }
+
+    // The most detailed level has every rail as it is.
+    for (int i = 0; i < map.GetNumRails(); ++i)
+    {
+        Rail rail = map.GetRail(i);
+        assert(rail.line >= 0);
+        if (rail.stop1 == rail.stop2)
+        {
+            continue;
+        }
+        Segment segment;
+        segment.point1 = map.GetStopPoint(rail.stop1);
+        segment.point2 = map.GetStopPoint(rail.stop2);
+        // Draw the rails partially transparent to make the buldings more readable.
+        segment.color  = (map.GetLineColor(rail.line) & 0x00FFFFFF) | 0x90000000;
+
+        int chunk = GetChunk(0.5f * (segment.point1 + segment.point2));
+        AddToChunk(chunk, segment.point1, kStopRadius);
+        AddToChunk(chunk, segment.point2, kStopRadius);
+        segments[0][chunk].push_back(segment);
+    }
+
+    BuildLineChains(map, segments);
+
+    std::vector<std::vector<int> > stops(m_chunks.size());
+    for (int i = 0; i < map.GetNumStops(); ++i)
+    {
+        const Vec2& point = map.GetStopPoint(i);
+        int chunk = GetChunk(point);
+        AddToChunk(chunk, point, kStopRadius);
+        stops[chunk].push_back(i);
+        if (map.GetStopStructure(i) != StructureType_None)
+        {
+            m_chunks[chunk].structures.push_back(i);
+        }
+    }
+
+    for (int chunk = 0; chunk < static_cast<int>(m_chunks.size()); ++chunk)
+    {
+
+        for (int lod = 0; lod < kNumLods; ++lod)
+        {
+
+            const SegmentList& list = segments[lod][chunk];
+
+            glNewList(GetList(chunk, List_Rails + lod), GL_COMPILE);
+            glBegin(GL_LINES);
+            for (size_t i = 0; i < list.size(); ++i)
+            {
+                glColor( list[i].color );
+                glVertex( list[i].point1 );
+                glVertex( list[i].point2 );
+            }
+            glEnd();
+            glEndList();
+
+            glNewList(GetList(chunk, List_Stops + lod), GL_COMPILE);
+            for (size_t i = 0; i < stops[chunk].size(); ++i)
+            {
+                int stop = stops[chunk][i];
+                if (!GetIsStopDrawn(map, stop, lod))
+                {
+                    continue;
+                }
+
+                const Vec2& point = map.GetStopPoint(stop);
+                int line = map.GetStopLine(stop);
+                if (line == -1)
+                {
+                    glColor( 0xFF000000 );
+                    Render_DrawCircle(point, 8.0f);
+                    glColor( 0xFFFFFFFF );
+                    Render_DrawCircle(point, 6.0f);
+                }
+                else
+                {
+                    glColor( map.GetLineColor(line) );
+                    Render_DrawCircle(point, 8.0f);
+                }
+            }
+            glEndList();
+
+        }
+
+    }
+
+}
+
+void MapLayer::BuildLineChains(const Map& map, std::vector<SegmentList>* segments)
+{
+
+    // Index the rails by the stops at either end.
+    const int numStops = map.GetNumStops();
+    const int numRails = map.GetNumRails();
+
+    std::vector<int> railStart(numStops + 1, 0);
+    for (int i = 0; i < numRails; ++i)
+    {
+        Rail rail = map.GetRail(i);
+        if (rail.stop1 != rail.stop2)
+        {
+            ++railStart[rail.stop1 + 1];
+            ++railStart[rail.stop2 + 1];
+        }
+    }
+    for (int i = 0; i < numStops; ++i)
+    {
+        railStart[i + 1] += railStart[i];
+    }
+    std::vector<int> stopRails(railStart[numStops]);
+    std::vector<int> fill(railStart.begin(), railStart.end() - 1);
+    for (int i = 0; i < numRails; ++i)
+    {
+        Rail rail = map.GetRail(i);
+        if (rail.stop1 != rail.stop2)
+        {
+            stopRails[fill[rail.stop1]++] = i;
+            stopRails[fill[rail.stop2]++] = i;
+        }
+    }
+
+    // Walk each line from the stops where it ends or branches to the next
+    // such stop, giving chains of rails that can be simplified as one
+    // polyline. Whatever is left over forms loops, which are started at any
+    // stop.
+    std::vector<char> used(numRails, 0);
+    std::vector<Vec2> points;
+    std::vector<Vec2> simplified;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int stop = 0; stop < numStops; ++stop)
+        {
+            for (int j = railStart[stop]; j < railStart[stop + 1]; ++j)
+            {
+
+                int rail = stopRails[j];
+                if (used[rail])
+                {
+                    continue;
+                }
+
+                int line = map.GetRail(rail).line;
+
+                int degree = 0;
+                for (int k = railStart[stop]; k < railStart[stop + 1]; ++k)
+                {
+                    if (map.GetRail(stopRails[k]).line == line)
+                    {
+                        ++degree;
+                    }
+                }
+                if (pass == 0 && degree == 2)
+                {
+                    continue;
+                }
+
+                points.clear();
+                points.push_back(map.GetStopPoint(stop));
+
+                int current = stop;
+                while (rail != -1)
+                {
+
+                    used[rail] = 1;
+                    Rail r = map.GetRail(rail);
+                    current = (r.stop1 == current) ? r.stop2 : r.stop1;
+                    points.push_back(map.GetStopPoint(current));
+
+                    // Carry on through stops where the line just passes through.
+                    int next = -1;
+                    degree = 0;
+                    for (int k = railStart[current]; k < railStart[current + 1]; ++k)
+                    {
+                        int other = stopRails[k];
+                        if (map.GetRail(other).line == line)
+                        {
+                            ++degree;
+                            if (!used[other])
+                            {
+                                next = other;
+                            }
+                        }
+                    }
+                    rail = (degree == 2) ? next : -1;
+
+                }
+
+                unsigned long color = (map.GetLineColor(line) & 0x00FFFFFF) | 0x90000000;
+
+                for (int lod = 1; lod < kNumLods; ++lod)
+                {
+                    Simplify(points, kLodScale[lod], simplified);
+                    for (size_t k = 0; k + 1 < simplified.size(); ++k)
+                    {
+                        Segment segment;
+                        segment.point1 = simplified[k];
+                        segment.point2 = simplified[k + 1];
+                        segment.color  = color;
+
+                        int chunk = GetChunk(0.5f * (segment.point1 + segment.point2));
+                        AddToChunk(chunk, segment.point1, kStopRadius);
+                        AddToChunk(chunk, segment.point2, kStopRadius);
+                        segments[lod][chunk].push_back(segment);
+                    }
+                }
+
+            }
+        }
+    }
+
+}
+
+void MapLayer::Simplify(const std::vector<Vec2>& points, float tolerance, std::vector<Vec2>& result)
+{
+
+    // Douglas-Peucker: keep the point furthest from the segment between the
+    // ends of each span if it's further than the tolerance and split the
+    // span there.
+    const int numPoints = static_cast<int>(points.size());
+    std::vector<char> keep(numPoints, 0);
+    keep[0] = 1;
+    keep[numPoints - 1] = 1;
+
+    std::vector<int> spans;
+    spans.push_back(0);
+    spans.push_back(numPoints - 1);
+
+    while (!spans.empty())
+    {
+
+        int last  = spans.back();
+        spans.pop_back();
+        int first = spans.back();
+        spans.pop_back();
+
+        const Vec2& a = points[first];
+        const Vec2 ab = points[last] - a;
+        const float lengthSquared = DotProduct(ab, ab);
+
+        float maxDistance = tolerance;
+        int   furthest = -1;
+
+        for (int i = first + 1; i < last; ++i)
+        {
+            Vec2 ap = points[i] - a;
+            float t = lengthSquared > 0.0f ? Clamp(DotProduct(ap, ab) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+            float distance = Length(ap - t * ab);
+            if (distance > maxDistance)
+            {
+                maxDistance = distance;
+                furthest = i;
+            }
+        }
+
+        if (furthest != -1)
+        {
+            keep[furthest] = 1;
+            spans.push_back(first);
+            spans.push_back(furthest);
+            spans.push_back(furthest);
+            spans.push_back(last);
+        }
+
+    }
+
+    result.clear();
+    for (int i = 0; i < numPoints; ++i)
+    {
+        if (keep[i])
+        {
+            result.push_back(points[i]);
+        }
+    }
+
+}
+
+bool MapLayer::GetIsStopDrawn(const Map& map, int stop, int lod)
+{
+    // Zoomed out a little the stops along the lines are only a couple of
+    // pixels across, so only the hubs are kept; further out there are none.
+    switch (lod)
+    {
+    case 0:
+        return true;
+    case 1:
+        return map.GetStopLine(stop) == -1;
+    }
+    return false;
+}
+
+void MapLayer::BuildLegend(const Font& font)
+{
+
+    m_columnLabels.resize(m_xMapSize / m_gridSpacing);
+    for (size_t x = 0; x < m_columnLabels.size(); ++x)
+    {
+        char buffer[32];
+        sprintf(buffer, "%d", static_cast<int>(x));
+        m_columnLabels[x].Set(font, buffer);
+    }
+
+    m_rowLabels.resize(m_yMapSize / m_gridSpacing);
+    for (size_t y = 0; y < m_rowLabels.size(); ++y)
+    {
+        char buffer[32];
+        sprintf(buffer, "%c", 'A' + static_cast<int>(y));
+        m_rowLabels[y].Set(font, buffer);
+    }
+
+}
+
+void MapLayer::DrawLegend(SpriteBatch& batch) const
+{
+
+    const int outerBorder = s_outerBorder;
+    const int numColumns  = static_cast<int>(m_columnLabels.size());
+    const int numRows     = static_cast<int>(m_rowLabels.size());
+
+    int step = 1;
+    while (m_gridSpacing * step < kMinLabelSpacing * m_scale)
+    {
+        step *= 2;
+    }
+
+    // Only the labels for the rows and columns in view, starting from a
+    // multiple of step so the labels don't move around when panning.
+    int xFirst = Max(static_cast<int>(floorf(m_xViewMin / m_gridSpacing)), 0);
+    int xLast  = Min(static_cast<int>(floorf(m_xViewMax / m_gridSpacing)), numColumns - 1);
+    int yFirst = Max(static_cast<int>(floorf(m_yViewMin / m_gridSpacing)), 0);
+    int yLast  = Min(static_cast<int>(floorf(m_yViewMax / m_gridSpacing)), numRows - 1);
+    xFirst -= xFirst % step;
+    yFirst -= yFirst % step;
+
+    batch.SetColor(0xFF7FD6F2);
+    for (int x = xFirst; x <= xLast; x += step)
+    {
+        const TextLayout& label = m_columnLabels[x];
+        int xLabel = x * m_gridSpacing + m_gridSpacing / 2 - label.GetWidth() / 2;
+        batch.Draw(label, xLabel, -outerBorder + 5);
+        batch.Draw(label, xLabel, m_yMapSize + 5);
+    }
+    for (int y = yFirst; y <= yLast; y += step)
+    {
+        const TextLayout& label = m_rowLabels[y];
+        int yLabel = y * m_gridSpacing + m_gridSpacing / 2 - label.GetHeight() / 2;
+        batch.Draw(label, -outerBorder + 10, yLabel);
+        batch.Draw(label, m_xMapSize + 10, yLabel);
+    }
+
+}
+
+int MapLayer::GetChunk(const Vec2& point) const
+{
+    int x = Clamp(static_cast<int>(point.x) / kChunkSize, 0, m_xChunks - 1);
+    int y = Clamp(static_cast<int>(point.y) / kChunkSize, 0, m_yChunks - 1);
+    return x + y * m_xChunks;
+}
+
+void MapLayer::AddToChunk(int chunk, const Vec2& point, float radius)
+{
+    Chunk& c = m_chunks[chunk];
+    c.xMin = Min(c.xMin, point.x - radius);
+    c.yMin = Min(c.yMin, point.y - radius);
+    c.xMax = Max(c.xMax, point.x + radius);
+    c.yMax = Max(c.yMax, point.y + radius);
+}
+
+GLuint MapLayer::GetList(int chunk, int list) const
+{
+    return m_lists + 1 + chunk * List_Count + list;
+}
@@ -0,0 +1,135 @@
+#ifndef GAME_MAP_LAYER_H
+#define GAME_MAP_LAYER_H
+
+#include "OpenGL.h"
+#include "TextLayout.h"
+
+#include <vector>
+
+class Map;
+class SpriteBatch;
+struct Font;
+
+/**
+ * The parts of the map that don't change once it's generated (background,
+ * grid, rails and stops), compiled into display lists so drawing them each
+ * frame doesn't resend the geometry. The lists are in world coordinates, so
+ * panning and zooming only change the projection.
+ *
+ * The rails and stops are split into square chunks of the map so only the
+ * chunks overlapping the view are drawn, and each chunk has a version of its
+ * lists for every level of detail. Further out the rails are simplified and
+ * the smaller stops are left out, so the cost of drawing the map follows what
+ * is on screen rather than the size of the map.
+ */
+class MapLayer
+{
+
+public:
+
+    enum Layer
+    {
+        Layer_Background,   // Map background, border and grid
+        Layer_Rails,        // Drawn with the current line width
+        Layer_Stops,
+        Layer_Count,
+    };
+
+    // Distance from the edge of the map to the border.
+    static const int s_outerBorder = 35;
+
+    MapLayer();
+    ~MapLayer();
+
+    // Compiles the lists for the map. Must be called again when the map
+    // changes.
+    void Build(const Map& map, int xMapSize, int yMapSize, int gridSpacing, const Font& font);
+    void Destroy();
+
+    // Sets the part of the world that's on screen and the number of world
+    // units per pixel, which picks the level of detail.
+    void SetView(float xMin, float yMin, float xMax, float yMax, float scale);
+
+    // Returns true if a circle around the point overlaps the view.
+    bool GetIsVisible(const Vec2& point, float radius) const;
+
+    // Stops with a structure in the chunks overlapping the view.
+    const std::vector<int>& GetVisibleStructures() const;
+
+    void Draw(Layer layer) const;
+
+    // Adds the labels for the visible rows and columns of the grid to a
+    // batch which has already begun.
+    void DrawLegend(SpriteBatch& batch) const;
+
+private:
+
+    enum { kNumLods = 3 };
+
+    // Display lists compiled for each chunk.
+    enum List
+    {
+        List_Rails,
+        List_Stops  = List_Rails + kNumLods,
+        List_Count  = List_Stops + kNumLods,
+    };
+
+    struct Chunk
+    {
+        // Bounds of everything drawn by the chunk; rails can reach outside
+        // of the chunk's square.
+        float               xMin;
+        float               yMin;
+        float               xMax;
+        float               yMax;
+        std::vector<int>    structures;
+    };
+
+    struct Segment
+    {
+        Vec2                point1;
+        Vec2                point2;
+        unsigned long       color;
+    };
+
+    typedef std::vector<Segment> SegmentList;
+
+    static void Simplify(const std::vector<Vec2>& points, float tolerance, std::vector<Vec2>& result);
+    static bool GetIsStopDrawn(const Map& map, int stop, int lod);
+
+    void BuildBackground();
+    void BuildChunks(const Map& map);
+    void BuildLineChains(const Map& map, std::vector<SegmentList>* segments);
+    void BuildLegend(const Font& font);
+
+    int  GetChunk(const Vec2& point) const;
+    void AddToChunk(int chunk, const Vec2& point, float radius);
+    GLuint GetList(int chunk, int list) const;
+
+private:
+
+    GLuint              m_lists;        // Background list followed by List_Count per chunk, or 0
+    int                 m_xMapSize;
+    int                 m_yMapSize;
+    int                 m_gridSpacing;
+
+    int                 m_xChunks;
+    int                 m_yChunks;
+    std::vector<Chunk>  m_chunks;
+    float               m_overhang;     // Furthest any chunk's bounds reach past its square
+
+    std::vector<TextLayout> m_columnLabels;
+    std::vector<TextLayout> m_rowLabels;
+
+    float               m_xViewMin;
+    float               m_yViewMin;
+    float               m_xViewMax;
+    float               m_yViewMax;
+    float               m_scale;
+    int                 m_lod;
+    std::vector<int>    m_visibleChunks;
+    std::vector<int>    m_visibleStructures;
+
+};
+
+#endif
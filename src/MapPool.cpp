@@ -0,0 +1,252 @@
+#include "MapPool.h"
+#include "Map.h"
+#include "Timer.h"
+#include "Log.h"
+
+#include <SDL.h>
+
+#include <time.h>
+
+// If this many maps in a row are rejected the generator probably can't make
+// a valid map of this size, so the workers give up rather than spin.
+static const int kMaxRejectedInRow = 64;
+
+MapPool::MapPool()
+{
+    m_xSize             = 0;
+    m_ySize             = 0;
+    m_size              = 0;
+    m_mutex             = SDL_CreateMutex();
+    m_wake              = SDL_CreateCond();
+    m_quit              = false;
+    m_nextSeed          = 0;
+    m_numInProgress     = 0;
+    m_numGenerated      = 0;
+    m_numRejected       = 0;
+    m_numRejectedInRow  = 0;
+    m_generationTime    = 0.0;
+}
+
+MapPool::~MapPool()
+{
+
+    Stop();
+
+    for (size_t i = 0; i < m_ready.size(); ++i)
+    {
+        delete m_ready[i];
+    }
+    for (size_t i = 0; i < m_free.size(); ++i)
+    {
+        delete m_free[i];
+    }
+
+    SDL_DestroyCond(m_wake);
+    SDL_DestroyMutex(m_mutex);
+
+}
+
+void MapPool::Start(int xSize, int ySize, int size, int numThreads)
+{
+
+    Stop();
+
+    // Maps left over from a different size are no use any more.
+    if (xSize != m_xSize || ySize != m_ySize)
+    {
+        m_free.insert(m_free.end(), m_ready.begin(), m_ready.end());
+        m_ready.clear();
+    }
+
+    m_xSize         = xSize;
+    m_ySize         = ySize;
+    m_size          = size;
+    m_quit          = false;
+    m_numRejectedInRow = 0;
+    m_nextSeed      = static_cast<int>(time(NULL));
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        SDL_Thread* thread = SDL_CreateThread(ThreadMain, this);
+        if (thread == NULL)
+        {
+            LogError("Failed to create a map pool thread: %s", SDL_GetError());
+            break;
+        }
+        m_threads.push_back(thread);
+    }
+
+}
+
+void MapPool::Stop()
+{
+
+    SDL_mutexP(m_mutex);
+    m_quit = true;
+    SDL_CondBroadcast(m_wake);
+    SDL_mutexV(m_mutex);
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        SDL_WaitThread(m_threads[i], NULL);
+    }
+    m_threads.clear();
+
+}
+
+bool MapPool::Take(Map& map, int xSize, int ySize)
+{
+
+    SDL_mutexP(m_mutex);
+
+    if (m_ready.empty() || xSize != m_xSize || ySize != m_ySize)
+    {
+        SDL_mutexV(m_mutex);
+        return false;
+    }
+
+    // The caller's old map goes back to the pool to be generated over.
+    Map* ready = m_ready.back();
+    m_ready.pop_back();
+    map.Swap(*ready);
+    m_free.push_back(ready);
+
+    SDL_CondSignal(m_wake);
+    SDL_mutexV(m_mutex);
+    return true;
+
+}
+
+int MapPool::GetNumReady() const
+{
+    SDL_mutexP(m_mutex);
+    int numReady = static_cast<int>(m_ready.size());
+    SDL_mutexV(m_mutex);
+    return numReady;
+}
+
+int MapPool::GetNumRejected() const
+{
+    SDL_mutexP(m_mutex);
+    int numRejected = m_numRejected;
+    SDL_mutexV(m_mutex);
+    return numRejected;
+}
+
+float MapPool::GetGenerationRate() const
+{
+    SDL_mutexP(m_mutex);
+    float rate = m_generationTime > 0.0 ? static_cast<float>(m_numGenerated / m_generationTime) : 0.0f;
+    SDL_mutexV(m_mutex);
+    return rate;
+}
+
+bool MapPool::GetIsValid(const Map& map)
+{
+
+    int numStops = map.GetNumStops();
+    if (numStops == 0)
+    {
+        return false;
+    }
+
+    bool placed[StructureType_House + 1] = { false };
+
+    // Breadth first search from the first stop.
+    std::vector<char> reached(numStops, 0);
+    std::vector<int> queue;
+    queue.reserve(numStops);
+    queue.push_back(0);
+    reached[0] = 1;
+
+    for (size_t i = 0; i < queue.size(); ++i)
+    {
+        int stop = queue[i];
+        placed[map.GetStopStructure(stop)] = true;
+        for (int j = 0; j < map.GetNumNeighbors(stop); ++j)
+        {
+            int neighbor = map.GetNeighbor(stop, j);
+            if (!reached[neighbor])
+            {
+                reached[neighbor] = 1;
+                queue.push_back(neighbor);
+            }
+        }
+    }
+
+    return static_cast<int>(queue.size()) == numStops &&
+           placed[StructureType_Bank] && placed[StructureType_Police] && placed[StructureType_Tower];
+
+}
+
+int MapPool::ThreadMain(void* data)
+{
+    static_cast<MapPool*>(data)->Run();
+    return 0;
+}
+
+void MapPool::Run()
+{
+
+    SDL_mutexP(m_mutex);
+
+    while (true)
+    {
+
+        while (!m_quit && static_cast<int>(m_ready.size()) + m_numInProgress >= m_size)
+        {
+            SDL_CondWait(m_wake, m_mutex);
+        }
+        if (m_quit)
+        {
+            break;
+        }
+
+        Map* map = NULL;
+        if (!m_free.empty())
+        {
+            map = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            map = new Map;
+        }
+        int seed = m_nextSeed++;
+        ++m_numInProgress;
+
+        SDL_mutexV(m_mutex);
+
+        double startTime = Timer_GetTime();
+        map->Generate(m_xSize, m_ySize, seed);
+        bool valid = GetIsValid(*map);
+        double time = Timer_GetTime() - startTime;
+
+        SDL_mutexP(m_mutex);
+
+        --m_numInProgress;
+        ++m_numGenerated;
+        m_generationTime += time;
+        if (valid)
+        {
+            m_numRejectedInRow = 0;
+            m_ready.push_back(map);
+        }
+        else
+        {
+            ++m_numRejected;
+            m_free.push_back(map);
+            if (++m_numRejectedInRow == kMaxRejectedInRow)
+            {
+                LogError("Stopping the map pool after %d invalid %d x %d maps in a row",
+                    kMaxRejectedInRow, m_xSize, m_ySize);
+                m_quit = true;
+                SDL_CondBroadcast(m_wake);
+            }
+        }
+
+    }
+
+    SDL_mutexV(m_mutex);
+
+}
@@ -0,0 +1,73 @@
+#ifndef GAME_MAP_POOL_H
+#define GAME_MAP_POOL_H
+
+#include <vector>
+
+class Map;
+struct SDL_Thread;
+struct SDL_mutex;
+struct SDL_cond;
+
+/**
+ * Generates maps on worker threads ahead of time so a new game can start
+ * without waiting for one. Maps that aren't fully connected or are missing
+ * a kind of structure are thrown away. Once the pool is full the workers
+ * sleep until a map is taken.
+ */
+class MapPool
+{
+
+public:
+
+    MapPool();
+    ~MapPool();
+
+    // Keeps size maps of the given dimensions ready, generated by numThreads
+    // worker threads.
+    void Start(int xSize, int ySize, int size, int numThreads);
+    void Stop();
+
+    // Swaps a ready map into map. Returns false if there isn't one ready or
+    // the maps in the pool have different dimensions.
+    bool Take(Map& map, int xSize, int ySize);
+
+    int     GetNumReady() const;
+    int     GetNumRejected() const;
+
+    // Maps generated per second of worker time, including rejected maps.
+    float   GetGenerationRate() const;
+
+    // Returns true if every stop can be reached from every other stop and
+    // each kind of structure has been placed.
+    static bool GetIsValid(const Map& map);
+
+private:
+
+    static int ThreadMain(void* data);
+    void Run();
+
+private:
+
+    int                     m_xSize;
+    int                     m_ySize;
+    int                     m_size;
+
+    std::vector<SDL_Thread*> m_threads;
+
+    // Everything below is shared with the worker threads and protected by
+    // m_mutex. m_wake is signalled when a map is taken or it's time to quit.
+    SDL_mutex*              m_mutex;
+    SDL_cond*               m_wake;
+    bool                    m_quit;
+    int                     m_nextSeed;
+    std::vector<Map*>       m_ready;
+    std::vector<Map*>       m_free;             // Maps given back by Take, reused by the workers
+    int                     m_numInProgress;
+    int                     m_numGenerated;
+    int                     m_numRejected;
+    int                     m_numRejectedInRow;
+    double                  m_generationTime;   // Total worker time spent generating
+
+};
+
+#endif
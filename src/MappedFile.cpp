@@ -0,0 +1,134 @@
+#include "MappedFile.h"
+#include "Log.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+    m_data      = NULL;
+    m_size      = 0;
+#ifdef WIN32
+    m_file      = INVALID_HANDLE_VALUE;
+    m_mapping   = NULL;
+#else
+    m_file      = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* fileName)
+{
+
+    Close();
+
+#ifdef WIN32
+
+    m_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0 || size.HighPart != 0)
+    {
+        Close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping == NULL)
+    {
+        LogError("Couldn't map '%s'", fileName);
+        Close();
+        return false;
+    }
+
+    m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    m_size = static_cast<size_t>(size.LowPart);
+
+#else
+
+    m_file = open(fileName, O_RDONLY);
+    if (m_file == -1)
+    {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(m_file, &status) != 0 || status.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    if (data != MAP_FAILED)
+    {
+        m_data = data;
+        m_size = static_cast<size_t>(status.st_size);
+    }
+
+#endif
+
+    if (m_data == NULL)
+    {
+        LogError("Couldn't map '%s'", fileName);
+        Close();
+        return false;
+    }
+
+    return true;
+
+}
+
+void MappedFile::Close()
+{
+
+#ifdef WIN32
+
+    if (m_data != NULL)
+    {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != NULL)
+    {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+
+#else
+
+    if (m_data != NULL)
+    {
+        munmap(const_cast<void*>(m_data), m_size);
+    }
+    if (m_file != -1)
+    {
+        close(m_file);
+        m_file = -1;
+    }
+
+#endif
+
+    m_data = NULL;
+    m_size = 0;
+
+}
@@ -0,0 +1,45 @@
+#ifndef GAME_MAPPED_FILE_H
+#define GAME_MAPPED_FILE_H
+
+#include <stddef.h>
+
+/**
+ * Maps a whole file into memory read-only, so its contents can be used in
+ * place without reading them into a buffer first.
+ */
+class MappedFile
+{
+
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    // Returns false if the file doesn't exist, is empty or can't be mapped.
+    bool Open(const char* fileName);
+    void Close();
+
+    bool        GetIsOpen() const { return m_data != NULL; }
+    const void* GetData() const { return m_data; }
+    size_t      GetSize() const { return m_size; }
+
+private:
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+private:
+
+    const void*     m_data;
+    size_t          m_size;
+
+#ifdef WIN32
+    void*           m_file;
+    void*           m_mapping;
+#else
+    int             m_file;
+#endif
+
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "Message.h"
+
+#include <assert.h>
+#include <string.h>
+
+static size_t EncodeVarUInt(unsigned int value, unsigned char buffer[])
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        buffer[length] = static_cast<unsigned char>(value | 0x80);
+        value >>= 7;
+        ++length;
+    }
+    buffer[length] = static_cast<unsigned char>(value);
+    return length + 1;
+}
+
+MessageWriter::MessageWriter()
+{
+    m_lengthOffset = static_cast<size_t>(-1);
+}
+
+void MessageWriter::BeginMessage(int type)
+{
+    assert(m_lengthOffset == static_cast<size_t>(-1));
+    assert(type >= 0);
+
+    WriteVarUInt(static_cast<unsigned int>(type));
+
+    // The payload length isn't known yet, so leave room for the largest
+    // possible varint and close the gap in EndMessage.
+    m_lengthOffset = m_buffer.size();
+    m_buffer.resize(m_buffer.size() + s_maxLengthBytes);
+}
+
+void MessageWriter::EndMessage()
+{
+    assert(m_lengthOffset != static_cast<size_t>(-1));
+
+    size_t payloadStart = m_lengthOffset + s_maxLengthBytes;
+    size_t payloadSize  = m_buffer.size() - payloadStart;
+
+    unsigned char length[s_maxLengthBytes];
+    size_t lengthBytes = EncodeVarUInt(static_cast<unsigned int>(payloadSize), length);
+
+    memcpy(&m_buffer[m_lengthOffset], length, lengthBytes);
+    if (lengthBytes < s_maxLengthBytes)
+    {
+        if (payloadSize > 0)
+        {
+            memmove(&m_buffer[m_lengthOffset + lengthBytes], &m_buffer[payloadStart], payloadSize);
+        }
+        m_buffer.resize(m_buffer.size() - (s_maxLengthBytes - lengthBytes));
+    }
+
+    m_lengthOffset = static_cast<size_t>(-1);
+}
+
+void MessageWriter::WriteUInt8(unsigned int value)
+{
+    m_buffer.push_back(static_cast<unsigned char>(value));
+}
+
+void MessageWriter::WriteUInt32(unsigned int value)
+{
+    m_buffer.push_back(static_cast<unsigned char>(value));
+    m_buffer.push_back(static_cast<unsigned char>(value >> 8));
+    m_buffer.push_back(static_cast<unsigned char>(value >> 16));
+    m_buffer.push_back(static_cast<unsigned char>(value >> 24));
+}
+
+void MessageWriter::WriteFloat(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    WriteUInt32(bits);
+}
+
+void MessageWriter::WriteVarUInt(unsigned int value)
+{
+    unsigned char buffer[s_maxLengthBytes];
+    size_t length = EncodeVarUInt(value, buffer);
+    m_buffer.insert(m_buffer.end(), buffer, buffer + length);
+}
+
+void MessageWriter::WriteVarInt(int value)
+{
+    // Zig-zag encoding keeps small negative numbers (like -1) small.
+    unsigned int bits = static_cast<unsigned int>(value);
+    WriteVarUInt((bits << 1) ^ (value < 0 ? 0xFFFFFFFF : 0));
+}
+
+void MessageWriter::WriteBytes(const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+}
+
+const void* MessageWriter::GetData() const
+{
+    return m_buffer.empty() ? NULL : &m_buffer[0];
+}
+
+size_t MessageWriter::GetSize() const
+{
+    return m_buffer.size();
+}
+
+bool MessageWriter::GetIsEmpty() const
+{
+    return m_buffer.empty();
+}
+
+void MessageWriter::Clear()
+{
+    assert(m_lengthOffset == static_cast<size_t>(-1));
+    m_buffer.clear();
+}
+
+MessageReader::MessageReader()
+{
+    m_data      = NULL;
+    m_size      = 0;
+    m_offset    = 0;
+    m_valid     = true;
+}
+
+MessageReader::MessageReader(const void* data, size_t size)
+{
+    m_data      = static_cast<const unsigned char*>(data);
+    m_size      = size;
+    m_offset    = 0;
+    m_valid     = true;
+}
+
+bool MessageReader::ReadMessage(int& type, MessageReader& payload)
+{
+
+    if (!m_valid || GetIsAtEnd())
+    {
+        return false;
+    }
+
+    unsigned int messageType;
+    unsigned int length;
+    if (!ReadVarUInt(messageType) || !ReadVarUInt(length))
+    {
+        return false;
+    }
+
+    const void* data;
+    if (messageType > 0x7FFFFFFF || !ReadBytes(data, length))
+    {
+        return Fail();
+    }
+
+    type    = static_cast<int>(messageType);
+    payload = MessageReader(data, length);
+    return true;
+
+}
+
+bool MessageReader::ReadUInt8(unsigned int& value)
+{
+    if (!m_valid || GetBytesLeft() < 1)
+    {
+        return Fail();
+    }
+    value = m_data[m_offset];
+    ++m_offset;
+    return true;
+}
+
+bool MessageReader::ReadUInt32(unsigned int& value)
+{
+    if (!m_valid || GetBytesLeft() < 4)
+    {
+        return Fail();
+    }
+    const unsigned char* bytes = m_data + m_offset;
+    value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<unsigned int>(bytes[3]) << 24);
+    m_offset += 4;
+    return true;
+}
+
+bool MessageReader::ReadFloat(float& value)
+{
+    unsigned int bits;
+    if (!ReadUInt32(bits))
+    {
+        return false;
+    }
+    memcpy(&value, &bits, sizeof(value));
+    return true;
+}
+
+bool MessageReader::ReadVarUInt(unsigned int& value)
+{
+
+    if (!m_valid)
+    {
+        return false;
+    }
+
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (GetBytesLeft() < 1)
+        {
+            return Fail();
+        }
+
+        unsigned int byte = m_data[m_offset];
+        ++m_offset;
+
+        // The fifth byte can only contribute the top four bits.
+        if (shift == 28 && byte > 0x0F)
+        {
+            return Fail();
+        }
+
+        value |= (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return Fail();
+
+}
+
+bool MessageReader::ReadVarInt(int& value)
+{
+    unsigned int bits;
+    if (!ReadVarUInt(bits))
+    {
+        return false;
+    }
+    value = static_cast<int>((bits >> 1) ^ (0 - (bits & 1)));
+    return true;
+}
+
+bool MessageReader::ReadBytes(const void*& data, size_t size)
+{
+    if (!m_valid || GetBytesLeft() < size)
+    {
+        return Fail();
+    }
+    data = m_data + m_offset;
+    m_offset += size;
+    return true;
+}
+
+bool MessageReader::GetIsValid() const
+{
+    return m_valid;
+}
+
+bool MessageReader::GetIsAtEnd() const
+{
+    return m_offset == m_size;
+}
+
+size_t MessageReader::GetBytesLeft() const
+{
+    return m_size - m_offset;
+}
+
+bool MessageReader::Fail()
+{
+    m_valid = false;
+    return false;
+}
@@ -0,0 +1,87 @@
+#ifndef GAME_MESSAGE_H
+#define GAME_MESSAGE_H
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Messages are framed as a varint type, a varint payload length and the
+ * payload itself. Any number of messages can be packed into one datagram.
+ * All multi-byte values are little-endian so that builds with different word
+ * sizes can talk to each other.
+ */
+class MessageWriter
+{
+
+public:
+
+    MessageWriter();
+
+    void BeginMessage(int type);
+    void EndMessage();
+
+    void WriteUInt8(unsigned int value);
+    void WriteUInt32(unsigned int value);
+    void WriteFloat(float value);
+    void WriteVarUInt(unsigned int value);
+    void WriteVarInt(int value);
+    void WriteBytes(const void* data, size_t size);
+
+    const void* GetData() const;
+    size_t GetSize() const;
+    bool GetIsEmpty() const;
+
+    void Clear();
+
+private:
+
+    static const size_t s_maxLengthBytes = 5;
+
+    std::vector<unsigned char>  m_buffer;
+    size_t                      m_lengthOffset;
+
+};
+
+/**
+ * Reads values out of a buffer without copying it. Every read is bounds
+ * checked; once a read fails the reader stays invalid and all further reads
+ * fail as well.
+ */
+class MessageReader
+{
+
+public:
+
+    MessageReader();
+    MessageReader(const void* data, size_t size);
+
+    /**
+     * Reads the next framed message. The payload reader points into the
+     * original buffer. Returns false at the end of the buffer or if the frame
+     * is malformed (in which case GetIsValid will return false).
+     */
+    bool ReadMessage(int& type, MessageReader& payload);
+
+    bool ReadUInt8(unsigned int& value);
+    bool ReadUInt32(unsigned int& value);
+    bool ReadFloat(float& value);
+    bool ReadVarUInt(unsigned int& value);
+    bool ReadVarInt(int& value);
+    bool ReadBytes(const void*& data, size_t size);
+
+    bool GetIsValid() const;
+    bool GetIsAtEnd() const;
+    size_t GetBytesLeft() const;
+
+private:
+
+    bool Fail();
+
+    const unsigned char*    m_data;
+    size_t                  m_size;
+    size_t                  m_offset;
+    bool                    m_valid;
+
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include "NetworkThread.h"
+#include "Message.h"
+#include "Log.h"
+
+#include <SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// How long the network thread blocks waiting for packets before checking for
+// outgoing data again (in milliseconds).
+static const int kServiceTimeout = 1;
+
+static const unsigned int kQueueSize = 1024;
+
+NetworkThread::NetworkThread(int numChannels)
+    : m_host(numChannels),
+      m_incoming(kQueueSize),
+      m_outgoing(kQueueSize)
+{
+    m_thread = NULL;
+    m_quit   = 0;
+}
+
+NetworkThread::~NetworkThread()
+{
+    Destroy();
+}
+
+void NetworkThread::Service(Host::Handler* handler)
+{
+
+    // Retry sends that didn't fit in the queue last time.
+    while (!m_outgoingBacklog.empty() && m_outgoing.Push(m_outgoingBacklog.front()))
+    {
+        m_outgoingBacklog.pop_front();
+    }
+
+    Event event;
+    while (m_incoming.Pop(event))
+    {
+        if (handler != NULL)
+        {
+            switch (event.type)
+            {
+            case EventType_Connect:
+                handler->OnConnect(event.peerId);
+                break;
+            case EventType_Disconnect:
+                handler->OnDisconnect(event.peerId);
+                break;
+            case EventType_Packet:
+                handler->OnPacket(event.peerId, event.channel, event.data, event.size);
+                break;
+            }
+        }
+        free(event.data);
+    }
+
+}
+
+bool NetworkThread::SendPacket(int peerId, int channel, const void* data, size_t size)
+{
+
+    if (m_thread == NULL)
+    {
+        return false;
+    }
+
+    Event event;
+    event.type      = EventType_Packet;
+    event.peerId    = peerId;
+    event.channel   = channel;
+    event.data      = malloc(size);
+    event.size      = size;
+    memcpy(event.data, data, size);
+
+    // Keep the packets in order if some are already waiting.
+    if (!m_outgoingBacklog.empty() || !m_outgoing.Push(event))
+    {
+        m_outgoingBacklog.push_back(event);
+    }
+
+    return true;
+
+}
+
+bool NetworkThread::Listen(int port)
+{
+    Stop();
+    ClearQueues();
+
+    if (!m_host.Listen(port))
+    {
+        return false;
+    }
+
+    Start();
+    return true;
+}
+
+bool NetworkThread::Connect(const char* hostName, int port)
+{
+    Stop();
+    ClearQueues();
+
+    if (!m_host.Connect(hostName, port))
+    {
+        return false;
+    }
+
+    Start();
+    return true;
+}
+
+void NetworkThread::Destroy()
+{
+    Stop();
+    m_host.Destroy();
+    ClearQueues();
+}
+
+int NetworkThread::ThreadMain(void* data)
+{
+    static_cast<NetworkThread*>(data)->Run();
+    return 0;
+}
+
+void NetworkThread::Run()
+{
+
+    while (!Atomic_Load(m_quit))
+    {
+
+        Event event;
+        while (m_outgoing.Pop(event))
+        {
+            m_host.SendPacket(event.peerId, event.channel, event.data, event.size);
+            free(event.data);
+        }
+
+        while (!m_incomingBacklog.empty() && m_incoming.Push(m_incomingBacklog.front()))
+        {
+            m_incomingBacklog.pop_front();
+        }
+
+        m_host.Service(this, kServiceTimeout);
+
+    }
+
+}
+
+void NetworkThread::Start()
+{
+    m_quit = 0;
+    m_thread = SDL_CreateThread(ThreadMain, this);
+    if (m_thread == NULL)
+    {
+        LogError("Failed to create the network thread: %s", SDL_GetError());
+    }
+}
+
+void NetworkThread::Stop()
+{
+    if (m_thread != NULL)
+    {
+        Atomic_Store(m_quit, 1);
+        SDL_WaitThread(m_thread, NULL);
+        m_thread = NULL;
+    }
+}
+
+void NetworkThread::ClearQueues()
+{
+
+    // Only called while the network thread isn't running, so it's safe to
+    // drain both ends from here.
+    Event event;
+    while (m_incoming.Pop(event))
+    {
+        free(event.data);
+    }
+    while (m_outgoing.Pop(event))
+    {
+        free(event.data);
+    }
+
+    for (size_t i = 0; i < m_incomingBacklog.size(); ++i)
+    {
+        free(m_incomingBacklog[i].data);
+    }
+    m_incomingBacklog.clear();
+
+    for (size_t i = 0; i < m_outgoingBacklog.size(); ++i)
+    {
+        free(m_outgoingBacklog[i].data);
+    }
+    m_outgoingBacklog.clear();
+
+}
+
+void NetworkThread::OnConnect(int peerId)
+{
+    Event event;
+    event.type      = EventType_Connect;
+    event.peerId    = peerId;
+    event.channel   = 0;
+    event.data      = NULL;
+    event.size      = 0;
+    QueueIncoming(event);
+}
+
+void NetworkThread::OnDisconnect(int peerId)
+{
+    Event event;
+    event.type      = EventType_Disconnect;
+    event.peerId    = peerId;
+    event.channel   = 0;
+    event.data      = NULL;
+    event.size      = 0;
+    QueueIncoming(event);
+}
+
+void NetworkThread::OnPacket(int peerId, int channel, void* data, size_t size)
+{
+
+    // Check the framing here so the game thread only sees well formed packets.
+    MessageReader reader(data, size);
+    MessageReader message;
+    int messageType;
+    while (reader.ReadMessage(messageType, message))
+    {
+    }
+
+    if (!reader.GetIsValid())
+    {
+        LogError("Dropping malformed packet from peer %i", peerId);
+        return;
+    }
+
+    Event event;
+    event.type      = EventType_Packet;
+    event.peerId    = peerId;
+    event.channel   = channel;
+    event.data      = malloc(size);
+    event.size      = size;
+    memcpy(event.data, data, size);
+    QueueIncoming(event);
+
+}
+
+void NetworkThread::QueueIncoming(const Event& event)
+{
+    if (!m_incomingBacklog.empty() || !m_incoming.Push(event))
+    {
+        m_incomingBacklog.push_back(event);
+    }
+}
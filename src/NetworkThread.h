@@ -0,0 +1,81 @@
+#ifndef GAME_NETWORK_THREAD_H
+#define GAME_NETWORK_THREAD_H
+
+#include "Host.h"
+#include "SpscQueue.h"
+
+#include <deque>
+
+struct SDL_Thread;
+
+/**
+ * Runs a Host on its own thread so sending and receiving packets isn't tied
+ * to the frame or tick rate of the game. The interface mirrors Host; events
+ * are queued by the network thread and dispatched to the handler when the
+ * game thread calls Service.
+ */
+class NetworkThread : private Host::Handler
+{
+
+public:
+
+    NetworkThread(int numChannels);
+    ~NetworkThread();
+
+    void Service(Host::Handler* handler);
+    bool SendPacket(int peerId, int channel, const void* data, size_t size);
+
+    bool Listen(int port);
+    bool Connect(const char* hostName, int port);
+
+    void Destroy();
+
+private:
+
+    enum EventType
+    {
+        EventType_Connect,
+        EventType_Disconnect,
+        EventType_Packet,
+    };
+
+    struct Event
+    {
+        EventType   type;
+        int         peerId;
+        int         channel;
+        void*       data;
+        size_t      size;
+    };
+
+    typedef std::deque<Event> EventList;
+
+    static int ThreadMain(void* data);
+    void Run();
+
+    void Start();
+    void Stop();
+    void ClearQueues();
+
+    // Host::Handler, called on the network thread.
+    virtual void OnConnect(int peerId);
+    virtual void OnDisconnect(int peerId);
+    virtual void OnPacket(int peerId, int channel, void* data, size_t size);
+
+    void QueueIncoming(const Event& event);
+
+    Host                m_host;
+    SDL_Thread*         m_thread;
+    volatile int        m_quit;
+
+    SpscQueue<Event>    m_incoming;         // Network thread -> game thread
+    SpscQueue<Event>    m_outgoing;         // Game thread -> network thread
+
+    // Events that didn't fit in the queues; each is only touched by the
+    // producing thread.
+    EventList           m_incomingBacklog;
+    EventList           m_outgoingBacklog;
+
+};
+
+#endif
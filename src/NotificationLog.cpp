@@ -4,6 +4,11 @@
 #include "Utility.h"
 #include "Font.h"
 #include "Map.h"
+#include "SpriteBatch.h"
+#include "TextureAtlas.h"
+#include "AssetLoader.h"
+
+#include <stdio.h>
 
 const float kPi = 3.14159265359f;
 
@@ -65,51 +70,46 @@ NotificationLog::~NotificationLog()
     BASS_SampleFree(m_soundDestroyed);
 }
 
-void NotificationLog::Draw()
+void NotificationLog::Draw(SpriteBatch& batch)
 {
     int rowY = m_windowY;
     const int iconSize = m_rowHeight;
     const int textStartX = iconSize + 10;
 
+    // The icons and the font share the atlas, so the whole log is drawn
+    // with one batch.
+    batch.Begin();
 
     for (size_t i = m_firstEntry; i < m_entries.size(); ++i)
     {
-        Protocol::Notification notification = m_entries[i].packet.notification;
-        const char* text = kNotificationText[notification];
-        Texture& texture = m_notificationTextures[notification];
-
-        glColor(0xffffffff);
-        Render_DrawSprite(texture, m_windowX, rowY, iconSize, iconSize);
+        const LogEntry& entry = m_entries[i];
 
-        Font_BeginDrawing(*m_font);
+        batch.SetColor(0xffffffff);
+        batch.Draw(m_notificationTextures[entry.packet.notification], m_windowX, rowY, iconSize, iconSize);
 
         if (i == m_activeEntry)
         {
-            glColor(0xffff0000);
+            batch.SetColor(0xffff0000);
         }
         else
         {
-            glColor(0xff000000);
+            batch.SetColor(0xff000000);
         }
 
-        Font_DrawText(text, m_windowX + textStartX, rowY);
+        batch.Draw(entry.text, m_windowX + textStartX, rowY);
         
-        if (notification == Protocol::Notification_LineUsed)
+        if (entry.packet.notification == Protocol::Notification_LineUsed)
         {
-            int offset = Font_GetTextWidth(*m_font, text);
-            int line = m_entries[i].packet.line;
-            char lineBuffer[1024];
-            sprintf(lineBuffer, "line %i", line + 1);
-            glColor(m_map->GetLineColor(line));
-            Font_DrawText(lineBuffer, m_windowX + offset + textStartX, rowY);            
+            batch.SetColor(m_map->GetLineColor(entry.packet.line));
+            batch.Draw(entry.lineText, m_windowX + textStartX + entry.text.GetWidth(), rowY);
         }
 
-        Font_EndDrawing();
-
         rowY += m_rowHeight;
 
     }
 
+    batch.End();
+
 }
 
 bool NotificationLog::OnMouseDown(int x, int y, int button, Vec2& location)
@@ -135,7 +135,7 @@ void NotificationLog::OnMouseMove(int x, int y)
     m_activeEntry = GetEntryUnderCursor(x, y);
 }
 
-void NotificationLog::LoadResources()
+void NotificationLog::LoadResources(AssetLoader& loader, TextureAtlas& atlas)
 {
 
     struct TextureLoad
@@ -160,12 +160,12 @@ void NotificationLog::LoadResources()
     int numTextures = sizeof(load) / sizeof(TextureLoad);
     for (int i = 0; i < numTextures; ++i)
     {   
-        Texture_Load(*load[i].texture, load[i].fileName);
+        loader.LoadTexture(*load[i].texture, load[i].fileName, &atlas);
     }
 
-    m_soundCrime = BASS_SampleLoad(false, "assets/sound_crime.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundSpotted = BASS_SampleLoad(false, "assets/sound_spotted.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
-    m_soundDestroyed = BASS_SampleLoad(false, "assets/sound_infiltrate.wav", 0, 0, 3, BASS_SAMPLE_OVER_POS);
+    loader.LoadSample(m_soundCrime, "assets/sound_crime.wav");
+    loader.LoadSample(m_soundSpotted, "assets/sound_spotted.wav");
+    loader.LoadSample(m_soundDestroyed, "assets/sound_infiltrate.wav");
 
     const int rowSpacing = 8;
     m_rowHeight = Font_GetTextHeight(*m_font) + rowSpacing;
@@ -174,8 +174,19 @@ void NotificationLog::LoadResources()
 void NotificationLog::AddNotification(float time, const Protocol::NotificationPacket& packet)
 {
 
-    LogEntry entry = { time, packet };
-    m_entries.push_back(entry);
+    m_entries.resize(m_entries.size() + 1);
+    LogEntry& entry = m_entries.back();
+    entry.time = time;
+    entry.packet = packet;
+
+    // Lay the text out now so it doesn't have to be formatted every frame.
+    entry.text.Set(*m_font, kNotificationText[packet.notification]);
+    if (packet.notification == Protocol::Notification_LineUsed)
+    {
+        char lineBuffer[32];
+        sprintf(lineBuffer, "line %i", packet.line + 1);
+        entry.lineText.Set(*m_font, lineBuffer);
+    }
     Vec2 location;
     VisualizeNotification(packet, location);
 
@@ -201,52 +212,52 @@ bool NotificationLog::VisualizeNotification(const Protocol::NotificationPacket&
     {
     case Protocol::Notification_AgentCaptured:
         {
-            const Stop& stop = m_map->GetStop(packet.stop);        
-            AddNotificationParticle(texture, static_cast<int>(stop.point.x), static_cast<int>(stop.point.y));
-            location = stop.point;
+            Vec2 point = m_map->GetStopPoint(packet.stop);        
+            AddNotificationParticle(texture, static_cast<int>(point.x), static_cast<int>(point.y));
+            location = point;
             return true;
         }
         break;
     case Protocol::Notification_AgentSpotted:
         {
-            const Stop& stop = m_map->GetStop(packet.stop);        
-            AddNotificationParticle(texture, static_cast<int>(stop.point.x), static_cast<int>(stop.point.y));
+            Vec2 point = m_map->GetStopPoint(packet.stop);        
+            AddNotificationParticle(texture, static_cast<int>(point.x), static_cast<int>(point.y));
             PlaySample(m_soundSpotted);
-            location = stop.point;
+            location = point;
             return true;
         }
         break;
     case Protocol::Notification_CrimeDetected:
         {
-            const Stop& stop = m_map->GetStop(packet.stop);
-            AddNotificationParticle(texture, static_cast<int>(stop.point.x), static_cast<int>(stop.point.y));
+            Vec2 point = m_map->GetStopPoint(packet.stop);
+            AddNotificationParticle(texture, static_cast<int>(point.x), static_cast<int>(point.y));
             PlaySample(m_soundCrime);
-            location = stop.point;
+            location = point;
             return true;
         }
         break;
     case Protocol::Notification_AgentLost:
         {
-            const Stop& stop = m_map->GetStop(packet.stop);        
-            AddNotificationParticle(texture, static_cast<int>(stop.point.x), static_cast<int>(stop.point.y));
-            location = stop.point;
+            Vec2 point = m_map->GetStopPoint(packet.stop);        
+            AddNotificationParticle(texture, static_cast<int>(point.x), static_cast<int>(point.y));
+            location = point;
             return true;
         }
         break;
     case Protocol::Notification_HouseDestroyed:
         {
-            const Stop& stop = m_map->GetStop(packet.stop);        
-            AddNotificationParticle(texture, static_cast<int>(stop.point.x), static_cast<int>(stop.point.y));
+            Vec2 point = m_map->GetStopPoint(packet.stop);        
+            AddNotificationParticle(texture, static_cast<int>(point.x), static_cast<int>(point.y));
             PlaySample(m_soundDestroyed);
-            location = stop.point;
+            location = point;
             return true;
         }
         break;
     case Protocol::Notification_IntelDetected:
         {
-            const Stop& stop = m_map->GetStop(packet.stop);        
-            AddNotificationParticle(texture, static_cast<int>(stop.point.x), static_cast<int>(stop.point.y));
-            location = stop.point;
+            Vec2 point = m_map->GetStopPoint(packet.stop);        
+            AddNotificationParticle(texture, static_cast<int>(point.x), static_cast<int>(point.y));
+            location = point;
             return true;
 
         }
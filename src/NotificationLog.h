@@ -3,6 +3,7 @@
 
 #include "Protocol.h"
 #include "Texture.h"
+#include "TextLayout.h"
 
 #include <bass.h>
 #include <vector>
@@ -10,6 +11,9 @@
 struct Font;
 class Particles;
 class Map;
+class SpriteBatch;
+class TextureAtlas;
+class AssetLoader;
 
 class NotificationLog
 {
@@ -18,11 +22,11 @@ public:
     NotificationLog(Map* map, Particles* mapParticles, Font* font, int xSize, int ySize);
     ~NotificationLog();
 
-    void Draw();
+    void Draw(SpriteBatch& batch);
     bool OnMouseDown(int x, int y, int button, Vec2& location);
     void OnMouseUp(int x, int y, int button);
     void OnMouseMove(int x, int y);
-    void LoadResources();
+    void LoadResources(AssetLoader& loader, TextureAtlas& atlas);
 
     void AddNotification(float time, const Protocol::NotificationPacket& packet);
 
@@ -38,6 +42,8 @@ private:
     {
         float time;
         Protocol::NotificationPacket packet;
+        TextLayout text;
+        TextLayout lineText;    // Name of the line for Notification_LineUsed
     };
 
     Font*                   m_font;
@@ -1,6 +1,9 @@
 #include "Particles.h"
 
 #include "Texture.h"
+#include "SpriteBatch.h"
+
+#include <string.h>
 
 
 Particle* Particles::Add()
@@ -13,7 +16,7 @@ Particle* Particles::Add()
 
 }
 
-void Particles::Draw() const
+void Particles::Draw(SpriteBatch& batch) const
 {
 
     for (size_t i = 0; i < m_particles.size(); ++i)
@@ -21,14 +24,8 @@ void Particles::Draw() const
         const Particle& particle = m_particles[i];
         if (particle.texture)
         {
-            glPushMatrix();
-
-            glTranslatef(particle.position.x, particle.position.y, 0);
-            glRotatef(particle.rotation, 0, 0, 1);
-            glScalef(particle.scale.x, particle.scale.y, 1);
-            glColor(particle.color);
-            Render_DrawSprite(*particle.texture, -particle.texture->xSize/2, -particle.texture->ySize/2);
-            glPopMatrix();
+            batch.SetColor(particle.color);
+            batch.Draw(*particle.texture, particle.position, particle.scale, particle.rotation);
         }
     }
 
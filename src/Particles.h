@@ -7,6 +7,7 @@
 
 struct Particle;
 struct Texture;
+class SpriteBatch;
 
 typedef bool (*UpdateFunction)(Particle& particle, float deltaTime);
 
@@ -30,7 +31,8 @@ class Particles
 {
 public:
 
-    void Draw() const;
+    // Adds the particles to a batch which has already begun.
+    void Draw(SpriteBatch& batch) const;
     Particle* Add();
     void Update(float deltaTime);
     int GetNumParticles() const;
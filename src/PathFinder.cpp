@@ -0,0 +1,238 @@
+#include "PathFinder.h"
+#include "Map.h"
+
+#include <algorithm>
+
+#include <assert.h>
+
+PathFinder::PathFinder(const Map* map)
+{
+    m_map       = map;
+    m_search    = 0;
+}
+
+void PathFinder::BuildTable()
+{
+    m_table.Build(*m_map);
+}
+
+int PathFinder::GetNextStop(int start, int goal, Metric metric)
+{
+    if (GetUseTable(metric))
+    {
+        return GetIsValid(start, goal) ? m_table.GetNextStop(start, goal) : -1;
+    }
+    if (!Search(start, goal, metric))
+    {
+        return -1;
+    }
+    return m_next[start];
+}
+
+int PathFinder::GetNumHops(int start, int goal)
+{
+    if (GetUseTable(Metric_Hops))
+    {
+        return GetIsValid(start, goal) ? m_table.GetNumHops(start, goal) : -1;
+    }
+    if (!Search(start, goal, Metric_Hops))
+    {
+        return -1;
+    }
+    return m_hops[start];
+}
+
+float PathFinder::GetDistance(int start, int goal)
+{
+    if (!Search(start, goal, Metric_Distance))
+    {
+        return -1.0f;
+    }
+    return m_cost[start];
+}
+
+int PathFinder::GetPath(int start, int goal, std::vector<int>& path, Metric metric)
+{
+
+    path.clear();
+
+    if (GetUseTable(metric))
+    {
+        return GetIsValid(start, goal) ? m_table.GetPath(start, goal, path) : 0;
+    }
+
+    if (!Search(start, goal, metric))
+    {
+        return 0;
+    }
+
+    int current = start;
+    path.push_back(current);
+    while (current != goal)
+    {
+        current = m_next[current];
+        assert(current != -1);
+        path.push_back(current);
+    }
+
+    return static_cast<int>(path.size());
+
+}
+
+bool PathFinder::CompareHeapEntries(const HeapEntry& a, const HeapEntry& b)
+{
+    // std::push_heap builds a max heap, so flip the comparison.
+    return a.cost > b.cost;
+}
+
+bool PathFinder::Search(int start, int goal, Metric metric)
+{
+
+    if (!GetIsValid(start, goal))
+    {
+        return false;
+    }
+
+    BeginSearch();
+
+    if (metric == Metric_Distance)
+    {
+        return SearchDistance(start, goal);
+    }
+    return SearchHops(start, goal);
+
+}
+
+bool PathFinder::SearchHops(int start, int goal)
+{
+
+    // Each stop is queued at most once, so the queue never wraps around.
+    int head = 0;
+    int tail = 0;
+    m_queue[tail++] = goal;
+
+    m_reached[goal] = m_search;
+    m_next[goal]    = goal;
+    m_hops[goal]    = 0;
+
+    while (head < tail)
+    {
+
+        int current = m_queue[head++];
+        if (current == start)
+        {
+            return true;
+        }
+
+        int numNeighbors = m_map->GetNumNeighbors(current);
+        for (int i = 0; i < numNeighbors; ++i)
+        {
+            int neighbor = m_map->GetNeighbor(current, i);
+            if (m_reached[neighbor] != m_search)
+            {
+                m_reached[neighbor] = m_search;
+                m_next[neighbor]    = current;
+                m_hops[neighbor]    = m_hops[current] + 1;
+                m_queue[tail++] = neighbor;
+            }
+        }
+
+    }
+
+    return false;
+
+}
+
+bool PathFinder::SearchDistance(int start, int goal)
+{
+
+    const Vec2& startPoint = m_map->GetStopPoint(start);
+
+    m_heap.clear();
+
+    m_reached[goal] = m_search;
+    m_next[goal]    = goal;
+    m_cost[goal]    = 0.0f;
+
+    HeapEntry entry;
+    entry.cost = Length(m_map->GetStopPoint(goal) - startPoint);
+    entry.stop = goal;
+    m_heap.push_back(entry);
+
+    while (!m_heap.empty())
+    {
+
+        std::pop_heap(m_heap.begin(), m_heap.end(), CompareHeapEntries);
+        int current = m_heap.back().stop;
+        m_heap.pop_back();
+
+        // Stops are pushed again rather than updated when a shorter path is
+        // found, so skip the stale entries.
+        if (m_closed[current] == m_search)
+        {
+            continue;
+        }
+        m_closed[current] = m_search;
+
+        if (current == start)
+        {
+            return true;
+        }
+
+        // The straight line distance never overestimates the rail distance,
+        // so the first time start comes off the heap its path is shortest.
+        int numNeighbors = m_map->GetNumNeighbors(current);
+        for (int i = 0; i < numNeighbors; ++i)
+        {
+            int neighbor = m_map->GetNeighbor(current, i);
+            float cost = m_cost[current] + m_map->GetNeighborDistance(current, i);
+            if (m_closed[neighbor] != m_search &&
+                (m_reached[neighbor] != m_search || cost < m_cost[neighbor]))
+            {
+                m_reached[neighbor] = m_search;
+                m_next[neighbor]    = current;
+                m_cost[neighbor]    = cost;
+
+                entry.cost = cost + Length(m_map->GetStopPoint(neighbor) - startPoint);
+                entry.stop = neighbor;
+                m_heap.push_back(entry);
+                std::push_heap(m_heap.begin(), m_heap.end(), CompareHeapEntries);
+            }
+        }
+
+    }
+
+    return false;
+
+}
+
+bool PathFinder::GetIsValid(int start, int goal) const
+{
+    int numStops = m_map->GetNumStops();
+    return start >= 0 && start < numStops && goal >= 0 && goal < numStops;
+}
+
+bool PathFinder::GetUseTable(Metric metric) const
+{
+    return metric == Metric_Hops && m_table.GetNumStops() == m_map->GetNumStops();
+}
+
+void PathFinder::BeginSearch()
+{
+
+    size_t numStops = static_cast<size_t>(m_map->GetNumStops());
+
+    // Start over if the map has changed size or the stamp wraps around.
+    ++m_search;
+    if (m_reached.size() != numStops || m_search == 0)
+    {
+        m_reached.assign(numStops, 0);
+        m_closed.assign(numStops, 0);
+        m_next.resize(numStops);
+        m_hops.resize(numStops);
+        m_cost.resize(numStops);
+        m_queue.resize(numStops);
+        m_search = 1;
+    }
+
+}
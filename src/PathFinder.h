@@ -0,0 +1,91 @@
+#ifndef GAME_PATH_FINDER_H
+#define GAME_PATH_FINDER_H
+
+#include "PathTable.h"
+
+#include <vector>
+
+class Map;
+
+/**
+ * Answers shortest path queries on the rail graph of a map. Paths can be
+ * measured in hops, which is how long agents take to travel them, or in rail
+ * length. The scratch space is kept between queries, so a PathFinder should
+ * only be used from one thread at a time.
+ */
+class PathFinder
+{
+
+public:
+
+    enum Metric
+    {
+        Metric_Hops,        // Breadth first search, since every rail takes as long
+        Metric_Distance,    // A* on the rail lengths
+    };
+
+    explicit PathFinder(const Map* map);
+
+    // Precomputes the answers to hop queries if the map is small enough. Must
+    // be called again whenever the map is regenerated.
+    void BuildTable();
+    const PathTable& GetTable() const { return m_table; }
+
+    // Returns the stop to move to from start to get to goal, start if they're
+    // the same or -1 if goal can't be reached.
+    int   GetNextStop(int start, int goal, Metric metric = Metric_Hops);
+
+    // Returns the number of rails on the shortest path, or -1 if goal can't
+    // be reached.
+    int   GetNumHops(int start, int goal);
+
+    // Returns the length of the shortest path along the rails, or -1 if goal
+    // can't be reached.
+    float GetDistance(int start, int goal);
+
+    // Stores the stops from start to goal inclusive in path and returns the
+    // number of stops, or 0 if goal can't be reached.
+    int   GetPath(int start, int goal, std::vector<int>& path, Metric metric = Metric_Hops);
+
+private:
+
+    struct HeapEntry
+    {
+        float   cost;       // Cost so far plus the estimate to the end
+        int     stop;
+    };
+
+    static bool CompareHeapEntries(const HeapEntry& a, const HeapEntry& b);
+
+    // Both searches run from goal back to start, so m_next holds the next
+    // stop towards goal for every stop they reach. Return false if start
+    // can't be reached.
+    bool Search(int start, int goal, Metric metric);
+    bool SearchHops(int start, int goal);
+    bool SearchDistance(int start, int goal);
+
+    bool GetIsValid(int start, int goal) const;
+    bool GetUseTable(Metric metric) const;
+
+    void BeginSearch();
+
+private:
+
+    const Map*                  m_map;
+    PathTable                   m_table;
+
+    // Entries are only valid if their stamp matches m_search, which saves
+    // clearing the arrays before each query.
+    unsigned int                m_search;
+    std::vector<unsigned int>   m_reached;
+    std::vector<unsigned int>   m_closed;
+    std::vector<int>            m_next;
+    std::vector<int>            m_hops;
+    std::vector<float>          m_cost;
+
+    std::vector<int>            m_queue;
+    std::vector<HeapEntry>      m_heap;
+
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "PathTable.h"
+#include "Map.h"
+#include "Thread.h"
+#include "Timer.h"
+#include "Log.h"
+#include "Utility.h"
+
+#include <assert.h>
+
+int PathTable::s_maxStops = PathTable::s_defaultMaxStops;
+
+PathTable::PathTable()
+{
+    m_numStops = 0;
+}
+
+void PathTable::SetMaxStops(int maxStops)
+{
+    // Stop ids have to fit in 16 bits with one value left over, which the
+    // memory limit is well under.
+    int limit = s_limitMaxStops;
+    if (maxStops > limit)
+    {
+        LogMessage("Path table limit of %d stops reduced to %d", maxStops, limit);
+    }
+    s_maxStops = Clamp(maxStops, 0, limit);
+}
+
+bool PathTable::Build(const Map& map)
+{
+
+    Clear();
+
+    int numStops = map.GetNumStops();
+    if (numStops == 0 || numStops > s_maxStops)
+    {
+        LogMessage("Skipping path table for %d stops (limit is %d)", numStops, s_maxStops);
+        return false;
+    }
+
+    double startTime = Timer_GetTime();
+
+    size_t tableSize = static_cast<size_t>(numStops) * numStops;
+    m_numStops = numStops;
+    m_next.resize(tableSize);
+    m_hops.resize(tableSize);
+
+    // The rows don't depend on each other, so each goal is a separate job.
+    BuildData data;
+    data.table  = this;
+    data.map    = &map;
+    Thread_ParallelFor(numStops, BuildRow, &data);
+
+    LogMessage("Built path table for %d stops in %.1f ms (%d KB)", numStops,
+        (Timer_GetTime() - startTime) * 1000.0, static_cast<int>(GetMemoryUsage() / 1024));
+
+    return true;
+
+}
+
+void PathTable::Clear()
+{
+    m_numStops = 0;
+    std::vector<unsigned short>().swap(m_next);
+    std::vector<unsigned short>().swap(m_hops);
+}
+
+size_t PathTable::GetMemoryUsage() const
+{
+    return (m_next.capacity() + m_hops.capacity()) * sizeof(unsigned short);
+}
+
+size_t PathTable::GetIndex(int start, int goal) const
+{
+    return static_cast<size_t>(goal) * m_numStops + start;
+}
+
+int PathTable::GetNextStop(int start, int goal) const
+{
+    unsigned short next = m_next[GetIndex(start, goal)];
+    return next == s_noStop ? -1 : next;
+}
+
+int PathTable::GetNumHops(int start, int goal) const
+{
+    unsigned short hops = m_hops[GetIndex(start, goal)];
+    return hops == s_noStop ? -1 : hops;
+}
+
+int PathTable::GetPath(int start, int goal, std::vector<int>& path) const
+{
+
+    path.clear();
+
+    const unsigned short* next = &m_next[GetIndex(0, goal)];
+    if (next[start] == s_noStop)
+    {
+        return 0;
+    }
+
+    int current = start;
+    path.push_back(current);
+    while (current != goal)
+    {
+        current = next[current];
+        path.push_back(current);
+    }
+
+    return static_cast<int>(path.size());
+
+}
+
+void PathTable::BuildRow(int goal, void* data)
+{
+
+    const BuildData* buildData = static_cast<const BuildData*>(data);
+    const Map& map = *buildData->map;
+
+    int numStops = buildData->table->m_numStops;
+    unsigned short* next = &buildData->table->m_next[buildData->table->GetIndex(0, goal)];
+    unsigned short* hops = &buildData->table->m_hops[buildData->table->GetIndex(0, goal)];
+
+    for (int i = 0; i < numStops; ++i)
+    {
+        next[i] = s_noStop;
+        hops[i] = s_noStop;
+    }
+
+    // Breadth first search from the goal, visiting neighbors in the same
+    // order as PathFinder so the paths match.
+    std::vector<unsigned short> queue(numStops);
+    int head = 0;
+    int tail = 0;
+    queue[tail++] = static_cast<unsigned short>(goal);
+
+    next[goal] = static_cast<unsigned short>(goal);
+    hops[goal] = 0;
+
+    while (head < tail)
+    {
+        int current = queue[head++];
+        int numNeighbors = map.GetNumNeighbors(current);
+        for (int i = 0; i < numNeighbors; ++i)
+        {
+            int neighbor = map.GetNeighbor(current, i);
+            if (next[neighbor] == s_noStop)
+            {
+                next[neighbor]  = static_cast<unsigned short>(current);
+                hops[neighbor]  = static_cast<unsigned short>(hops[current] + 1);
+                queue[tail++]   = static_cast<unsigned short>(neighbor);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,75 @@
+#ifndef GAME_PATH_TABLE_H
+#define GAME_PATH_TABLE_H
+
+#include <stddef.h>
+#include <vector>
+
+class Map;
+
+/**
+ * The next stop and number of hops between every pair of stops on a map,
+ * computed once so each step along a path is a single lookup. The paths are
+ * the same ones PathFinder finds when measuring in hops. Memory grows with
+ * the square of the number of stops, so large maps aren't tabulated.
+ */
+class PathTable
+{
+
+public:
+
+    static const int s_defaultMaxStops = 2048;
+
+    // The most SetMaxStops allows. Each pair of stops takes four bytes, so
+    // this is a 256 MB table.
+    static const int s_limitMaxStops = 8192;
+
+    PathTable();
+
+    // Sets the largest map that will be tabulated, up to s_limitMaxStops. 0
+    // disables the table.
+    static void SetMaxStops(int maxStops);
+
+    // Computes the table on worker threads. Returns false (and leaves the
+    // table empty) if the map has more stops than the limit.
+    bool Build(const Map& map);
+    void Clear();
+
+    bool GetIsBuilt() const { return m_numStops > 0; }
+    int  GetNumStops() const { return m_numStops; }
+
+    // Memory used by the table in bytes.
+    size_t GetMemoryUsage() const;
+
+    // Same as the PathFinder functions for Metric_Hops. The stops must be
+    // valid.
+    int GetNextStop(int start, int goal) const;
+    int GetNumHops(int start, int goal) const;
+    int GetPath(int start, int goal, std::vector<int>& path) const;
+
+private:
+
+    // Stop ids are stored in 16 bits; this marks unreachable stops.
+    static const unsigned short s_noStop = 0xFFFF;
+
+    struct BuildData
+    {
+        PathTable*  table;
+        const Map*  map;
+    };
+
+    static void BuildRow(int goal, void* data);
+
+    size_t GetIndex(int start, int goal) const;
+
+    static int          s_maxStops;
+
+    int                         m_numStops;
+
+    // Indexed by goal * m_numStops + start, so each row is one search from
+    // the goal.
+    std::vector<unsigned short> m_next;
+    std::vector<unsigned short> m_hops;
+
+};
+
+#endif
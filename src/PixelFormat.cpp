@@ -0,0 +1,222 @@
+#include "PixelFormat.h"
+
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define PIXEL_FORMAT_SSE2
+#include <emmintrin.h>
+#if defined(_M_IX86)
+#include <intrin.h>
+#endif
+#endif
+
+static bool g_useSimd = PixelFormat_GetHasSimd();
+
+// Reads four bytes from a position that may not be aligned.
+static unsigned int LoadWord(const unsigned char* src)
+{
+    unsigned int word;
+    memcpy(&word, src, 4);
+    return word;
+}
+
+static void ConvertBgraToRgbaScalar(const unsigned char* src, unsigned char* dst, int numPixels)
+{
+    for (int i = 0; i < numPixels; ++i)
+    {
+        unsigned char b = src[i * 4 + 0];
+        unsigned char g = src[i * 4 + 1];
+        unsigned char r = src[i * 4 + 2];
+        unsigned char a = src[i * 4 + 3];
+        dst[i * 4 + 0] = r;
+        dst[i * 4 + 1] = g;
+        dst[i * 4 + 2] = b;
+        dst[i * 4 + 3] = a;
+    }
+}
+
+static void ConvertBgrToRgbaScalar(const unsigned char* src, unsigned char* dst, int numPixels)
+{
+    for (int i = 0; i < numPixels; ++i)
+    {
+        dst[i * 4 + 0] = src[i * 3 + 2];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 0];
+        dst[i * 4 + 3] = 0xFF;
+    }
+}
+
+// Averages the 2x2 blocks for destination pixels x1 up to x2 of one row. The
+// second source row and column repeat the first when the image is only one
+// pixel high or wide.
+static void BuildMipRowScalar(const unsigned char* row1, const unsigned char* row2, int xSize, int x1, int x2, unsigned char* dst)
+{
+    int step = xSize > 1 ? 4 : 0;
+    for (int x = x1; x < x2; ++x)
+    {
+        const unsigned char* a = row1 + x * 8;
+        const unsigned char* b = row2 + x * 8;
+        for (int c = 0; c < 4; ++c)
+        {
+            dst[x * 4 + c] = static_cast<unsigned char>((a[c] + a[c + step] + b[c] + b[c + step] + 2) >> 2);
+        }
+    }
+}
+
+#ifdef PIXEL_FORMAT_SSE2
+
+// Swaps the red and blue bytes of four pixels, keeps the bytes in keepMask
+// and sets the bits in alpha.
+static __m128i SwapRedBlue(__m128i pixels, __m128i keepMask, __m128i alpha)
+{
+    __m128i rb = _mm_and_si128(pixels, _mm_set1_epi32(0x00FF00FF));
+    rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(pixels, keepMask), rb), alpha);
+}
+
+static void ConvertBgraToRgbaSse2(const unsigned char* src, unsigned char* dst, int numPixels)
+{
+
+    const __m128i keepMask = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+    const __m128i alpha    = _mm_setzero_si128();
+
+    int i = 0;
+    for (; i + 4 <= numPixels; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), SwapRedBlue(pixels, keepMask, alpha));
+    }
+
+    ConvertBgraToRgbaScalar(src + i * 4, dst + i * 4, numPixels - i);
+
+}
+
+static void ConvertBgrToRgbaSse2(const unsigned char* src, unsigned char* dst, int numPixels)
+{
+
+    const __m128i keepMask = _mm_set1_epi32(0x0000FF00);
+    const __m128i alpha    = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+    // Each pixel is read as a word, which takes a byte from the next pixel, so
+    // the last one is left for the scalar loop to avoid reading past the end.
+    int i = 0;
+    for (; i + 5 <= numPixels; i += 4)
+    {
+        const unsigned char* p = src + i * 3;
+        __m128i pixels = _mm_set_epi32(LoadWord(p + 9), LoadWord(p + 6), LoadWord(p + 3), LoadWord(p));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), SwapRedBlue(pixels, keepMask, alpha));
+    }
+
+    ConvertBgrToRgbaScalar(src + i * 3, dst + i * 4, numPixels - i);
+
+}
+
+static void BuildMipRowSse2(const unsigned char* row1, const unsigned char* row2, int xSize, unsigned char* dst)
+{
+
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(2);
+
+    // Each step reads eight pixels from both rows and writes four. The sums
+    // are done in 16 bits so the result matches the scalar version exactly.
+    int xDstSize = xSize / 2;
+    int x = 0;
+    for (; x + 4 <= xDstSize; x += 4)
+    {
+
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+        __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row2 + x * 8));
+        __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row2 + x * 8 + 16));
+
+        // Vertical sums, two source pixels in each register.
+        __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+        __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a2, zero), _mm_unpacklo_epi8(b2, zero));
+        __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a2, zero), _mm_unpackhi_epi8(b2, zero));
+
+        // Horizontal sums of neighbouring pixels.
+        __m128i t0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+        __m128i t1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+
+        t0 = _mm_srli_epi16(_mm_add_epi16(t0, round), 2);
+        t1 = _mm_srli_epi16(_mm_add_epi16(t1, round), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(t0, t1));
+
+    }
+
+    BuildMipRowScalar(row1, row2, xSize, x, xDstSize, dst);
+
+}
+
+#endif
+
+bool PixelFormat_GetHasSimd()
+{
+#if defined(PIXEL_FORMAT_SSE2) && defined(_M_IX86)
+    // Every 64-bit processor has SSE2, but 32-bit ones have to be asked.
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#elif defined(PIXEL_FORMAT_SSE2)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PixelFormat_SetUseSimd(bool useSimd)
+{
+    g_useSimd = useSimd && PixelFormat_GetHasSimd();
+}
+
+void PixelFormat_ConvertBgraToRgba(const unsigned char* src, unsigned char* dst, int numPixels)
+{
+#ifdef PIXEL_FORMAT_SSE2
+    if (g_useSimd)
+    {
+        ConvertBgraToRgbaSse2(src, dst, numPixels);
+        return;
+    }
+#endif
+    ConvertBgraToRgbaScalar(src, dst, numPixels);
+}
+
+void PixelFormat_ConvertBgrToRgba(const unsigned char* src, unsigned char* dst, int numPixels)
+{
+#ifdef PIXEL_FORMAT_SSE2
+    if (g_useSimd)
+    {
+        ConvertBgrToRgbaSse2(src, dst, numPixels);
+        return;
+    }
+#endif
+    ConvertBgrToRgbaScalar(src, dst, numPixels);
+}
+
+void PixelFormat_BuildMip(const unsigned char* src, int xSize, int ySize, unsigned char* dst)
+{
+
+    int xDstSize = xSize > 1 ? xSize / 2 : 1;
+    int yDstSize = ySize > 1 ? ySize / 2 : 1;
+
+    for (int y = 0; y < yDstSize; ++y)
+    {
+
+        const unsigned char* row1 = src + (y * 2) * xSize * 4;
+        const unsigned char* row2 = ySize > 1 ? row1 + xSize * 4 : row1;
+        unsigned char* dstRow = dst + y * xDstSize * 4;
+
+#ifdef PIXEL_FORMAT_SSE2
+        if (g_useSimd && xSize > 1)
+        {
+            BuildMipRowSse2(row1, row2, xSize, dstRow);
+            continue;
+        }
+#endif
+
+        BuildMipRowScalar(row1, row2, xSize, 0, xDstSize, dstRow);
+
+    }
+
+}
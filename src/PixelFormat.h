@@ -0,0 +1,35 @@
+#ifndef GAME_PIXEL_FORMAT_H
+#define GAME_PIXEL_FORMAT_H
+
+/**
+ * Returns true if the SSE2 versions of the conversions below can be used on
+ * this machine.
+ */
+bool PixelFormat_GetHasSimd();
+
+/**
+ * Chooses between the SSE2 and the plain C versions of the conversions. The
+ * SSE2 versions are used by default when they're available; the plain C ones
+ * are kept as the reference they're checked against.
+ */
+void PixelFormat_SetUseSimd(bool useSimd);
+
+/**
+ * Converts a row of 32-bit BGRA pixels to RGBA. The source and destination
+ * may be the same.
+ */
+void PixelFormat_ConvertBgraToRgba(const unsigned char* src, unsigned char* dst, int numPixels);
+
+/**
+ * Converts a row of 24-bit BGR pixels to opaque RGBA.
+ */
+void PixelFormat_ConvertBgrToRgba(const unsigned char* src, unsigned char* dst, int numPixels);
+
+/**
+ * Halves an RGBA image by averaging each 2x2 block of pixels to make the next
+ * mipmap level. The destination is Max(xSize / 2, 1) by Max(ySize / 2, 1);
+ * a last odd row or column is dropped.
+ */
+void PixelFormat_BuildMip(const unsigned char* src, int xSize, int ySize, unsigned char* dst);
+
+#endif
@@ -1,4 +1,8 @@
 #include "PlayerEntity.h"
+#include "Message.h"
+#include "Utility.h"
+
+#include <string.h>
 
 PlayerEntity::PlayerEntity()
 {
@@ -14,3 +18,61 @@ PlayerEntity::PlayerEntity()
     m_name[0] = 0;
     m_numIntels = 0;
 }
+
+void PlayerEntity::Serialize(MessageWriter& writer) const
+{
+
+    Entity::Serialize(writer);
+
+    unsigned int nameLength = static_cast<unsigned int>(strlen(m_name));
+    writer.WriteVarUInt(nameLength);
+    writer.WriteBytes(m_name, nameLength);
+
+    writer.WriteVarInt(m_clientId);
+
+    unsigned int flags = (m_eliminated    ? 1 : 0) |
+                         (m_hackingBank   ? 2 : 0) |
+                         (m_hackingTower  ? 4 : 0) |
+                         (m_hackingPolice ? 8 : 0);
+    writer.WriteUInt8(flags);
+
+    writer.WriteFloat(m_nextIntelPing);
+    writer.WriteVarInt(m_lastIntelFound);
+    writer.WriteVarInt(m_numSafeHouses);
+    writer.WriteVarInt(m_numAgents);
+    writer.WriteVarInt(m_numIntels);
+
+}
+
+void PlayerEntity::Deserialize(MessageReader& reader)
+{
+
+    Entity::Deserialize(reader);
+
+    // A name that doesn't fit is truncated.
+    unsigned int nameLength = 0;
+    const void* name = NULL;
+    m_name[0] = 0;
+    if (reader.ReadVarUInt(nameLength) && reader.ReadBytes(name, nameLength))
+    {
+        size_t length = Min<size_t>(nameLength, sizeof(m_name) - 1);
+        memcpy(m_name, name, length);
+        m_name[length] = 0;
+    }
+
+    reader.ReadVarInt(m_clientId);
+
+    unsigned int flags = 0;
+    reader.ReadUInt8(flags);
+    m_eliminated    = (flags & 1) != 0;
+    m_hackingBank   = (flags & 2) != 0;
+    m_hackingTower  = (flags & 4) != 0;
+    m_hackingPolice = (flags & 8) != 0;
+
+    reader.ReadFloat(m_nextIntelPing);
+    reader.ReadVarInt(m_lastIntelFound);
+    reader.ReadVarInt(m_numSafeHouses);
+    reader.ReadVarInt(m_numAgents);
+    reader.ReadVarInt(m_numIntels);
+
+}
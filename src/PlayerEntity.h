@@ -13,6 +13,10 @@ public:
 
     PlayerEntity();
 
+    void Serialize(MessageWriter& writer) const;
+    void Deserialize(MessageReader& reader);
+
+
     char    m_name[32];
     int     m_clientId;
     bool    m_eliminated;
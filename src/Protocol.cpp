@@ -0,0 +1,239 @@
+#include "Protocol.h"
+#include "Message.h"
+
+#include <string.h>
+
+namespace Protocol
+{
+
+void Write(MessageWriter& writer, const InitializeGamePacket& packet)
+{
+    writer.BeginMessage(MessageType_InitializeGame);
+    writer.WriteFloat(packet.time);
+    writer.WriteVarInt(packet.clientId);
+    writer.WriteVarInt(packet.mapSeed);
+    writer.WriteVarInt(packet.gridSpacing);
+    writer.WriteVarInt(packet.xMapSize);
+    writer.WriteVarInt(packet.yMapSize);
+    writer.WriteVarInt(packet.totalNumIntels);
+    writer.WriteFloat(packet.railSpeed);
+    writer.WriteUInt32(packet.mapHash);
+    writer.EndMessage();
+}
+
+void Write(MessageWriter& writer, const OrderPacket& packet)
+{
+    writer.BeginMessage(MessageType_Order);
+    writer.WriteVarUInt(packet.sequence);
+    writer.WriteVarUInt(packet.order);
+    writer.WriteVarInt(packet.agentId);
+    writer.WriteVarInt(packet.targetStop);
+    writer.EndMessage();
+}
+
+void Write(MessageWriter& writer, const GroupOrderPacket& packet)
+{
+    writer.BeginMessage(MessageType_GroupOrder);
+    writer.WriteVarUInt(packet.sequence);
+    writer.WriteVarUInt(packet.order);
+    writer.WriteVarUInt(static_cast<unsigned int>(packet.agentIds.size()));
+    writer.WriteVarUInt(static_cast<unsigned int>(packet.targetStops.size()));
+    for (size_t i = 0; i < packet.agentIds.size(); ++i)
+    {
+        writer.WriteVarInt(packet.agentIds[i]);
+    }
+    for (size_t i = 0; i < packet.targetStops.size(); ++i)
+    {
+        writer.WriteVarInt(packet.targetStops[i]);
+    }
+    writer.EndMessage();
+}
+
+void Write(MessageWriter& writer, const NotificationPacket& packet)
+{
+    writer.BeginMessage(MessageType_Notification);
+    writer.WriteVarUInt(packet.notification);
+    writer.WriteVarInt(packet.agentId);
+    writer.WriteVarInt(packet.stop);
+    writer.WriteVarInt(packet.line);
+    writer.EndMessage();
+}
+
+void Write(MessageWriter& writer, const MapRequestPacket& packet)
+{
+    writer.BeginMessage(MessageType_MapRequest);
+    writer.WriteUInt32(packet.mapHash);
+    writer.EndMessage();
+}
+
+void Write(MessageWriter& writer, const MapDataPacket& packet)
+{
+    writer.BeginMessage(MessageType_MapData);
+    writer.WriteBytes(packet.data, packet.dataSize);
+    writer.EndMessage();
+}
+
+bool Read(MessageReader& reader, InitializeGamePacket& packet)
+{
+    reader.ReadFloat(packet.time);
+    reader.ReadVarInt(packet.clientId);
+    reader.ReadVarInt(packet.mapSeed);
+    reader.ReadVarInt(packet.gridSpacing);
+    reader.ReadVarInt(packet.xMapSize);
+    reader.ReadVarInt(packet.yMapSize);
+    reader.ReadVarInt(packet.totalNumIntels);
+    reader.ReadFloat(packet.railSpeed);
+    reader.ReadUInt32(packet.mapHash);
+    return reader.GetIsValid() && reader.GetIsAtEnd() &&
+           packet.gridSpacing > 0 && packet.xMapSize > 0 && packet.yMapSize > 0 &&
+           packet.railSpeed >= 0.0f;
+}
+
+bool Read(MessageReader& reader, OrderPacket& packet)
+{
+    unsigned int order = 0;
+    reader.ReadVarUInt(packet.sequence);
+    reader.ReadVarUInt(order);
+    reader.ReadVarInt(packet.agentId);
+    reader.ReadVarInt(packet.targetStop);
+    packet.order = static_cast<Order>(order);
+    return reader.GetIsValid() && reader.GetIsAtEnd() && order < Order_Count;
+}
+
+bool Read(MessageReader& reader, GroupOrderPacket& packet)
+{
+
+    unsigned int order = 0;
+    unsigned int numAgents = 0;
+    unsigned int numTargets = 0;
+    reader.ReadVarUInt(packet.sequence);
+    reader.ReadVarUInt(order);
+    reader.ReadVarUInt(numAgents);
+    reader.ReadVarUInt(numTargets);
+    packet.order = static_cast<Order>(order);
+
+    if (!reader.GetIsValid() || order >= Order_Count || numAgents == 0 ||
+        numAgents > static_cast<unsigned int>(maxGroupSize) ||
+        (numTargets != 1 && numTargets != numAgents))
+    {
+        return false;
+    }
+
+    packet.agentIds.resize(numAgents);
+    for (unsigned int i = 0; i < numAgents; ++i)
+    {
+        reader.ReadVarInt(packet.agentIds[i]);
+    }
+    packet.targetStops.resize(numTargets);
+    for (unsigned int i = 0; i < numTargets; ++i)
+    {
+        reader.ReadVarInt(packet.targetStops[i]);
+    }
+
+    return reader.GetIsValid() && reader.GetIsAtEnd();
+
+}
+
+bool Read(MessageReader& reader, StatePacket& packet)
+{
+    reader.ReadVarUInt(packet.lastOrder);
+    packet.dataSize = reader.GetBytesLeft();
+    return reader.ReadBytes(packet.data, packet.dataSize);
+}
+
+bool Read(MessageReader& reader, NotificationPacket& packet)
+{
+    unsigned int notification = 0;
+    reader.ReadVarUInt(notification);
+    reader.ReadVarInt(packet.agentId);
+    reader.ReadVarInt(packet.stop);
+    reader.ReadVarInt(packet.line);
+    packet.notification = static_cast<Notification>(notification);
+    return reader.GetIsValid() && reader.GetIsAtEnd() && notification < Notification_Count;
+}
+
+bool Read(MessageReader& reader, MapRequestPacket& packet)
+{
+    reader.ReadUInt32(packet.mapHash);
+    return reader.GetIsValid() && reader.GetIsAtEnd();
+}
+
+bool Read(MessageReader& reader, MapDataPacket& packet)
+{
+    packet.dataSize = reader.GetBytesLeft();
+    return reader.ReadBytes(packet.data, packet.dataSize);
+}
+
+void WriteDiscoveryHeader(MessageWriter& writer, DiscoveryType type)
+{
+    writer.WriteUInt32(beaconMagic);
+    writer.WriteVarUInt(beaconVersion);
+    writer.WriteVarUInt(type);
+}
+
+bool ReadDiscoveryHeader(MessageReader& reader, DiscoveryType& type)
+{
+    unsigned int magic = 0;
+    unsigned int version = 0;
+    unsigned int discoveryType = 0;
+    reader.ReadUInt32(magic);
+    reader.ReadVarUInt(version);
+    reader.ReadVarUInt(discoveryType);
+    type = static_cast<DiscoveryType>(discoveryType);
+    return reader.GetIsValid() && magic == beaconMagic && version == beaconVersion &&
+           discoveryType < DiscoveryType_Count;
+}
+
+void Write(MessageWriter& writer, const ServerInfoPacket& packet)
+{
+    size_t nameLength = strlen(packet.name);
+    writer.WriteVarUInt(static_cast<unsigned int>(nameLength));
+    writer.WriteBytes(packet.name, nameLength);
+    writer.WriteVarInt(packet.gamePort);
+    writer.WriteVarInt(packet.numPlayers);
+    writer.WriteVarInt(packet.maxPlayers);
+    writer.WriteVarInt(packet.mapSeed);
+    writer.WriteFloat(packet.tickOverrunRate);
+    writer.WriteFloat(packet.load);
+    writer.WriteVarUInt(packet.beaconInterval);
+    writer.WriteUInt32(packet.queryTime);
+}
+
+void Write(MessageWriter& writer, const ServerQueryPacket& packet)
+{
+    writer.WriteUInt32(packet.queryTime);
+}
+
+bool Read(MessageReader& reader, ServerInfoPacket& packet)
+{
+
+    unsigned int nameLength = 0;
+    const void* name = NULL;
+    reader.ReadVarUInt(nameLength);
+    if (nameLength >= static_cast<unsigned int>(maxServerName) || !reader.ReadBytes(name, nameLength))
+    {
+        return false;
+    }
+    memcpy(packet.name, name, nameLength);
+    packet.name[nameLength] = 0;
+
+    reader.ReadVarInt(packet.gamePort);
+    reader.ReadVarInt(packet.numPlayers);
+    reader.ReadVarInt(packet.maxPlayers);
+    reader.ReadVarInt(packet.mapSeed);
+    reader.ReadFloat(packet.tickOverrunRate);
+    reader.ReadFloat(packet.load);
+    reader.ReadVarUInt(packet.beaconInterval);
+    reader.ReadUInt32(packet.queryTime);
+    return reader.GetIsValid() && reader.GetIsAtEnd() &&
+           packet.gamePort > 0 && packet.gamePort < 65536;
+
+}
+
+bool Read(MessageReader& reader, ServerQueryPacket& packet)
+{
+    reader.ReadUInt32(packet.queryTime);
+    return reader.GetIsValid() && reader.GetIsAtEnd();
+}
+
+}
@@ -1,19 +1,58 @@
 #ifndef GAME_PROTOCOL_H
 #define GAME_PROTOCOL_H
 
+#include <stddef.h>
+#include <vector>
+
+class MessageWriter;
+class MessageReader;
+
 namespace Protocol
 {
 
 const int listenPort = 12347;
 
-enum PacketType
+// Servers listen for discovery queries on this port and multicast group.
+const int queryPort = listenPort + 1;
+const char* const queryGroup = "239.255.71.82";
+
+// Discovery datagrams start with these so stray datagrams on the port and
+// datagrams from incompatible builds are ignored.
+const unsigned int beaconMagic = 0x44495247; // "GRID"
+const unsigned int beaconVersion = 2;
+
+enum DiscoveryType
+{
+    DiscoveryType_Beacon,       // ServerInfoPacket broadcast periodically
+    DiscoveryType_Query,        // ServerQueryPacket multicast by a client
+    DiscoveryType_Response,     // ServerInfoPacket sent back to the client
+    DiscoveryType_Count,
+};
+
+const int maxServerName = 64;
+
+// Time it takes an agent to travel between two adjacent stops (in seconds),
+// unless the server times travel by rail length.
+const float travelTime = 1.0f;
+
+// Extra time a route is charged for changing lines at a stop (in seconds)
+// when travel is timed by rail length.
+const float transferTime = 2.0f;
+
+enum MessageType
 {
-    PacketType_InitializeGame,
-    PacketType_Order,
-    PacketType_State,
-    PacketType_Notification,
+    MessageType_InitializeGame,
+    MessageType_Order,
+    MessageType_State,
+    MessageType_Notification,
+    MessageType_GroupOrder,
+    MessageType_MapRequest,
+    MessageType_MapData,
 };
 
+// Maximum number of agents that can be given a group order.
+const int maxGroupSize = 64;
+
 enum Order
 {
     Order_MoveTo,
@@ -21,7 +60,10 @@ enum Order
     Order_Capture,
     Order_Stakeout,
     Order_Hack,
-    Order_Intel
+    Order_Intel,
+    Order_Route,        // Travel to targetStop along the shortest path
+    Order_Cancel,       // Stop following a route after the current hop
+    Order_Count,
 };
 
 enum Notification
@@ -39,7 +81,6 @@ enum Notification
 
 struct InitializeGamePacket
 {
-    char        packetType;
     float       time;
     int         clientId;
     int         mapSeed;
@@ -47,35 +88,58 @@ struct InitializeGamePacket
     int         xMapSize;
     int         yMapSize;
     int         totalNumIntels;
+    float       railSpeed;      // World units per second, or 0 if every hop takes travelTime
+    unsigned int mapHash;       // Map::GetHash of the server's map
+};
+
+// Sent by a client whose map doesn't match the hash in InitializeGame.
+struct MapRequestPacket
+{
+    unsigned int    mapHash;
+};
+
+// The server's map in the format written by Map::Save. When reading data
+// points into the received datagram.
+struct MapDataPacket
+{
+    const void*     data;
+    size_t          dataSize;
 };
 
 struct OrderPacket
 {
-    char        packetType;
-    Order       order;
-    int         agentId;
+    unsigned int    sequence;       // Increases by one with each order sent
+    Order           order;
+    int             agentId;
 
     union
     {
-        int     targetStop;
+        int         targetStop;
     };
 };
 
-struct StatePacketHeader
+// Gives the same order to several agents. Each agent either has its own
+// target, or a single target is shared by all of them. Shares the sequence
+// numbering with OrderPacket.
+struct GroupOrderPacket
 {
-    char        packetType;
-    size_t      dataSize;
+    unsigned int        sequence;
+    Order               order;
+    std::vector<int>    agentIds;
+    std::vector<int>    targetStops;    // One per agent, or one shared
 };
 
+// The serialized entity state is written directly by the server; when reading
+// data points into the received datagram.
 struct StatePacket
 {
-    StatePacketHeader header;
-    char        data[1];
+    unsigned int    lastOrder;      // Sequence of the last order the server processed
+    const void*     data;
+    size_t          dataSize;
 };
 
 struct NotificationPacket
 {
-    char            packetType;
     Notification    notification;
 
     int             agentId;
@@ -83,6 +147,62 @@ struct NotificationPacket
     int             line;
 };
 
+// Broadcast on the LAN by servers so clients can choose one without
+// connecting.
+struct ServerInfoPacket
+{
+    char            name[maxServerName];
+    int             gamePort;
+    int             numPlayers;
+    int             maxPlayers;
+    int             mapSeed;
+    float           tickOverrunRate;    // Fraction of ticks that started late
+    float           load;               // Fraction of the tick interval spent updating
+    unsigned int    beaconInterval;     // Milliseconds between beacons
+    unsigned int    queryTime;          // Echoed from the query for responses
+};
+
+// Asks all of the servers on the LAN to respond with their info.
+struct ServerQueryPacket
+{
+    unsigned int    queryTime;          // Client time, used to measure the ping
+};
+
+/**
+ * Appends a framed message to the writer.
+ */
+void Write(MessageWriter& writer, const InitializeGamePacket& packet);
+void Write(MessageWriter& writer, const OrderPacket& packet);
+void Write(MessageWriter& writer, const GroupOrderPacket& packet);
+void Write(MessageWriter& writer, const NotificationPacket& packet);
+void Write(MessageWriter& writer, const MapRequestPacket& packet);
+void Write(MessageWriter& writer, const MapDataPacket& packet);
+
+/**
+ * Decodes the payload of a message. Returns false if the payload is truncated,
+ * has trailing data or contains out of range values.
+ */
+bool Read(MessageReader& reader, InitializeGamePacket& packet);
+bool Read(MessageReader& reader, OrderPacket& packet);
+bool Read(MessageReader& reader, GroupOrderPacket& packet);
+bool Read(MessageReader& reader, StatePacket& packet);
+bool Read(MessageReader& reader, NotificationPacket& packet);
+bool Read(MessageReader& reader, MapRequestPacket& packet);
+bool Read(MessageReader& reader, MapDataPacket& packet);
+
+/**
+ * Discovery datagrams are sent raw rather than as framed messages; they start
+ * with a header identifying the packet that follows. ReadDiscoveryHeader
+ * returns false if the magic number or version don't match.
+ */
+void WriteDiscoveryHeader(MessageWriter& writer, DiscoveryType type);
+bool ReadDiscoveryHeader(MessageReader& reader, DiscoveryType& type);
+
+void Write(MessageWriter& writer, const ServerInfoPacket& packet);
+void Write(MessageWriter& writer, const ServerQueryPacket& packet);
+bool Read(MessageReader& reader, ServerInfoPacket& packet);
+bool Read(MessageReader& reader, ServerQueryPacket& packet);
+
 }
 
 #endif
@@ -1,5 +1,48 @@
 #include "Render.h"
 #include "Texture.h"
+#include "PixelFormat.h"
+#include "Utility.h"
+
+#include <math.h>
+#include <vector>
+
+static const int kNumCircleSides = 16;
+
+static bool GetIsPowerOfTwo(int x)
+{
+    return x > 0 && (x & (x - 1)) == 0;
+}
+
+// Uploads the image and every smaller level, each made by halving the one
+// before with a box filter.
+static void UploadMipmaps(int xSize, int ySize, const void* buffer)
+{
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, xSize, ySize, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+
+    // Each level is only made from the one before, so two buffers are enough.
+    std::vector<unsigned char> levels[2];
+    const unsigned char* src = static_cast<const unsigned char*>(buffer);
+
+    for (int level = 1; xSize > 1 || ySize > 1; ++level)
+    {
+
+        int xMipSize = Max(xSize / 2, 1);
+        int yMipSize = Max(ySize / 2, 1);
+
+        std::vector<unsigned char>& dst = levels[level % 2];
+        dst.resize(xMipSize * yMipSize * 4);
+        PixelFormat_BuildMip(src, xSize, ySize, &dst[0]);
+
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, xMipSize, yMipSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, &dst[0]);
+
+        src   = &dst[0];
+        xSize = xMipSize;
+        ySize = yMipSize;
+
+    }
+
+}
 
 GLuint Render_CreateTexture(int xSize, int ySize, const void* buffer, int mipMap)
 {
@@ -19,7 +62,15 @@ GLuint Render_CreateTexture(int xSize, int ySize, const void* buffer, int mipMap
     if (mipMap)
     {
         glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        gluBuild2DMipmaps( GL_TEXTURE_2D, GL_RGBA, xSize, ySize, GL_RGBA, GL_UNSIGNED_BYTE, buffer );
+        if (GetIsPowerOfTwo(xSize) && GetIsPowerOfTwo(ySize))
+        {
+            UploadMipmaps(xSize, ySize, buffer);
+        }
+        else
+        {
+            // GLU rescales the image to a power of two first.
+            gluBuild2DMipmaps( GL_TEXTURE_2D, GL_RGBA, xSize, ySize, GL_RGBA, GL_UNSIGNED_BYTE, buffer );
+        }
     }
     else
     {
@@ -37,16 +88,16 @@ void Render_DrawSprite(const Texture& texture, int x, int y)
     glBindTexture( GL_TEXTURE_2D, texture.handle );
     glBegin(GL_QUADS);
 
-    glTexCoord2f(0, 0);
+    glTexCoord2f(texture.u1, texture.v1);
     glVertex2i(x, y);
 
-    glTexCoord2f(1, 0);
+    glTexCoord2f(texture.u2, texture.v1);
     glVertex2i(x + texture.xSize, y);
 
-    glTexCoord2f(1, 1);
+    glTexCoord2f(texture.u2, texture.v2);
     glVertex2i(x + texture.xSize, y + texture.ySize);
 
-    glTexCoord2f(0, 1);
+    glTexCoord2f(texture.u1, texture.v2);
     glVertex2i(x, y + texture.ySize);
 
     glEnd();
@@ -59,18 +110,44 @@ void Render_DrawSprite(const Texture& texture, int x, int y, int width, int heig
     glBindTexture( GL_TEXTURE_2D, texture.handle );
     glBegin(GL_QUADS);
 
-    glTexCoord2f(0, 0);
+    glTexCoord2f(texture.u1, texture.v1);
     glVertex2i(x, y);
 
-    glTexCoord2f(1, 0);
+    glTexCoord2f(texture.u2, texture.v1);
     glVertex2i(x + width, y);
 
-    glTexCoord2f(1, 1);
+    glTexCoord2f(texture.u2, texture.v2);
     glVertex2i(x + width, y + height);
 
-    glTexCoord2f(0, 1);
+    glTexCoord2f(texture.u1, texture.v2);
     glVertex2i(x, y + height);
 
     glEnd();
 
 }
+
+void Render_DrawCircle(const Vec2& point, float radius)
+{
+
+    // Unit circle, the first and last points are the same.
+    static Vec2 circle[kNumCircleSides];
+    static bool init = false;
+
+    if (!init)
+    {
+        for (int i = 0; i < kNumCircleSides; ++i)
+        {
+            float angle = (2.0f * i * 3.14159265f) / (kNumCircleSides - 1);
+            circle[i] = Vec2(cosf(angle), sinf(angle));
+        }
+        init = true;
+    }
+
+    glBegin(GL_TRIANGLE_FAN);
+    for (int i = 0; i < kNumCircleSides; ++i)
+    {
+        glVertex2f(point.x + circle[i].x * radius, point.y + circle[i].y * radius);
+    }
+    glEnd();
+
+}
@@ -6,11 +6,17 @@
 struct Texture;
 
 /**
- * Creates a new texture from the RGBA pixel data.
+ * Creates a new texture from the RGBA pixel data. If buffer is NULL the
+ * contents are left undefined to be filled in with glTexSubImage2D.
  */
 GLuint Render_CreateTexture(int xSize, int ySize, const void* buffer, int mipMap);
 
 void Render_DrawSprite(const Texture& texture, int x, int y);
 void Render_DrawSprite(const Texture& texture, int x, int y, int width, int height);
 
+/**
+ * Draws a filled circle with the current color.
+ */
+void Render_DrawCircle(const Vec2& point, float radius);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,597 @@
+#include "RoutePlanner.h"
+#include "Map.h"
+#include "Timer.h"
+#include "Log.h"
+#include "Utility.h"
+
+#include <algorithm>
+
+#include <assert.h>
+#include <float.h>
+
+// Witness searches give up after settling this many nodes. Stopping early
+// only means an unnecessary shortcut might be added.
+static const int kMaxWitnessSettled = 500;
+
+RoutePlanner::RoutePlanner(const Map* map)
+{
+    m_map           = map;
+    m_railSpeed     = 0.0f;
+    m_transferTime  = 0.0f;
+    m_witness       = 0;
+    m_query         = 0;
+}
+
+void RoutePlanner::Build(float railSpeed, float transferTime)
+{
+
+    assert(railSpeed > 0.0f);
+
+    Clear();
+
+    double startTime = Timer_GetTime();
+
+    m_railSpeed     = railSpeed;
+    m_transferTime  = transferTime;
+
+    BuildNodes();
+    Contract();
+    BuildUpwardEdges();
+
+    LogMessage("Built route hierarchy for %d platforms (%d edges) in %.1f ms",
+        static_cast<int>(m_nodeStop.size()), static_cast<int>(m_upwardEdges.size()),
+        (Timer_GetTime() - startTime) * 1000.0);
+
+}
+
+void RoutePlanner::Clear()
+{
+
+    m_railSpeed = 0.0f;
+
+    m_stopFirstNode.clear();
+    m_nodeStop.clear();
+    m_rank.clear();
+    m_upwardStart.clear();
+    m_upwardEdges.clear();
+
+    m_forward.reached.clear();
+    m_backward.reached.clear();
+
+}
+
+float RoutePlanner::GetHopTime(int stopA, int stopB) const
+{
+
+    int numNeighbors = m_map->GetNumNeighbors(stopA);
+    for (int i = 0; i < numNeighbors; ++i)
+    {
+        if (m_map->GetNeighbor(stopA, i) == stopB)
+        {
+            return m_map->GetNeighborDistance(stopA, i) / m_railSpeed;
+        }
+    }
+
+    return -1.0f;
+
+}
+
+float RoutePlanner::GetRoute(int start, int goal, std::vector<int>& stops)
+{
+
+    stops.clear();
+
+    int numStops = m_map->GetNumStops();
+    if (!GetIsBuilt() || start < 0 || start >= numStops || goal < 0 || goal >= numStops)
+    {
+        return -1.0f;
+    }
+
+    if (start == goal)
+    {
+        stops.push_back(start);
+        return 0.0f;
+    }
+
+    BeginQuery();
+
+    // A route can begin and end on any line at the stop.
+    for (int i = m_stopFirstNode[start]; i < m_stopFirstNode[start + 1]; ++i)
+    {
+        Reach(m_forward, i, 0.0f, -1, -1);
+    }
+    for (int i = m_stopFirstNode[goal]; i < m_stopFirstNode[goal + 1]; ++i)
+    {
+        Reach(m_backward, i, 0.0f, -1, -1);
+    }
+
+    // Both searches only climb the hierarchy, and the quickest route passes
+    // through the highest ranked node on it, where they meet.
+    float bestTime = FLT_MAX;
+    int meetingNode = -1;
+
+    while (true)
+    {
+        float forwardTime  = m_forward.heap.empty()  ? FLT_MAX : m_forward.heap.front().time;
+        float backwardTime = m_backward.heap.empty() ? FLT_MAX : m_backward.heap.front().time;
+        if (Min(forwardTime, backwardTime) >= bestTime)
+        {
+            break;
+        }
+        if (forwardTime <= backwardTime)
+        {
+            Expand(m_forward, bestTime, meetingNode, m_backward);
+        }
+        else
+        {
+            Expand(m_backward, bestTime, meetingNode, m_forward);
+        }
+    }
+
+    if (meetingNode == -1)
+    {
+        return -1.0f;
+    }
+
+    // Walk back from the meeting node to the start, then unpack the
+    // shortcuts on the way forward to the goal.
+    std::vector<int> chain;
+    for (int node = meetingNode; node != -1; node = m_forward.parent[node])
+    {
+        chain.push_back(node);
+    }
+    std::reverse(chain.begin(), chain.end());
+
+    m_nodes.clear();
+    m_nodes.push_back(chain[0]);
+    for (size_t i = 1; i < chain.size(); ++i)
+    {
+        Unpack(chain[i - 1], chain[i], m_forward.middle[chain[i]], m_nodes);
+    }
+    for (int node = meetingNode; m_backward.parent[node] != -1; node = m_backward.parent[node])
+    {
+        Unpack(node, m_backward.parent[node], m_backward.middle[node], m_nodes);
+    }
+
+    // Changing lines moves between platforms of the same stop, which isn't a
+    // step on the route.
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        int stop = m_nodeStop[m_nodes[i]];
+        if (stops.empty() || stops.back() != stop)
+        {
+            stops.push_back(stop);
+        }
+    }
+
+    return bestTime;
+
+}
+
+int RoutePlanner::GetNextStop(int start, int goal)
+{
+    std::vector<int> stops;
+    if (GetRoute(start, goal, stops) < 0.0f)
+    {
+        return -1;
+    }
+    return stops.size() > 1 ? stops[1] : start;
+}
+
+bool RoutePlanner::CompareHeapEntries(const HeapEntry& a, const HeapEntry& b)
+{
+    // std::push_heap builds a max heap, so flip the comparison. Ties are
+    // broken by node so every platform produces the same routes.
+    return a.time > b.time || (a.time == b.time && a.node > b.node);
+}
+
+void RoutePlanner::PushHeap(Heap& heap, float time, int node)
+{
+    HeapEntry entry;
+    entry.time = time;
+    entry.node = node;
+    heap.push_back(entry);
+    std::push_heap(heap.begin(), heap.end(), CompareHeapEntries);
+}
+
+RoutePlanner::HeapEntry RoutePlanner::PopHeap(Heap& heap)
+{
+    std::pop_heap(heap.begin(), heap.end(), CompareHeapEntries);
+    HeapEntry entry = heap.back();
+    heap.pop_back();
+    return entry;
+}
+
+void RoutePlanner::BuildNodes()
+{
+
+    int numStops = m_map->GetNumStops();
+
+    // One platform for each line that serves a stop.
+    std::vector<int> nodeLine;
+    m_stopFirstNode.resize(numStops + 1);
+    for (int stop = 0; stop < numStops; ++stop)
+    {
+        m_stopFirstNode[stop] = static_cast<int>(nodeLine.size());
+        for (int i = 0; i < m_map->GetNumNeighbors(stop); ++i)
+        {
+            int line = m_map->GetNeighborLine(stop, i);
+            if (std::find(nodeLine.begin() + m_stopFirstNode[stop], nodeLine.end(), line) == nodeLine.end())
+            {
+                nodeLine.push_back(line);
+                m_nodeStop.push_back(stop);
+            }
+        }
+    }
+    m_stopFirstNode[numStops] = static_cast<int>(nodeLine.size());
+
+    m_graph.assign(nodeLine.size(), EdgeList());
+
+    for (int stop = 0; stop < numStops; ++stop)
+    {
+
+        int firstNode = m_stopFirstNode[stop];
+        int lastNode  = m_stopFirstNode[stop + 1];
+
+        // Each rail appears from both ends, so only add it from one.
+        for (int i = 0; i < m_map->GetNumNeighbors(stop); ++i)
+        {
+            int neighbor = m_map->GetNeighbor(stop, i);
+            if (neighbor < stop)
+            {
+                continue;
+            }
+
+            int line = m_map->GetNeighborLine(stop, i);
+            int nodeA = static_cast<int>(std::find(nodeLine.begin() + firstNode, nodeLine.begin() + lastNode, line) - nodeLine.begin());
+            int nodeB = static_cast<int>(std::find(nodeLine.begin() + m_stopFirstNode[neighbor], nodeLine.begin() + m_stopFirstNode[neighbor + 1], line) - nodeLine.begin());
+            AddEdge(nodeA, nodeB, m_map->GetNeighborDistance(stop, i) / m_railSpeed, -1);
+        }
+
+        for (int nodeA = firstNode; nodeA < lastNode; ++nodeA)
+        {
+            for (int nodeB = nodeA + 1; nodeB < lastNode; ++nodeB)
+            {
+                AddEdge(nodeA, nodeB, m_transferTime, -1);
+            }
+        }
+
+    }
+
+}
+
+void RoutePlanner::AddEdge(int nodeA, int nodeB, float time, int middle)
+{
+
+    // Keep only the quickest edge between two nodes.
+    EdgeList& edgesA = m_graph[nodeA];
+    for (size_t i = 0; i < edgesA.size(); ++i)
+    {
+        if (edgesA[i].node == nodeB)
+        {
+            if (time < edgesA[i].time)
+            {
+                edgesA[i].time   = time;
+                edgesA[i].middle = middle;
+
+                EdgeList& edgesB = m_graph[nodeB];
+                for (size_t j = 0; j < edgesB.size(); ++j)
+                {
+                    if (edgesB[j].node == nodeA)
+                    {
+                        edgesB[j].time   = time;
+                        edgesB[j].middle = middle;
+                        break;
+                    }
+                }
+            }
+            return;
+        }
+    }
+
+    Edge edge;
+    edge.time   = time;
+    edge.middle = middle;
+
+    edge.node = nodeB;
+    edgesA.push_back(edge);
+
+    edge.node = nodeA;
+    m_graph[nodeB].push_back(edge);
+
+}
+
+void RoutePlanner::Contract()
+{
+
+    int numNodes = static_cast<int>(m_graph.size());
+
+    m_contracted.assign(numNodes, 0);
+    m_numContractedNeighbors.assign(numNodes, 0);
+    m_rank.assign(numNodes, -1);
+    m_witnessTime.resize(numNodes);
+    m_witnessStamp.assign(numNodes, 0);
+    m_witness = 0;
+
+    // Nodes whose removal adds the fewest shortcuts go first. Priorities
+    // change as neighbors are contracted, so they're checked again as each
+    // node comes off the queue.
+    Heap queue;
+    for (int node = 0; node < numNodes; ++node)
+    {
+        PushHeap(queue, static_cast<float>(GetPriority(node)), node);
+    }
+
+    int rank = 0;
+    while (!queue.empty())
+    {
+
+        int node = PopHeap(queue).node;
+
+        float priority = static_cast<float>(GetPriority(node));
+        if (!queue.empty() && priority > queue.front().time)
+        {
+            PushHeap(queue, priority, node);
+            continue;
+        }
+
+        ContractNode(node, false);
+        m_contracted[node] = 1;
+        m_rank[node] = rank++;
+
+        const EdgeList& edges = m_graph[node];
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            ++m_numContractedNeighbors[edges[i].node];
+        }
+
+    }
+
+}
+
+int RoutePlanner::ContractNode(int node, bool simulate)
+{
+
+    // Copied since adding shortcuts changes the neighbors' edge lists.
+    EdgeList neighbors;
+    const EdgeList& edges = m_graph[node];
+    for (size_t i = 0; i < edges.size(); ++i)
+    {
+        if (!m_contracted[edges[i].node])
+        {
+            neighbors.push_back(edges[i]);
+        }
+    }
+
+    int numShortcuts = 0;
+
+    for (size_t i = 0; i + 1 < neighbors.size(); ++i)
+    {
+
+        float maxTime = 0.0f;
+        for (size_t j = i + 1; j < neighbors.size(); ++j)
+        {
+            maxTime = Max(maxTime, neighbors[i].time + neighbors[j].time);
+        }
+
+        // A shortcut is only needed if there's no route at least as quick
+        // that avoids this node.
+        FindWitnesses(neighbors[i].node, node, maxTime);
+
+        for (size_t j = i + 1; j < neighbors.size(); ++j)
+        {
+            int other = neighbors[j].node;
+            float time = neighbors[i].time + neighbors[j].time;
+            if (m_witnessStamp[other] == m_witness && m_witnessTime[other] <= time)
+            {
+                continue;
+            }
+            ++numShortcuts;
+            if (!simulate)
+            {
+                AddEdge(neighbors[i].node, other, time, node);
+            }
+        }
+
+    }
+
+    return numShortcuts;
+
+}
+
+int RoutePlanner::GetPriority(int node)
+{
+
+    int numNeighbors = 0;
+    const EdgeList& edges = m_graph[node];
+    for (size_t i = 0; i < edges.size(); ++i)
+    {
+        if (!m_contracted[edges[i].node])
+        {
+            ++numNeighbors;
+        }
+    }
+
+    // The edge difference, plus a term that spreads the contraction out over
+    // the map rather than eating into one area.
+    return ContractNode(node, true) - numNeighbors + m_numContractedNeighbors[node];
+
+}
+
+void RoutePlanner::FindWitnesses(int source, int excluded, float maxTime)
+{
+
+    ++m_witness;
+    if (m_witness == 0)
+    {
+        std::fill(m_witnessStamp.begin(), m_witnessStamp.end(), 0);
+        m_witness = 1;
+    }
+
+    m_witnessHeap.clear();
+    m_witnessStamp[source] = m_witness;
+    m_witnessTime[source]  = 0.0f;
+    PushHeap(m_witnessHeap, 0.0f, source);
+
+    int numSettled = 0;
+    while (!m_witnessHeap.empty() && numSettled < kMaxWitnessSettled)
+    {
+
+        HeapEntry entry = PopHeap(m_witnessHeap);
+        if (entry.time > m_witnessTime[entry.node])
+        {
+            continue;
+        }
+        if (entry.time > maxTime)
+        {
+            break;
+        }
+        ++numSettled;
+
+        const EdgeList& edges = m_graph[entry.node];
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            int node = edges[i].node;
+            if (node == excluded || m_contracted[node])
+            {
+                continue;
+            }
+            float time = entry.time + edges[i].time;
+            if (m_witnessStamp[node] != m_witness || time < m_witnessTime[node])
+            {
+                m_witnessStamp[node] = m_witness;
+                m_witnessTime[node]  = time;
+                PushHeap(m_witnessHeap, time, node);
+            }
+        }
+
+    }
+
+}
+
+void RoutePlanner::BuildUpwardEdges()
+{
+
+    int numNodes = static_cast<int>(m_graph.size());
+
+    m_upwardStart.resize(numNodes + 1);
+    for (int node = 0; node < numNodes; ++node)
+    {
+        m_upwardStart[node] = static_cast<int>(m_upwardEdges.size());
+        const EdgeList& edges = m_graph[node];
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            if (m_rank[edges[i].node] > m_rank[node])
+            {
+                m_upwardEdges.push_back(edges[i]);
+            }
+        }
+    }
+    m_upwardStart[numNodes] = static_cast<int>(m_upwardEdges.size());
+
+    // The rest is only needed while building.
+    std::vector<EdgeList>().swap(m_graph);
+    std::vector<char>().swap(m_contracted);
+    std::vector<int>().swap(m_numContractedNeighbors);
+    std::vector<float>().swap(m_witnessTime);
+    std::vector<unsigned int>().swap(m_witnessStamp);
+    Heap().swap(m_witnessHeap);
+
+}
+
+void RoutePlanner::BeginQuery()
+{
+
+    size_t numNodes = m_nodeStop.size();
+
+    // Start over if the hierarchy has changed or the stamp wraps around.
+    ++m_query;
+    if (m_forward.reached.size() != numNodes || m_query == 0)
+    {
+        m_forward.reached.assign(numNodes, 0);
+        m_forward.time.resize(numNodes);
+        m_forward.parent.resize(numNodes);
+        m_forward.middle.resize(numNodes);
+        m_backward.reached.assign(numNodes, 0);
+        m_backward.time.resize(numNodes);
+        m_backward.parent.resize(numNodes);
+        m_backward.middle.resize(numNodes);
+        m_query = 1;
+    }
+
+    m_forward.heap.clear();
+    m_backward.heap.clear();
+
+}
+
+void RoutePlanner::Reach(Search& search, int node, float time, int parent, int middle)
+{
+    if (search.reached[node] != m_query || time < search.time[node])
+    {
+        search.reached[node] = m_query;
+        search.time[node]    = time;
+        search.parent[node]  = parent;
+        search.middle[node]  = middle;
+        PushHeap(search.heap, time, node);
+    }
+}
+
+void RoutePlanner::Expand(Search& search, float& bestTime, int& meetingNode, const Search& other)
+{
+
+    HeapEntry entry = PopHeap(search.heap);
+    int node = entry.node;
+    if (entry.time > search.time[node])
+    {
+        return;
+    }
+
+    if (other.reached[node] == m_query)
+    {
+        float time = entry.time + other.time[node];
+        if (time < bestTime)
+        {
+            bestTime    = time;
+            meetingNode = node;
+        }
+    }
+
+    for (int i = m_upwardStart[node]; i < m_upwardStart[node + 1]; ++i)
+    {
+        const Edge& edge = m_upwardEdges[i];
+        Reach(search, edge.node, entry.time + edge.time, node, edge.middle);
+    }
+
+}
+
+const RoutePlanner::Edge* RoutePlanner::FindUpwardEdge(int from, int to) const
+{
+    for (int i = m_upwardStart[from]; i < m_upwardStart[from + 1]; ++i)
+    {
+        if (m_upwardEdges[i].node == to)
+        {
+            return &m_upwardEdges[i];
+        }
+    }
+    return NULL;
+}
+
+void RoutePlanner::Unpack(int from, int to, int middle, std::vector<int>& nodes) const
+{
+
+    if (middle == -1)
+    {
+        nodes.push_back(to);
+        return;
+    }
+
+    // The skipped node was contracted before both ends, so it holds the two
+    // edges the shortcut replaced.
+    const Edge* first  = FindUpwardEdge(middle, from);
+    const Edge* second = FindUpwardEdge(middle, to);
+    assert(first != NULL && second != NULL);
+
+    Unpack(from, middle, first->middle, nodes);
+    Unpack(middle, to, second->middle, nodes);
+
+}
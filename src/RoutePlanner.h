@@ -0,0 +1,120 @@
+#ifndef GAME_ROUTE_PLANNER_H
+#define GAME_ROUTE_PLANNER_H
+
+#include <vector>
+
+class Map;
+
+/**
+ * Finds the quickest routes across a map when rails take time in proportion
+ * to their length and changing lines at a stop costs extra. Each stop is
+ * split into a platform per line that serves it, with transfer edges between
+ * the platforms. The platform graph is preprocessed into a contraction
+ * hierarchy, so each query only explores a small part of the map.
+ */
+class RoutePlanner
+{
+
+public:
+
+    explicit RoutePlanner(const Map* map);
+
+    // Preprocesses the map. Rails are travelled at railSpeed (world units per
+    // second) and changing lines takes transferTime seconds. Must be called
+    // again whenever the map is regenerated.
+    void Build(float railSpeed, float transferTime);
+    void Clear();
+
+    bool  GetIsBuilt() const { return m_railSpeed > 0.0f; }
+
+    // Time to travel along the rail between two adjacent stops.
+    float GetHopTime(int stopA, int stopB) const;
+
+    // Stores the stops from start to goal inclusive in stops and returns the
+    // travel time, or -1 if goal can't be reached.
+    float GetRoute(int start, int goal, std::vector<int>& stops);
+
+    // Returns the stop to move to from start on the quickest route to goal,
+    // start if they're the same or -1 if goal can't be reached.
+    int   GetNextStop(int start, int goal);
+
+private:
+
+    struct Edge
+    {
+        int     node;
+        float   time;
+        int     middle;     // Node the shortcut skips over, or -1 for an original edge
+    };
+
+    struct HeapEntry
+    {
+        float   time;
+        int     node;
+    };
+
+    typedef std::vector<Edge> EdgeList;
+    typedef std::vector<HeapEntry> Heap;
+
+    struct Search
+    {
+        std::vector<unsigned int>   reached;
+        std::vector<float>          time;
+        std::vector<int>            parent;
+        std::vector<int>            middle;     // Of the edge from the parent
+        Heap                        heap;
+    };
+
+    static bool CompareHeapEntries(const HeapEntry& a, const HeapEntry& b);
+    static void PushHeap(Heap& heap, float time, int node);
+    static HeapEntry PopHeap(Heap& heap);
+
+    void BuildNodes();
+    void AddEdge(int nodeA, int nodeB, float time, int middle);
+    void Contract();
+    int  ContractNode(int node, bool simulate);
+    int  GetPriority(int node);
+    void FindWitnesses(int source, int excluded, float maxTime);
+    void BuildUpwardEdges();
+
+    void BeginQuery();
+    void Reach(Search& search, int node, float time, int parent, int middle);
+    void Expand(Search& search, float& bestTime, int& meetingNode, const Search& other);
+
+    const Edge* FindUpwardEdge(int from, int to) const;
+    void Unpack(int from, int to, int middle, std::vector<int>& nodes) const;
+
+private:
+
+    const Map*                  m_map;
+    float                       m_railSpeed;
+    float                       m_transferTime;
+
+    // Platforms for stop i are m_stopFirstNode[i] up to m_stopFirstNode[i + 1].
+    std::vector<int>            m_stopFirstNode;
+    std::vector<int>            m_nodeStop;
+
+    // Only used while the hierarchy is built.
+    std::vector<EdgeList>       m_graph;
+    std::vector<char>           m_contracted;
+    std::vector<int>            m_numContractedNeighbors;
+    std::vector<float>          m_witnessTime;
+    std::vector<unsigned int>   m_witnessStamp;
+    unsigned int                m_witness;
+    Heap                        m_witnessHeap;
+
+    // The finished hierarchy. Each node keeps the edges to nodes that were
+    // contracted after it; since every edge goes both ways both searches of a
+    // query use the same edges.
+    std::vector<int>            m_rank;
+    std::vector<int>            m_upwardStart;
+    EdgeList                    m_upwardEdges;
+
+    unsigned int                m_query;
+    Search                      m_forward;
+    Search                      m_backward;
+    std::vector<int>            m_nodes;
+
+};
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "Log.h"
 #include "Map.h"
+#include "MapPool.h"
 #include "BuildingEntity.h"
 #include "PlayerEntity.h"
 
@@ -10,7 +11,9 @@
 #include <time.h>
 
 static const float kServerTickRate      = 1.0f / 30.0f;
-static const float kServerBroadcastRate = 1.0f;
+
+// Weight given to each new tick when averaging the server load.
+static const float kLoadSmoothing       = 0.05f;
 
 static const float kIntelHackTime       = 5.0f;
 
@@ -18,8 +21,11 @@ Server::Client::Client(int id, Server& server)
 {
 
     m_id = id;
+    m_lastOrder = 0;
     m_server = &server;
     m_map = &server.GetMap();
+    m_pathFinder = &server.GetPathFinder();
+    m_routePlanner = &server.GetRoutePlanner();
     m_state = &server.GetState();
 
     m_random.Seed(SDL_GetTicks());
@@ -51,7 +57,7 @@ Server::Client::Client(int id, Server& server)
         for (int j = 0; j < m_map->GetNumStops(); ++j)
         {
             stopIndex = (j + offset) % m_map->GetNumStops();
-            if (m_map->GetStop(stopIndex).structureType  == StructureType_None)
+            if (m_map->GetStopStructure(stopIndex)  == StructureType_None)
             {
                 break;
             }
@@ -70,6 +76,11 @@ int Server::Client::GetId() const
     return m_id;
 }
 
+unsigned int Server::Client::GetLastOrder() const
+{
+    return m_lastOrder;
+}
+
 void Server::Client::Update()
 {
 
@@ -84,6 +95,7 @@ void Server::Client::Update()
         if ((*i)->GetOwnerId() != m_id)
         {
             // Agent lost!
+            CancelRoute(*i);
             i = m_agents.erase(i);
         }
         else
@@ -105,9 +117,15 @@ void Server::Client::Update()
             {
                 m_server->GetIntel(agent->m_intel).m_stop = agent->m_currentStop;
             }
-            CheckForStakeout(agent);
+            if (CheckForStakeout(agent))
+            {
+                // Being spotted interrupts the route.
+                CancelRoute(agent);
+            }
         }
 
+        AdvanceRoute(agent);
+
     }
 
     // Hacking
@@ -130,7 +148,7 @@ void Server::Client::Update()
 
 }
 
-void Server::Client::CheckForStakeout(AgentEntity* agent)
+bool Server::Client::CheckForStakeout(AgentEntity* agent)
 {
     bool spotted = false;
 
@@ -156,10 +174,16 @@ void Server::Client::CheckForStakeout(AgentEntity* agent)
         NotifyCrime(agent->GetId(), agent->m_currentStop);
     }
 
+    return spotted;
+
 }
 
 void Server::Client::OnOrder(const Protocol::OrderPacket& order)
 {
+
+    // Acknowledge the order even if it's rejected so the client stops
+    // predicting it.
+    m_lastOrder = order.sequence;
     
     AgentEntity* agent = FindAgent(order.agentId);
 
@@ -168,23 +192,58 @@ void Server::Client::OnOrder(const Protocol::OrderPacket& order)
         return;
     }
 
-    switch (order.order)
+    ExecuteOrder(agent, order.order, order.targetStop);
+
+}
+
+void Server::Client::OnGroupOrder(const Protocol::GroupOrderPacket& order)
+{
+
+    m_lastOrder = order.sequence;
+
+    if (m_player->m_eliminated)
     {
-    case Protocol::Order_MoveTo:
+        return;
+    }
+
+    bool sharedTarget = order.targetStops.size() == 1;
+
+    for (size_t i = 0; i < order.agentIds.size(); ++i)
+    {
+
+        // Ignore agents listed more than once so toggles aren't undone.
+        std::vector<int>::const_iterator previous = order.agentIds.begin() + i;
+        if (std::find(order.agentIds.begin(), previous, order.agentIds[i]) != previous)
         {
-            const std::vector<int>& neighbors = m_map->GetStop(agent->m_currentStop).children;
-            if (agent->m_targetStop == -1 && std::find(neighbors.begin(), neighbors.end(), order.targetStop) != neighbors.end())
-            {
-                agent->m_targetStop = order.targetStop;
-                agent->m_departureTime = m_state->GetTime();
-                agent->m_arrivalTime = m_state->GetTime() + 1;
-                agent->m_state = AgentEntity::State_Idle;
-
-                int line = m_map->GetLineBetween(agent->m_currentStop, agent->m_targetStop);
-                assert(line != -1);
-                m_server->OnLineUsed(m_id, line);
-            }
+            continue;
+        }
+
+        AgentEntity* agent = FindAgent(order.agentIds[i]);
+        if (agent != NULL)
+        {
+            ExecuteOrder(agent, order.order, order.targetStops[sharedTarget ? 0 : i]);
         }
+
+    }
+
+}
+
+void Server::Client::ExecuteOrder(AgentEntity* agent, Protocol::Order order, int targetStop)
+{
+
+    switch (order)
+    {
+    case Protocol::Order_MoveTo:
+        CancelRoute(agent);
+        MoveAgent(agent, targetStop);
+        break;
+
+    case Protocol::Order_Route:
+        SetRoute(agent, targetStop);
+        break;
+
+    case Protocol::Order_Cancel:
+        CancelRoute(agent);
         break;
 
     case Protocol::Order_Capture:
@@ -202,6 +261,7 @@ void Server::Client::OnOrder(const Protocol::OrderPacket& order)
                         // Capture this agent!
                         int oldOwnerId = capturedAgent->GetOwnerId();
                         capturedAgent->SetOwnerId(m_id);
+                        capturedAgent->m_destinationStop = -1;
                         if (capturedAgent->m_intel != -1)
                         {
                             IntelData& intelData = m_server->GetIntel(capturedAgent->m_intel);
@@ -227,7 +287,7 @@ void Server::Client::OnOrder(const Protocol::OrderPacket& order)
 
     case Protocol::Order_Hack:
         {
-            StructureType structureType = m_map->GetStop(agent->m_currentStop).structureType;
+            StructureType structureType = m_map->GetStopStructure(agent->m_currentStop);
             if (structureType != StructureType_None)
             {
                 if (agent->m_state == AgentEntity::State_Hacking)
@@ -237,6 +297,7 @@ void Server::Client::OnOrder(const Protocol::OrderPacket& order)
                 else
                 {
                     agent->m_state = AgentEntity::State_Hacking;
+                    CancelRoute(agent);
                 }
                 break;
             }
@@ -251,6 +312,7 @@ void Server::Client::OnOrder(const Protocol::OrderPacket& order)
         else
         {
             agent->m_state = AgentEntity::State_Stakeout;
+            CancelRoute(agent);
         }   
         break;
 
@@ -376,6 +438,11 @@ PlayerEntity* Server::Client::GetPlayer()
     return m_player;
 }
 
+MessageWriter& Server::Client::GetOutgoing()
+{
+    return m_outgoing;
+}
+
 void Server::Client::UpdateHackingStatus()
 {
     bool wasHackingTower = m_player->m_hackingTower;
@@ -388,7 +455,7 @@ void Server::Client::UpdateHackingStatus()
         const AgentEntity* agent = m_agents[i];
         if (agent->m_state == AgentEntity::State_Hacking)
         {
-            switch (m_map->GetStop(agent->m_currentStop).structureType)
+            switch (m_map->GetStopStructure(agent->m_currentStop))
             {   
             case StructureType_Bank:
                 m_player->m_hackingBank = true;
@@ -449,10 +516,104 @@ AgentEntity* Server::Client::FindAgent(int agentId)
     return NULL;
 }
 
+bool Server::Client::MoveAgent(AgentEntity* agent, int stop)
+{
+
+    int line = m_map->GetLineBetween(agent->m_currentStop, stop);
+    if (agent->m_targetStop != -1 || line == -1)
+    {
+        return false;
+    }
+
+    agent->m_targetStop = stop;
+    agent->m_departureTime = m_state->GetTime();
+    agent->m_arrivalTime = m_state->GetTime() + m_server->GetHopTime(agent->m_currentStop, stop);
+    agent->m_state = AgentEntity::State_Idle;
+
+    m_server->OnLineUsed(m_id, line);
+
+    return true;
+
+}
+
+bool Server::Client::SetRoute(AgentEntity* agent, int destination)
+{
+
+    if (destination < 0 || destination >= m_map->GetNumStops())
+    {
+        return false;
+    }
+
+    // If the agent is between stops the route starts where it's headed.
+    int start = agent->m_targetStop != -1 ? agent->m_targetStop : agent->m_currentStop;
+
+    std::vector<int> path;
+    if (m_routePlanner->GetIsBuilt())
+    {
+        m_routePlanner->GetRoute(start, destination, path);
+    }
+    else
+    {
+        m_pathFinder->GetPath(start, destination, path);
+    }
+    int pathLength = static_cast<int>(path.size());
+    if (pathLength == 0)
+    {
+        return false;
+    }
+
+    CancelRoute(agent);
+
+    if (pathLength > 1)
+    {
+        std::vector<int>& route = m_routes[agent->GetId()];
+        route.assign(path.begin() + 1, path.end());
+        std::reverse(route.begin(), route.end());
+        agent->m_destinationStop = destination;
+        AdvanceRoute(agent);
+    }
+
+    return true;
+
+}
+
+void Server::Client::CancelRoute(AgentEntity* agent)
+{
+    m_routes.erase(agent->GetId());
+    agent->m_destinationStop = -1;
+}
+
+void Server::Client::AdvanceRoute(AgentEntity* agent)
+{
+
+    if (agent->m_targetStop != -1)
+    {
+        return;
+    }
+
+    RouteMap::iterator iter = m_routes.find(agent->GetId());
+    if (iter == m_routes.end())
+    {
+        return;
+    }
+
+    std::vector<int>& route = iter->second;
+    if (route.empty() || !MoveAgent(agent, route.back()))
+    {
+        // Arrived (or the route is no longer valid).
+        CancelRoute(agent);
+        return;
+    }
+    route.pop_back();
 
-Server::Server() 
+}
+
+
+Server::Server(LanBroadcast::Mode discoveryMode, float railSpeed, MapPool* mapPool) 
     : m_host(1), 
-      m_globalState(&m_typeRegistry)
+      m_globalState(&m_typeRegistry),
+      m_pathFinder(&m_map),
+      m_routePlanner(&m_map)
 {
     const int numIntels     = 5;
     const int gamePort      = 12345;
@@ -460,17 +621,33 @@ Server::Server()
     m_random.Seed(SDL_GetTicks());
 
     m_host.Listen(gamePort);
-    m_lanBroadcast.Initialize(Protocol::listenPort, gamePort);
+    m_lanBroadcast.Initialize(Protocol::listenPort, gamePort, discoveryMode);
 
     m_time                  = 0;
     m_timeSinceUpdate       = 0;
-    m_timeSinceBroadcast    = 0;
-    m_mapSeed               = static_cast<int>(time(NULL));
-    m_gridSpacing           = 150;
-    m_xMapSize              = m_gridSpacing * 9;
-    m_yMapSize              = m_gridSpacing * 6;
-
-    m_map.Generate(m_xMapSize, m_yMapSize, m_mapSeed);
+    m_tickOverrunRate       = 0;
+    m_load                  = 0;
+    m_railSpeed             = railSpeed;
+    m_gridSpacing           = s_gridSpacing;
+    m_xMapSize              = s_xMapSize;
+    m_yMapSize              = s_yMapSize;
+
+    if (mapPool != NULL && mapPool->Take(m_map, m_xMapSize, m_yMapSize))
+    {
+        LogMessage("Using map %d from the pool (%d ready, %d rejected, %.1f maps/s)",
+            m_map.GetSeed(), mapPool->GetNumReady(), mapPool->GetNumRejected(), mapPool->GetGenerationRate());
+    }
+    else
+    {
+        // The seed is new every time, so there's no point caching the map.
+        m_map.Generate(m_xMapSize, m_yMapSize, static_cast<int>(time(NULL)));
+    }
+    m_mapSeed               = m_map.GetSeed();
+    m_pathFinder.BuildTable();
+    if (m_railSpeed > 0.0f)
+    {
+        m_routePlanner.Build(m_railSpeed, Protocol::transferTime);
+    }
 
     // Generate intel
     m_intelList.resize(numIntels);
@@ -512,13 +689,16 @@ void Server::Update(float deltaTime)
 {
 
     m_timeSinceUpdate += deltaTime;
-    m_timeSinceBroadcast += deltaTime;
 
-    if (m_timeSinceBroadcast > kServerBroadcastRate)
-    {
-        m_lanBroadcast.BroadcastInfo();
-        m_timeSinceBroadcast = 0.0f;
-    }
+    // Discovery queries are answered from here rather than the tick so the
+    // response time doesn't depend on the tick rate.
+    Protocol::ServerInfoPacket info;
+    info.numPlayers         = static_cast<int>(m_clientMap.size());
+    info.maxPlayers         = Host::s_maxPeers;
+    info.mapSeed            = m_mapSeed;
+    info.tickOverrunRate    = m_tickOverrunRate;
+    info.load               = m_load;
+    m_lanBroadcast.Update(info);
     
     if (m_timeSinceUpdate > kServerTickRate)
     {
@@ -526,6 +706,13 @@ void Server::Update(float deltaTime)
         m_timeSinceUpdate -= kServerTickRate;
         m_time += kServerTickRate;
 
+        // Only one tick is run per update, so if another one is already due
+        // the server is falling behind.
+        float overrun = m_timeSinceUpdate > kServerTickRate ? 1.0f : 0.0f;
+        m_tickOverrunRate += (overrun - m_tickOverrunRate) * kLoadSmoothing;
+
+        Uint32 tickStart = SDL_GetTicks();
+
         m_globalState.SetTime(m_time);
 
         m_host.Service(this);
@@ -538,8 +725,12 @@ void Server::Update(float deltaTime)
         for (ClientMap::iterator i = m_clientMap.begin(); i != m_clientMap.end(); ++i)
         {
             SendClientState(i->second->GetId());
+            FlushClient(i->second);
         }
 
+        float tickTime = static_cast<float>(SDL_GetTicks() - tickStart) / 1000.0f;
+        m_load += (tickTime / kServerTickRate - m_load) * kLoadSmoothing;
+
     }
 
     // Check intel end game condition
@@ -580,19 +771,22 @@ void Server::Update(float deltaTime)
 
 void Server::OnConnect(int peerId)
 {
-    m_clientMap[peerId] = new Client(peerId, *this);
+    Client* client = new Client(peerId, *this);
+    m_clientMap[peerId] = client;
 
     Protocol::InitializeGamePacket initializeGame;
     initializeGame.time         = m_time;
     initializeGame.clientId     = peerId;
-    initializeGame.packetType   = Protocol::PacketType_InitializeGame;
     initializeGame.mapSeed      = m_mapSeed;
     initializeGame.gridSpacing  = m_gridSpacing;
     initializeGame.xMapSize     = m_xMapSize;
     initializeGame.yMapSize     = m_yMapSize;
     initializeGame.totalNumIntels    = static_cast<int>(m_intelList.size());
-    
-    m_host.SendPacket(peerId, 0, &initializeGame, sizeof(Protocol::InitializeGamePacket));
+    initializeGame.railSpeed    = m_railSpeed;
+    initializeGame.mapHash      = m_map.GetHash();
+
+    // Goes out with the first state update at the end of the tick.
+    Protocol::Write(client->GetOutgoing(), initializeGame);
 }
 
 void Server::OnDisconnect(int peerId)
@@ -628,33 +822,68 @@ Server::IntelData& Server::GetIntel(int intel)
 void Server::OnPacket(int peerId, int channel, void* data, size_t size)
 {
 
-    if (size == 0)
-    {
-        return;
-    }
-
-    char* byteData = static_cast<char*>(data);
-    Protocol::PacketType packetType = static_cast<Protocol::PacketType>(*byteData);
-
     Client* client = FindClient(peerId);
 
-    switch (packetType)
+    MessageReader reader(data, size);
+    MessageReader message;
+    int messageType;
+
+    while (reader.ReadMessage(messageType, message))
     {
-    case Protocol::PacketType_Order:
-        if (size != sizeof(Protocol::OrderPacket))
-        {
-            LogError("Malformed order packet");
-        }
-        else if (client != NULL)
+        switch (messageType)
         {
-            client->OnOrder(*static_cast<Protocol::OrderPacket*>(data));
+        case Protocol::MessageType_Order:
+            {
+                Protocol::OrderPacket order;
+                if (!Protocol::Read(message, order))
+                {
+                    LogError("Malformed order message");
+                }
+                else if (client != NULL)
+                {
+                    client->OnOrder(order);
+                }
+            }
+            break;
+
+        case Protocol::MessageType_GroupOrder:
+            {
+                Protocol::GroupOrderPacket order;
+                if (!Protocol::Read(message, order))
+                {
+                    LogError("Malformed group order message");
+                }
+                else if (client != NULL)
+                {
+                    client->OnGroupOrder(order);
+                }
+            }
+            break;
+
+        case Protocol::MessageType_MapRequest:
+            {
+                Protocol::MapRequestPacket request;
+                if (!Protocol::Read(message, request))
+                {
+                    LogError("Malformed map request message");
+                }
+                else if (client != NULL && request.mapHash == m_map.GetHash())
+                {
+                    SendMap(client);
+                }
+            }
+            break;
+
+        default:
+            LogDebug("Unrecognized message: %i", messageType);
         }
-        break;
+    }
 
-    default:
-        LogDebug("Unrecognized packet: %i", packetType);
+    if (!reader.GetIsValid())
+    {
+        LogError("Malformed packet from peer %i", peerId);
     }
-    
+
 }
 
 float Server::GetTime() const
@@ -681,16 +910,40 @@ Map& Server::GetMap()
     return m_map;
 }
 
+PathFinder& Server::GetPathFinder()
+{
+    return m_pathFinder;
+}
+
+RoutePlanner& Server::GetRoutePlanner()
+{
+    return m_routePlanner;
+}
+
+float Server::GetHopTime(int stopA, int stopB) const
+{
+    if (m_routePlanner.GetIsBuilt())
+    {
+        return m_routePlanner.GetHopTime(stopA, stopB);
+    }
+    return Protocol::travelTime;
+}
+
 void Server::SendNotification(int peerId, Protocol::Notification notification, int agentId, int stop, int line)
 {
 
+    Client* client = FindClient(peerId);
+    if (client == NULL)
+    {
+        return;
+    }
+
     Protocol::NotificationPacket packet;
-    packet.packetType = Protocol::PacketType_Notification;
     packet.notification = notification;
     packet.agentId = agentId;
     packet.stop = stop;
     packet.line = line;
-    m_host.SendPacket(peerId, 0, &packet, sizeof(packet));
+    Protocol::Write(client->GetOutgoing(), packet);
 
 }
 
@@ -723,16 +976,48 @@ Server::Client* Server::FindClient(int peerId)
 void Server::SendClientState(int clientId)
 {
 
-    size_t dataSize = m_globalState.GetSerializedSize(clientId);
-    size_t packetSize = dataSize + sizeof(Protocol::StatePacketHeader);
-    char* buffer = new char[packetSize];
+    Client* client = FindClient(clientId);
+    if (client == NULL)
+    {
+        return;
+    }
+
+    // Serialize straight into the outgoing message.
+    MessageWriter& writer = client->GetOutgoing();
+    writer.BeginMessage(Protocol::MessageType_State);
+    writer.WriteVarUInt(client->GetLastOrder());
+    m_globalState.Serialize(clientId, writer);
+    writer.EndMessage();
+
+}
+
+void Server::SendMap(Client* client)
+{
+
+    // Only clients whose own map generation disagrees with ours ask for it.
+    if (m_mapData.empty())
+    {
+        m_map.Save(m_mapData);
+    }
+
+    LogMessage("Sending the map to client %i (%d KB)", client->GetId(), static_cast<int>(m_mapData.size() / 1024));
+
+    Protocol::MapDataPacket packet;
+    packet.data     = &m_mapData[0];
+    packet.dataSize = m_mapData.size();
+    Protocol::Write(client->GetOutgoing(), packet);
 
-    Protocol::StatePacket* packet = reinterpret_cast<Protocol::StatePacket*>(buffer);
-    packet->header.packetType = Protocol::PacketType_State;
-    packet->header.dataSize = dataSize;
-    m_globalState.Serialize(clientId, packet->data, dataSize);
-    m_host.SendPacket(clientId, 0, packet, packetSize);
-    delete[] buffer;
+}
+
+void Server::FlushClient(Client* client)
+{
+
+    MessageWriter& writer = client->GetOutgoing();
+    if (!writer.GetIsEmpty())
+    {
+        m_host.SendPacket(client->GetId(), 0, writer.GetData(), writer.GetSize());
+        writer.Clear();
+    }
 
 }
 
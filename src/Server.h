@@ -1,20 +1,24 @@
 #ifndef GAME_SERVER_H
 #define GAME_SERVER_H
 
-#include "Host.h"
+#include "NetworkThread.h"
 
 #include "Protocol.h"
 #include "EntityState.h"
 #include "Entity.h"
 #include "EntityType.h"
 #include "Map.h"
+#include "PathFinder.h"
+#include "RoutePlanner.h"
 #include "AgentEntity.h"
 #include "Random.h"
 #include "LanBroadcast.h"
+#include "Message.h"
 
-#include <hash_map>
+#include <map>
 
 class Map;
+class MapPool;
 class PlayerEntity;
 
 class Server : public Host::Handler
@@ -33,8 +37,15 @@ public:
 
         void OnOrder(const Protocol::OrderPacket& order);
 
+        // Applies the same order to several agents at once.
+        void OnGroupOrder(const Protocol::GroupOrderPacket& order);
+
+        // Sequence number of the last order received from the client, which
+        // is echoed back so it can discard its predictions.
+        unsigned int GetLastOrder() const;
+
         void UpdateHackingStatus();
-        void CheckForStakeout(AgentEntity* agent);
+        bool CheckForStakeout(AgentEntity* agent);
         void Infiltrate(AgentEntity* agent);
         void TakeIntel(AgentEntity* agent);
         void DropIntel(AgentEntity* agent);
@@ -43,19 +54,43 @@ public:
 
         void UpdateCounts();
 
+        // Messages queued for this client, sent as a single packet per tick.
+        MessageWriter& GetOutgoing();
+
     private:
 
         AgentEntity* FindAgent(int agentId);
+
+        void ExecuteOrder(AgentEntity* agent, Protocol::Order order, int targetStop);
+
+        // Starts the agent moving to an adjacent stop. Returns false if the
+        // agent is already moving or the stop isn't adjacent.
+        bool MoveAgent(AgentEntity* agent, int stop);
+
+        // Routes are followed one hop at a time as the agent arrives at each
+        // stop, until the destination is reached or the route is cancelled.
+        bool SetRoute(AgentEntity* agent, int destination);
+        void CancelRoute(AgentEntity* agent);
+        void AdvanceRoute(AgentEntity* agent);
         
         typedef std::vector<AgentEntity*> AgentList;
 
+        // Remaining stops for each agent following a route, keyed by agent id.
+        // Stored in reverse so the next hop is at the back.
+        typedef std::map<int, std::vector<int> > RouteMap;
+
         int                 m_id;
         Server*             m_server;
         Map*                m_map;
+        PathFinder*         m_pathFinder;
+        RoutePlanner*       m_routePlanner;
         EntityState*        m_state;
         Random              m_random;
         AgentList           m_agents;
+        RouteMap            m_routes;
         PlayerEntity*       m_player;
+        MessageWriter       m_outgoing;
+        unsigned int        m_lastOrder;
 
     };
 
@@ -69,7 +104,15 @@ public:
 
     typedef std::vector<Client*> ClientList;
 
-    Server();
+    // Dimensions of the maps the server plays on.
+    static const int s_gridSpacing  = 150;
+    static const int s_xMapSize     = s_gridSpacing * 9;
+    static const int s_yMapSize     = s_gridSpacing * 6;
+
+    // If railSpeed is 0 every hop takes the same time, otherwise travel is
+    // timed by rail length and routes are the quickest rather than the
+    // fewest hops. The map is taken from mapPool if it has one ready.
+    explicit Server(LanBroadcast::Mode discoveryMode = LanBroadcast::Mode_Broadcast, float railSpeed = 0.0f, MapPool* mapPool = NULL);
     virtual ~Server();
 
     void Update(float deltaTime);
@@ -83,6 +126,11 @@ public:
 
     EntityState& GetState();
     Map& GetMap();
+    PathFinder& GetPathFinder();
+    RoutePlanner& GetRoutePlanner();
+
+    // Time an agent takes to travel between two adjacent stops.
+    float GetHopTime(int stopA, int stopB) const;
 
     void SendNotification(int peerId, Protocol::Notification notification, int agentId, int stop, int line);
     void OnLineUsed(int clientId, int lineId);
@@ -96,22 +144,29 @@ private:
     
     Client* FindClient(int peerId);
     void SendClientState(int peerId);
+    void SendMap(Client* client);
+    void FlushClient(Client* client);
     int GetIntelAtStop(int stop);
     int PingIntel(int clientId, int lastPinged);
 
-    typedef stdext::hash_map<int, Client*> ClientMap;
+    typedef std::map<int, Client*> ClientMap;
     typedef std::vector<IntelData> IntelList;
 
     Random              m_random;
     LanBroadcast        m_lanBroadcast;
-    Host                m_host;
+    NetworkThread       m_host;
     ClientMap           m_clientMap;
     EntityTypeRegistry  m_typeRegistry;
     EntityState         m_globalState;
     Map                 m_map;
+    std::vector<unsigned char> m_mapData;   // Saved map, built the first time a client asks for it
+    PathFinder          m_pathFinder;
+    RoutePlanner        m_routePlanner;
+    float               m_railSpeed;
     float               m_time;
     float               m_timeSinceUpdate;
-    float               m_timeSinceBroadcast;
+    float               m_tickOverrunRate;      // Smoothed fraction of ticks that started late
+    float               m_load;                 // Smoothed fraction of the tick interval spent updating
     IntelList           m_intelList;
 
     int                 m_mapSeed;
@@ -0,0 +1,45 @@
+#include "Socket.h"
+
+#include <string.h>
+
+void Socket_Close(int socket)
+{
+    shutdown(socket, SD_SEND);
+#ifdef WIN32
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+bool Socket_GetIsReadable(int socket)
+{
+
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socket, &readSet);
+
+    timeval timeVal;
+    timeVal.tv_sec = 0;
+    timeVal.tv_usec = 0;
+
+    // The first argument is ignored by Winsock.
+    return select(socket + 1, &readSet, NULL, NULL, &timeVal) > 0;
+
+}
+
+void Socket_GetComputerName(char* name, size_t size)
+{
+
+    name[0] = 0;
+
+#ifdef WIN32
+    DWORD length = static_cast<DWORD>(size - 1);
+    GetComputerNameA(name, &length);
+#else
+    gethostname(name, size - 1);
+#endif
+
+    name[size - 1] = 0;
+
+}
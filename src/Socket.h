@@ -0,0 +1,47 @@
+#ifndef GAME_SOCKET_H
+#define GAME_SOCKET_H
+
+// Hides the differences between Winsock and BSD sockets so the LAN discovery
+// code can be shared between platforms.
+
+#ifdef WIN32
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+typedef int socklen_t;
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#define INVALID_SOCKET  (-1)
+#define SOCKET_ERROR    (-1)
+#define SD_SEND         SHUT_WR
+
+#endif
+
+#include <stddef.h>
+
+/**
+ * Closes a socket created with socket().
+ */
+void Socket_Close(int socket);
+
+/**
+ * Returns true if data can be read from the socket without blocking.
+ */
+bool Socket_GetIsReadable(int socket);
+
+/**
+ * Gets the name of this computer to show to other players. The name is
+ * always null terminated.
+ */
+void Socket_GetComputerName(char* name, size_t size);
+
+#endif
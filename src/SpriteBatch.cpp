@@ -0,0 +1,180 @@
+#include "SpriteBatch.h"
+#include "Texture.h"
+#include "TextLayout.h"
+
+#include <math.h>
+#include <assert.h>
+
+static const float kPi = 3.14159265359f;
+
+SpriteBatch::SpriteBatch()
+{
+    m_texture       = 0;
+    m_color[0]      = 0xFF;
+    m_color[1]      = 0xFF;
+    m_color[2]      = 0xFF;
+    m_color[3]      = 0xFF;
+    m_numDrawCalls  = 0;
+    m_drawing       = false;
+}
+
+void SpriteBatch::Begin()
+{
+    assert(!m_drawing);
+    m_drawing = true;
+    m_texture = 0;
+    m_numDrawCalls = 0;
+    m_vertices.clear();
+    SetColor(0xFFFFFFFF);
+}
+
+void SpriteBatch::End()
+{
+    assert(m_drawing);
+    Flush();
+    m_drawing = false;
+}
+
+void SpriteBatch::SetColor(unsigned long color)
+{
+    m_color[0] = static_cast<unsigned char>((color >> 16) & 0xFF);
+    m_color[1] = static_cast<unsigned char>((color >> 8) & 0xFF);
+    m_color[2] = static_cast<unsigned char>((color) & 0xFF);
+    m_color[3] = static_cast<unsigned char>((color >> 24) & 0xFF);
+}
+
+void SpriteBatch::Draw(const Texture& texture, int x, int y)
+{
+    Draw(texture, x, y, texture.xSize, texture.ySize);
+}
+
+void SpriteBatch::Draw(const Texture& texture, int x, int y, int width, int height)
+{
+
+    SetTexture(texture);
+
+    float x1 = static_cast<float>(x);
+    float y1 = static_cast<float>(y);
+    float x2 = static_cast<float>(x + width);
+    float y2 = static_cast<float>(y + height);
+
+    AddVertex(x1, y1, texture.u1, texture.v1);
+    AddVertex(x2, y1, texture.u2, texture.v1);
+    AddVertex(x2, y2, texture.u2, texture.v2);
+    AddVertex(x1, y2, texture.u1, texture.v2);
+
+}
+
+void SpriteBatch::Draw(const Texture& texture, const Vec2& position, const Vec2& scale, float rotation)
+{
+
+    SetTexture(texture);
+
+    float angle = rotation * kPi / 180.0f;
+    float c = cosf(angle);
+    float s = sinf(angle);
+
+    // Half extents of the scaled sprite along its rotated axes.
+    float xHalf = 0.5f * texture.xSize * scale.x;
+    float yHalf = 0.5f * texture.ySize * scale.y;
+    Vec2 xAxis(c * xHalf, s * xHalf);
+    Vec2 yAxis(-s * yHalf, c * yHalf);
+
+    Vec2 p1 = position - xAxis - yAxis;
+    Vec2 p2 = position + xAxis - yAxis;
+    Vec2 p3 = position + xAxis + yAxis;
+    Vec2 p4 = position - xAxis + yAxis;
+
+    AddVertex(p1.x, p1.y, texture.u1, texture.v1);
+    AddVertex(p2.x, p2.y, texture.u2, texture.v1);
+    AddVertex(p3.x, p3.y, texture.u2, texture.v2);
+    AddVertex(p4.x, p4.y, texture.u1, texture.v2);
+
+}
+
+void SpriteBatch::Draw(const TextLayout& text, int x, int y)
+{
+
+    if (text.GetTexture() == NULL)
+    {
+        return;
+    }
+
+    SetTexture(*text.GetTexture());
+
+    for (int i = 0; i < text.GetNumGlyphs(); ++i)
+    {
+        const TextLayout::Glyph& glyph = text.GetGlyph(i);
+
+        float x1 = static_cast<float>(x + glyph.x1);
+        float y1 = static_cast<float>(y + glyph.y1);
+        float x2 = static_cast<float>(x + glyph.x2);
+        float y2 = static_cast<float>(y + glyph.y2);
+
+        AddVertex(x1, y1, glyph.u1, glyph.v1);
+        AddVertex(x2, y1, glyph.u2, glyph.v1);
+        AddVertex(x2, y2, glyph.u2, glyph.v2);
+        AddVertex(x1, y2, glyph.u1, glyph.v2);
+    }
+
+}
+
+int SpriteBatch::GetNumDrawCalls() const
+{
+    return m_numDrawCalls;
+}
+
+void SpriteBatch::SetTexture(const Texture& texture)
+{
+    assert(m_drawing);
+    if (texture.handle != m_texture)
+    {
+        Flush();
+        m_texture = texture.handle;
+    }
+}
+
+void SpriteBatch::AddVertex(float x, float y, float u, float v)
+{
+    Vertex vertex;
+    vertex.x = x;
+    vertex.y = y;
+    vertex.u = u;
+    vertex.v = v;
+    vertex.color[0] = m_color[0];
+    vertex.color[1] = m_color[1];
+    vertex.color[2] = m_color[2];
+    vertex.color[3] = m_color[3];
+    m_vertices.push_back(vertex);
+}
+
+void SpriteBatch::Flush()
+{
+
+    if (m_vertices.empty())
+    {
+        return;
+    }
+
+    const Vertex* vertices = &m_vertices[0];
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    glVertexPointer(2, GL_FLOAT, sizeof(Vertex), &vertices->x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &vertices->u);
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), vertices->color);
+
+    glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(m_vertices.size()));
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    m_vertices.clear();
+    ++m_numDrawCalls;
+
+}
@@ -0,0 +1,67 @@
+#ifndef GAME_SPRITE_BATCH_H
+#define GAME_SPRITE_BATCH_H
+
+#include "OpenGL.h"
+
+#include <vector>
+
+struct Texture;
+class TextLayout;
+
+/**
+ * Collects sprites into a vertex array and draws them with as few calls as
+ * possible. Sprites are drawn in the order they're added; the batch is only
+ * flushed when the texture changes, so sprites from the same TextureAtlas
+ * page are drawn together with a single call. GL_TEXTURE_2D should be enabled
+ * while drawing, and the current GL color is undefined after End.
+ */
+class SpriteBatch
+{
+
+public:
+
+    SpriteBatch();
+
+    void Begin();
+    void End();
+
+    // Sets the color (ARGB) the following sprites are modulated by.
+    void SetColor(unsigned long color);
+
+    void Draw(const Texture& texture, int x, int y);
+    void Draw(const Texture& texture, int x, int y, int width, int height);
+
+    // Draws the texture centered on position after scaling it and rotating it
+    // by rotation degrees.
+    void Draw(const Texture& texture, const Vec2& position, const Vec2& scale, float rotation);
+
+    // Draws text laid out earlier with its top left corner at x, y.
+    void Draw(const TextLayout& text, int x, int y);
+
+    // Number of draw calls made since Begin.
+    int  GetNumDrawCalls() const;
+
+private:
+
+    struct Vertex
+    {
+        float           x, y;
+        float           u, v;
+        unsigned char   color[4];
+    };
+
+    void SetTexture(const Texture& texture);
+    void AddVertex(float x, float y, float u, float v);
+    void Flush();
+
+private:
+
+    std::vector<Vertex>     m_vertices;
+    GLuint                  m_texture;
+    unsigned char           m_color[4];
+    int                     m_numDrawCalls;
+    bool                    m_drawing;
+
+};
+
+#endif
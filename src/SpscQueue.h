@@ -0,0 +1,88 @@
+#ifndef GAME_SPSC_QUEUE_H
+#define GAME_SPSC_QUEUE_H
+
+#include "Atomic.h"
+
+#include <assert.h>
+#include <vector>
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer
+ * thread. Push must only be called from the producer and Pop only from the
+ * consumer.
+ */
+template <class T>
+class SpscQueue
+{
+
+public:
+
+    // The capacity must be a power of two.
+    explicit SpscQueue(unsigned int capacity);
+
+    // Returns false if the queue is full.
+    bool Push(const T& item);
+
+    // Returns false if the queue is empty.
+    bool Pop(T& item);
+
+private:
+
+    static const int s_cacheLineSize = 64;
+
+    std::vector<T>          m_items;
+    unsigned int            m_mask;
+
+    // The read and write positions are written by different threads, so keep
+    // them on separate cache lines.
+    char                    m_padding1[s_cacheLineSize];
+    volatile unsigned int   m_head;
+    char                    m_padding2[s_cacheLineSize];
+    volatile unsigned int   m_tail;
+    char                    m_padding3[s_cacheLineSize];
+
+};
+
+template <class T>
+SpscQueue<T>::SpscQueue(unsigned int capacity)
+{
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    m_items.resize(capacity);
+    m_mask = capacity - 1;
+    m_head = 0;
+    m_tail = 0;
+}
+
+template <class T>
+bool SpscQueue<T>::Push(const T& item)
+{
+    unsigned int tail = m_tail;
+    unsigned int head = Atomic_Load(m_head);
+
+    if (tail - head > m_mask)
+    {
+        return false;
+    }
+
+    m_items[tail & m_mask] = item;
+    Atomic_Store(m_tail, tail + 1);
+    return true;
+}
+
+template <class T>
+bool SpscQueue<T>::Pop(T& item)
+{
+    unsigned int head = m_head;
+    unsigned int tail = Atomic_Load(m_tail);
+
+    if (head == tail)
+    {
+        return false;
+    }
+
+    item = m_items[head & m_mask];
+    Atomic_Store(m_head, head + 1);
+    return true;
+}
+
+#endif
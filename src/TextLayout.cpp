@@ -0,0 +1,56 @@
+#include "TextLayout.h"
+#include "Font.h"
+#include "Utility.h"
+
+TextLayout::TextLayout()
+{
+    m_texture   = NULL;
+    m_width     = 0;
+    m_height    = 0;
+}
+
+void TextLayout::Set(const Font& font, const char* text)
+{
+
+    Clear();
+
+    m_texture = &font.texture;
+    m_height  = font.fontHeight;
+
+    int x = 0;
+    int y = 0;
+
+    for (; text[0] != 0; ++text)
+    {
+
+        if (text[0] == '\n')
+        {
+            y += font.fontHeight;
+            m_height += font.fontHeight;
+            x = 0;
+            continue;
+        }
+
+        Glyph glyph;
+        int width = Font_GetGlyph(font, (unsigned char)text[0], glyph.u1, glyph.v1, glyph.u2, glyph.v2);
+
+        glyph.x1 = x;
+        glyph.y1 = y;
+        glyph.x2 = x + width;
+        glyph.y2 = y + font.cellHeight;
+        m_glyphs.push_back(glyph);
+
+        x += width;
+        m_width = Max(m_width, x);
+
+    }
+
+}
+
+void TextLayout::Clear()
+{
+    m_texture   = NULL;
+    m_width     = 0;
+    m_height    = 0;
+    m_glyphs.clear();
+}
@@ -0,0 +1,51 @@
+#ifndef GAME_TEXT_LAYOUT_H
+#define GAME_TEXT_LAYOUT_H
+
+#include <vector>
+
+struct Font;
+struct Texture;
+
+/**
+ * A string laid out once into a quad per glyph, relative to the top left of
+ * the text. Drawing it with a SpriteBatch only copies the quads, so labels
+ * that rarely change don't need formatting or measuring every frame.
+ */
+class TextLayout
+{
+
+public:
+
+    struct Glyph
+    {
+        int     x1, y1;
+        int     x2, y2;
+        float   u1, v1;
+        float   u2, v2;
+    };
+
+    TextLayout();
+
+    // Lays out the text; newlines start a new row.
+    void Set(const Font& font, const char* text);
+    void Clear();
+
+    int  GetWidth() const { return m_width; }
+    int  GetHeight() const { return m_height; }
+
+    int  GetNumGlyphs() const { return static_cast<int>(m_glyphs.size()); }
+    const Glyph& GetGlyph(int i) const { return m_glyphs[i]; }
+
+    // The font's texture, or NULL if the layout is empty.
+    const Texture* GetTexture() const { return m_texture; }
+
+private:
+
+    const Texture*      m_texture;
+    std::vector<Glyph>  m_glyphs;
+    int                 m_width;
+    int                 m_height;
+
+};
+
+#endif
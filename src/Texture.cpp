@@ -1,29 +1,33 @@
 #include "Texture.h"
 #include "Render.h"
+#include "PixelFormat.h"
 
 #include <FreeImage.h>
 #include <stdio.h>
 #include <malloc.h>
 
-bool Texture_LoadFromMemory(Texture& texture, const void* buffer, size_t bufferLength)
+static int g_initialized = 0;
+
+void Texture_Initialize()
 {
+    if (!g_initialized)
+    {
+        FreeImage_Initialise(0);
+        g_initialized = 1;
+    }
+}
 
-    static int          init = 0;
+static unsigned char* Texture_DecodeFromMemory(const void* buffer, size_t bufferLength, int& xSize, int& ySize)
+{
 
     FIMEMORY*           stream = NULL;
     FIBITMAP*           bitmap = NULL;
     FREE_IMAGE_FORMAT   format;
     FREE_IMAGE_TYPE     type;
-    int                 xSize;
-    int                 ySize;
     unsigned int        bpp;
     unsigned int        pitch;
 
-    if (!init)
-    {
-        FreeImage_Initialise(0);
-        init = 1;
-    }
+    Texture_Initialize();
     
     stream = FreeImage_OpenMemory( (BYTE*)buffer, (DWORD)bufferLength );
     format = FreeImage_GetFileTypeFromMemory(stream, 0);
@@ -33,6 +37,11 @@ bool Texture_LoadFromMemory(Texture& texture, const void* buffer, size_t bufferL
     FreeImage_CloseMemory(stream);
     stream = NULL;
 
+    if (bitmap == NULL)
+    {
+        return NULL;
+    }
+
     xSize  = FreeImage_GetWidth(bitmap);
     ySize  = FreeImage_GetHeight(bitmap);
     bpp    = FreeImage_GetBPP(bitmap);
@@ -43,14 +52,17 @@ bool Texture_LoadFromMemory(Texture& texture, const void* buffer, size_t bufferL
     if (type != FIT_BITMAP)
     {
         FreeImage_Unload(bitmap);
-        return false;
+        return NULL;
     }
 
-    texture.handle = 0;
+    unsigned char* pixel = NULL;
 
-    if (bpp == 32)
+    // FreeImage stores the pixels as BGR(A) on the little endian machines the
+    // game runs on, with the bottom row first.
+    if (bpp == 32 || bpp == 24)
     {
-        unsigned char* pixel = (unsigned char*)malloc( 4 * xSize * ySize );
+
+        pixel = (unsigned char*)malloc( 4 * xSize * ySize );
 
         for (int y = 0; y < ySize; ++y)
         {
@@ -58,84 +70,119 @@ bool Texture_LoadFromMemory(Texture& texture, const void* buffer, size_t bufferL
             BYTE* scanline;
             scanline = FreeImage_GetScanLine(bitmap, ySize - y - 1);
 
-            for (int x = 0; x < xSize; ++x)
+            if (bpp == 32)
+            {
+                PixelFormat_ConvertBgraToRgba(scanline, pixel + y * xSize * 4, xSize);
+            }
+            else
             {
-                pixel[ (x + y * xSize) * 4 + 0 ] = scanline[x * 4 + FI_RGBA_RED];
-                pixel[ (x + y * xSize) * 4 + 1 ] = scanline[x * 4 + FI_RGBA_GREEN];
-                pixel[ (x + y * xSize) * 4 + 2 ] = scanline[x * 4 + FI_RGBA_BLUE];
-                pixel[ (x + y * xSize) * 4 + 3 ] = scanline[x * 4 + FI_RGBA_ALPHA];
+                PixelFormat_ConvertBgrToRgba(scanline, pixel + y * xSize * 4, xSize);
             }
-            
 
         }
 
-        texture.handle = Render_CreateTexture(xSize, ySize, pixel, 0);
-        free(pixel);
-
     }
-    else if (bpp == 24)
-    {
-
-        unsigned char* pixel = (unsigned char*)malloc( 4 * xSize * ySize );
 
-        for (int y = 0; y < ySize; ++y)
-        {
+    FreeImage_Unload(bitmap);
+    bitmap = NULL;
 
-            BYTE* scanline;
-            scanline = FreeImage_GetScanLine(bitmap, ySize - y - 1);
+    return pixel;
 
-            for (int x = 0; x < xSize; ++x)
-            {
-                pixel[ (x + y * xSize) * 4 + 0 ] = scanline[x * 3 + FI_RGBA_RED];
-                pixel[ (x + y * xSize) * 4 + 1 ] = scanline[x * 3 + FI_RGBA_GREEN];
-                pixel[ (x + y * xSize) * 4 + 2 ] = scanline[x * 3 + FI_RGBA_BLUE];
-                pixel[ (x + y * xSize) * 4 + 3 ] = 0xFF;
-            }
-            
-        }
+}
 
-        texture.handle = Render_CreateTexture(xSize, ySize, pixel, 0);
-        free(pixel);
+bool Texture_LoadFromMemory(Texture& texture, const void* buffer, size_t bufferLength)
+{
 
+    int xSize;
+    int ySize;
+    unsigned char* pixel = Texture_DecodeFromMemory(buffer, bufferLength, xSize, ySize);
 
+    if (pixel == NULL)
+    {
+        return false;
     }
 
+    texture.handle = Render_CreateTexture(xSize, ySize, pixel, 0);
+    free(pixel);
+
     texture.xSize = xSize;
     texture.ySize = ySize;
+    texture.u1 = 0.0f;
+    texture.v1 = 0.0f;
+    texture.u2 = 1.0f;
+    texture.v2 = 1.0f;
     
-    FreeImage_Unload(bitmap);
-    bitmap = NULL;
-
     return texture.handle != 0;
 
 }
 
-bool Texture_Load(Texture& texture, const char* fileName)
+// Reads a whole file into a buffer allocated with malloc. Returns NULL if the
+// file couldn't be opened or read, or is empty.
+static void* Texture_ReadFile(const char* fileName, size_t& bufferLength)
 {
 
-    FILE*   file            = NULL;
-    void*   buffer          = NULL;
-    size_t  bufferLength;
-
-    file = fopen(fileName, "rb");
+    FILE* file = fopen(fileName, "rb");
 
     if (file == NULL)
     {
-        return false;
+        return NULL;
     }
 
     fseek(file, 0, SEEK_END);
-    bufferLength = ftell(file);
-    
-    buffer = malloc(bufferLength);
+    long size = ftell(file);
     fseek(file, 0, SEEK_SET);
-    fread(buffer, 1, bufferLength, file);
+
+    void* buffer = NULL;
+    if (size > 0)
+    {
+        buffer = malloc(size);
+    }
+
+    if (buffer != NULL && fread(buffer, 1, size, file) != static_cast<size_t>(size))
+    {
+        free(buffer);
+        buffer = NULL;
+    }
 
     fclose(file);
 
+    bufferLength = buffer != NULL ? size : 0;
+    return buffer;
+
+}
+
+unsigned char* Texture_LoadPixels(const char* fileName, int& xSize, int& ySize)
+{
+
+    size_t bufferLength;
+    void* buffer = Texture_ReadFile(fileName, bufferLength);
+
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    unsigned char* pixel = Texture_DecodeFromMemory(buffer, bufferLength, xSize, ySize);
+    free(buffer);
+
+    return pixel;
+
+}
+
+bool Texture_Load(Texture& texture, const char* fileName)
+{
+
+    size_t bufferLength;
+    void* buffer = Texture_ReadFile(fileName, bufferLength);
+
+    if (buffer == NULL)
+    {
+        return false;
+    }
+
     bool result = Texture_LoadFromMemory(texture, buffer, bufferLength);
     free(buffer);
 
-    return true;
+    return result;
 
 }
@@ -8,12 +8,29 @@ struct Texture
     int     xSize;
     int     ySize;
     GLuint  handle;
+    // Part of the GL texture holding the image; less than the whole thing
+    // when the image was packed into a TextureAtlas.
+    float   u1, v1;
+    float   u2, v2;
 };
 
 
+/**
+ * Sets up the image decoder. Called automatically by the first load, but must
+ * be called before images are decoded on more than one thread.
+ */
+void Texture_Initialize();
+
 /**
  * Loads a texture from disk.
  */
 bool Texture_Load(Texture& texture, const char* fileName);
 
-#endif
\ No newline at end of file
+/**
+ * Decodes an image file into RGBA pixels without creating a texture, so it
+ * can be called from any thread. The result must be released with free.
+ * Returns NULL if the file couldn't be loaded.
+ */
+unsigned char* Texture_LoadPixels(const char* fileName, int& xSize, int& ySize);
+
+#endif
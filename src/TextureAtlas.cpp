@@ -0,0 +1,142 @@
+#include "TextureAtlas.h"
+#include "Texture.h"
+#include "Render.h"
+#include "Utility.h"
+
+#include <stdlib.h>
+
+// Size of each page (in pixels).
+static const int kPageSize = 1024;
+
+// Edge pixels of each image are repeated this far around it so that
+// filtering doesn't blend in the neighbouring images.
+static const int kPadding = 1;
+
+TextureAtlas::TextureAtlas()
+{
+    m_x             = 0;
+    m_y             = 0;
+    m_shelfHeight   = 0;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    Destroy();
+}
+
+bool TextureAtlas::Add(Texture& texture, const char* fileName)
+{
+
+    int xSize;
+    int ySize;
+    unsigned char* pixels = Texture_LoadPixels(fileName, xSize, ySize);
+
+    if (pixels == NULL)
+    {
+        texture.handle = 0;
+        return false;
+    }
+
+    Insert(texture, pixels, xSize, ySize);
+    free(pixels);
+    return true;
+
+}
+
+void TextureAtlas::Insert(Texture& texture, const unsigned char* pixels, int xSize, int ySize)
+{
+
+    texture.xSize = xSize;
+    texture.ySize = ySize;
+
+    const int xPadded = xSize + 2 * kPadding;
+    const int yPadded = ySize + 2 * kPadding;
+
+    if (xPadded > kPageSize || yPadded > kPageSize)
+    {
+        // Too big to share a page.
+        texture.handle = Render_CreateTexture(xSize, ySize, pixels, 0);
+        texture.u1 = 0.0f;
+        texture.v1 = 0.0f;
+        texture.u2 = 1.0f;
+        texture.v2 = 1.0f;
+        m_largeTextures.push_back(texture.handle);
+        return;
+    }
+
+    // Images are placed left to right along a shelf as tall as the tallest
+    // image on it, then a new shelf is started above it.
+    if (!m_pages.empty() && m_x + xPadded > kPageSize)
+    {
+        m_x = 0;
+        m_y += m_shelfHeight;
+        m_shelfHeight = 0;
+    }
+    if (m_pages.empty() || m_y + yPadded > kPageSize)
+    {
+        CreatePage();
+    }
+
+    const int x = m_x + kPadding;
+    const int y = m_y + kPadding;
+    m_x += xPadded;
+    m_shelfHeight = Max(m_shelfHeight, yPadded);
+
+    // Copy the image with its border so it goes up in one call.
+    m_padded.resize(xPadded * yPadded);
+    const unsigned int* src = reinterpret_cast<const unsigned int*>(pixels);
+    for (int py = 0; py < yPadded; ++py)
+    {
+        const unsigned int* srcRow = src + Clamp(py - kPadding, 0, ySize - 1) * xSize;
+        unsigned int* dstRow = &m_padded[py * xPadded];
+        for (int px = 0; px < xPadded; ++px)
+        {
+            dstRow[px] = srcRow[Clamp(px - kPadding, 0, xSize - 1)];
+        }
+    }
+
+    GLuint page = m_pages.back();
+    glBindTexture(GL_TEXTURE_2D, page);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x - kPadding, y - kPadding, xPadded, yPadded, GL_RGBA, GL_UNSIGNED_BYTE, &m_padded[0]);
+
+    texture.handle = page;
+    texture.u1 = static_cast<float>(x) / kPageSize;
+    texture.v1 = static_cast<float>(y) / kPageSize;
+    texture.u2 = static_cast<float>(x + xSize) / kPageSize;
+    texture.v2 = static_cast<float>(y + ySize) / kPageSize;
+
+}
+
+void TextureAtlas::CreatePage()
+{
+    m_pages.push_back(Render_CreateTexture(kPageSize, kPageSize, NULL, 0));
+    m_x = 0;
+    m_y = 0;
+    m_shelfHeight = 0;
+}
+
+void TextureAtlas::Destroy()
+{
+
+    if (!m_pages.empty())
+    {
+        glDeleteTextures(static_cast<GLsizei>(m_pages.size()), &m_pages[0]);
+        m_pages.clear();
+    }
+    if (!m_largeTextures.empty())
+    {
+        glDeleteTextures(static_cast<GLsizei>(m_largeTextures.size()), &m_largeTextures[0]);
+        m_largeTextures.clear();
+    }
+
+    m_x = 0;
+    m_y = 0;
+    m_shelfHeight = 0;
+
+}
+
+int TextureAtlas::GetNumPages() const
+{
+    return static_cast<int>(m_pages.size());
+}
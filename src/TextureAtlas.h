@@ -0,0 +1,56 @@
+#ifndef GAME_TEXTURE_ATLAS_H
+#define GAME_TEXTURE_ATLAS_H
+
+#include "OpenGL.h"
+
+#include <vector>
+
+struct Texture;
+
+/**
+ * Packs many small images into a few large textures (pages) so sprites using
+ * different images can be drawn without changing the bound texture. Images
+ * are placed on shelves as they're inserted and copied into their page
+ * straight away, so they can arrive one at a time while the game is running.
+ * The Texture is filled in with its page and area.
+ */
+class TextureAtlas
+{
+
+public:
+
+    TextureAtlas();
+    ~TextureAtlas();
+
+    // Decodes the image file and inserts it. Returns false if it couldn't be
+    // loaded.
+    bool Add(Texture& texture, const char* fileName);
+
+    // Copies RGBA pixels into the atlas. Must be called from the thread that
+    // owns the GL context.
+    void Insert(Texture& texture, const unsigned char* pixels, int xSize, int ySize);
+
+    // Deletes the pages; textures that were inserted become invalid.
+    void Destroy();
+
+    int  GetNumPages() const;
+
+private:
+
+    void CreatePage();
+
+private:
+
+    std::vector<GLuint>         m_pages;
+    std::vector<GLuint>         m_largeTextures;    // Images too big to share a page
+
+    // Free space on the last page.
+    int                         m_x;
+    int                         m_y;
+    int                         m_shelfHeight;
+
+    std::vector<unsigned int>   m_padded;       // Scratch space for the image with its border
+
+};
+
+#endif
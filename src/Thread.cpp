@@ -0,0 +1,91 @@
+#include "Thread.h"
+#include "Atomic.h"
+#include "Log.h"
+
+#include <SDL.h>
+
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct ParallelFor
+{
+    int             count;
+    volatile int    nextIndex;
+    void            (*function)(int index, void* data);
+    void*           data;
+};
+
+static int ParallelForThreadMain(void* data)
+{
+
+    ParallelFor* parallelFor = static_cast<ParallelFor*>(data);
+
+    // Each thread claims the next index until there are none left, so
+    // uneven amounts of work still balance out.
+    while (true)
+    {
+        int index = Atomic_Increment(parallelFor->nextIndex) - 1;
+        if (index >= parallelFor->count)
+        {
+            break;
+        }
+        parallelFor->function(index, parallelFor->data);
+    }
+
+    return 0;
+
+}
+
+int Thread_GetNumProcessors()
+{
+#ifdef WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    int numProcessors = static_cast<int>(systemInfo.dwNumberOfProcessors);
+#else
+    int numProcessors = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    return numProcessors > 0 ? numProcessors : 1;
+}
+
+void Thread_ParallelFor(int count, void (*function)(int index, void* data), void* data)
+{
+
+    ParallelFor parallelFor;
+    parallelFor.count       = count;
+    parallelFor.nextIndex   = 0;
+    parallelFor.function    = function;
+    parallelFor.data        = data;
+
+    int numThreads = Thread_GetNumProcessors();
+    if (numThreads > count)
+    {
+        numThreads = count;
+    }
+
+    // The calling thread does its share of the work too.
+    std::vector<SDL_Thread*> threads;
+    for (int i = 1; i < numThreads; ++i)
+    {
+        SDL_Thread* thread = SDL_CreateThread(ParallelForThreadMain, &parallelFor);
+        if (thread == NULL)
+        {
+            LogError("Failed to create a worker thread: %s", SDL_GetError());
+            break;
+        }
+        threads.push_back(thread);
+    }
+
+    ParallelForThreadMain(&parallelFor);
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        SDL_WaitThread(threads[i], NULL);
+    }
+
+}
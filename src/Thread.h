@@ -0,0 +1,17 @@
+#ifndef GAME_THREAD_H
+#define GAME_THREAD_H
+
+/**
+ * Returns the number of processors available to run threads on.
+ */
+int Thread_GetNumProcessors();
+
+/**
+ * Calls function(index, data) once for every index from 0 to count - 1 and
+ * returns when all of the calls have finished. The calls are spread over a
+ * worker thread per processor (including the calling thread), so they may
+ * run in any order and at the same time as each other.
+ */
+void Thread_ParallelFor(int count, void (*function)(int index, void* data), void* data);
+
+#endif
@@ -0,0 +1,26 @@
+#include "Timer.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <stddef.h>
+#endif
+
+double Timer_GetTime()
+{
+#ifdef WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+#else
+    timeval time;
+    gettimeofday(&time, NULL);
+    return time.tv_sec + time.tv_usec * 0.000001;
+#endif
+}
@@ -0,0 +1,11 @@
+#ifndef GAME_TIMER_H
+#define GAME_TIMER_H
+
+/**
+ * Returns the time in seconds from an arbitrary starting point, with much
+ * finer resolution than SDL_GetTicks. Only differences between two calls are
+ * meaningful.
+ */
+double Timer_GetTime();
+
+#endif
@@ -27,6 +27,7 @@ inline Vec2 operator*(float s, const Vec2& v) { return Vec2(s * v.x, s * v.y); }
 inline Vec2 operator/(const Vec2& v, float s) { return Vec2(v.x / s, v.y / s); }
 
 inline float DotProduct(const Vec2& u, const Vec2& v) { return u.x * v.x + u.y * v.y; }
+inline float Length(const Vec2& v) { return sqrtf(DotProduct(v, v)); }
 inline Vec2 Lerp(const Vec2& a, const Vec2& b, float t) { return a + t*(b - a); }
 
 #endif
\ No newline at end of file